@@ -141,10 +141,12 @@ struct all_attrs_item {
 /*
  * Reallocate and reinitialize the array of all attributes (which is used in
  * the attribute collection process) in 'check' based on the global dictionary
- * of attributes.
+ * of attributes.  Returns 1 if attributes were added to the dictionary
+ * since the last call, i.e. if the macros have to be looked up again.
  */
-static void all_attrs_init(struct attr_hashmap *map, struct attr_check *check)
+static int all_attrs_init(struct attr_hashmap *map, struct attr_check *check)
 {
+	int resized = 0;
 	int i;
 	unsigned int size;
 
@@ -166,6 +168,7 @@ static void all_attrs_init(struct attr_hashmap *map, struct attr_check *check)
 
 		REALLOC_ARRAY(check->all_attrs, size);
 		check->all_attrs_nr = size;
+		resized = 1;
 
 		hashmap_for_each_entry(&map->map, &iter, e,
 					ent /* member name */) {
@@ -181,10 +184,9 @@ static void all_attrs_init(struct attr_hashmap *map, struct attr_check *check)
 	 * This re-initialization can live outside of the locked region since
 	 * the attribute dictionary is no longer being accessed.
 	 */
-	for (i = 0; i < check->all_attrs_nr; i++) {
+	for (i = 0; i < check->all_attrs_nr; i++)
 		check->all_attrs[i].value = ATTR__UNKNOWN;
-		check->all_attrs[i].macro = NULL;
-	}
+	return resized;
 }
 
 /*
@@ -434,6 +436,8 @@ struct attr_stack {
 	unsigned num_matches;
 	unsigned alloc;
 	struct match_attr **attrs;
+	/* set for long lists, see PATTERN_INDEX_MIN */
+	struct pattern_index *index;
 };
 
 static void attr_stack_free(struct attr_stack *e)
@@ -457,6 +461,10 @@ static void attr_stack_free(struct attr_stack *e)
 		free(a);
 	}
 	free(e->attrs);
+	if (e->index) {
+		pattern_index_clear(e->index);
+		free(e->index);
+	}
 	free(e);
 }
 
@@ -895,10 +903,31 @@ int git_attr_system_is_enabled(void)
 
 static GIT_PATH_FUNC(git_path_info_attributes, INFOATTRIBUTES_FILE)
 
+static void index_attr_stack(struct attr_stack *elem)
+{
+	unsigned i;
+
+	/* the info/attributes frame is pushed again and again */
+	if (elem->index || elem->num_matches < PATTERN_INDEX_MIN)
+		return;
+
+	elem->index = xmalloc(sizeof(*elem->index));
+	pattern_index_init(elem->index);
+	for (i = 0; i < elem->num_matches; i++) {
+		const struct pattern *pat = &elem->attrs[i]->u.pat;
+
+		if (elem->attrs[i]->is_macro)
+			continue;
+		pattern_index_add(elem->index, i, pat->pattern, pat->patternlen,
+				  pat->nowildcardlen, pat->flags);
+	}
+}
+
 static void push_stack(struct attr_stack **attr_stack_p,
 		       struct attr_stack *elem, char *origin, size_t originlen)
 {
 	if (elem) {
+		index_attr_stack(elem);
 		elem->origin = origin;
 		if (origin)
 			elem->originlen = originlen;
@@ -947,13 +976,18 @@ static void bootstrap_attr_stack(struct index_state *istate,
 	push_stack(stack, e, NULL, 0);
 }
 
-static void prepare_attr_stack(struct index_state *istate,
-			       const struct object_id *tree_oid,
-			       const char *path, int dirlen,
-			       struct attr_stack **stack)
+/*
+ * Returns 1 if the frames on the stack below the "info" one changed,
+ * i.e. if the macros have to be looked up again.
+ */
+static int prepare_attr_stack(struct index_state *istate,
+			      const struct object_id *tree_oid,
+			      const char *path, int dirlen,
+			      struct attr_stack **stack)
 {
 	struct attr_stack *info;
 	struct strbuf pathbuf = STRBUF_INIT;
+	int changed = !*stack;
 
 	/*
 	 * At the bottom of the attribute stack is the built-in
@@ -996,6 +1030,7 @@ static void prepare_attr_stack(struct index_state *istate,
 
 		*stack = elem->prev;
 		attr_stack_free(elem);
+		changed = 1;
 	}
 
 	/*
@@ -1032,6 +1067,7 @@ static void prepare_attr_stack(struct index_state *istate,
 
 		origin = xstrdup(pathbuf.buf);
 		push_stack(stack, next, origin, len);
+		changed = 1;
 	}
 
 	/*
@@ -1040,6 +1076,7 @@ static void prepare_attr_stack(struct index_state *istate,
 	push_stack(stack, info, NULL, 0);
 
 	strbuf_release(&pathbuf);
+	return changed;
 }
 
 static int path_matches(const char *pathname, int pathlen,
@@ -1122,6 +1159,25 @@ static int fill(const char *path, int pathlen, int basename_offset,
 		unsigned i;
 		const char *base = stack->origin ? stack->origin : "";
 
+		if (stack->index) {
+			struct pattern_candidates candidates;
+			int pos;
+
+			pattern_index_lookup(stack->index,
+					     path + basename_offset,
+					     pathlen - basename_offset -
+					     (pathlen && path[pathlen - 1] == '/'),
+					     &candidates);
+			while (rem > 0 &&
+			       (pos = pattern_candidates_next(&candidates)) >= 0) {
+				const struct match_attr *a = stack->attrs[pos];
+				if (path_matches(path, pathlen, basename_offset,
+						 &a->u.pat, base, stack->originlen))
+					rem = fill_one(all_attrs, a, rem);
+			}
+			continue;
+		}
+
 		for (i = stack->num_matches; 0 < rem && 0 < i; i--) {
 			const struct match_attr *a = stack->attrs[i - 1];
 			if (a->is_macro)
@@ -1140,9 +1196,13 @@ static int fill(const char *path, int pathlen, int basename_offset,
  * This prevents having to search through the attribute stack each time
  * a macro needs to be expanded during the fill stage.
  */
-static void determine_macros(struct all_attrs_item *all_attrs,
+static void determine_macros(struct all_attrs_item *all_attrs, int nr,
 			     const struct attr_stack *stack)
 {
+	int i;
+
+	for (i = 0; i < nr; i++)
+		all_attrs[i].macro = NULL;
 	for (; stack; stack = stack->prev) {
 		unsigned i;
 		for (i = stack->num_matches; i > 0; i--) {
@@ -1183,9 +1243,14 @@ static void collect_some_attrs(struct index_state *istate,
 		dirlen = 0;
 	}
 
-	prepare_attr_stack(istate, tree_oid, path, dirlen, &check->stack);
-	all_attrs_init(&g_attr_hashmap, check);
-	determine_macros(check->all_attrs, check->stack);
+	/*
+	 * Paths in the same directory see the same stack, so the
+	 * macros only need to be looked up when moving to another one.
+	 */
+	if (prepare_attr_stack(istate, tree_oid, path, dirlen, &check->stack) |
+	    all_attrs_init(&g_attr_hashmap, check))
+		determine_macros(check->all_attrs, check->all_attrs_nr,
+				 check->stack);
 
 	rem = check->all_attrs_nr;
 	fill(path, pathlen, basename_offset, check->stack, check->all_attrs, rem);
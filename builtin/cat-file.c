@@ -29,6 +29,7 @@
 #include "promisor-remote.h"
 #include "mailmap.h"
 #include "write-or-die.h"
+#include "thread-utils.h"
 
 enum batch_mode {
 	BATCH_MODE_CONTENTS,
@@ -44,6 +45,7 @@ struct batch_options {
 	int buffer_output;
 	int all_objects;
 	int unordered;
+	int parallel;
 	int transform_mode; /* may be 'w' or 'c' for --filters or --textconv */
 	char input_delim;
 	char output_delim;
@@ -474,87 +476,87 @@ static void report_object_status(struct batch_options *opt,
 }
 
 /*
- * If "pack" is non-NULL, then "offset" is the byte offset within the pack from
- * which the object may be accessed (though note that we may also rely on
- * data->oid, too). If "pack" is NULL, then offset is ignored.
+ * Look up the object in "data", asking for whatever the format and the
+ * objects filter need. If "pack" is non-NULL, then "offset" is the byte
+ * offset within the pack from which the object may be accessed (though
+ * note that we may also rely on data->oid, too). If "pack" is NULL, then
+ * offset is ignored.
  */
-static void batch_object_write(const char *obj_name,
-			       struct strbuf *scratch,
-			       struct batch_options *opt,
+static int batch_object_lookup(struct batch_options *opt,
 			       struct expand_data *data,
 			       struct packed_git *pack,
 			       off_t offset)
 {
-	if (!data->skip_object_info) {
-		int ret;
+	if (use_mailmap ||
+	    opt->objects_filter.choice == LOFC_BLOB_NONE ||
+	    opt->objects_filter.choice == LOFC_BLOB_LIMIT ||
+	    opt->objects_filter.choice == LOFC_OBJECT_TYPE)
+		data->info.typep = &data->type;
+	if (opt->objects_filter.choice == LOFC_BLOB_LIMIT)
+		data->info.sizep = &data->size;
+
+	if (pack)
+		return packed_object_info(pack, offset, &data->info);
+	return odb_read_object_info_extended(the_repository->objects,
+					     &data->oid, &data->info,
+					     OBJECT_INFO_LOOKUP_REPLACE);
+}
 
-		if (use_mailmap ||
-		    opt->objects_filter.choice == LOFC_BLOB_NONE ||
-		    opt->objects_filter.choice == LOFC_BLOB_LIMIT ||
-		    opt->objects_filter.choice == LOFC_OBJECT_TYPE)
-			data->info.typep = &data->type;
-		if (opt->objects_filter.choice == LOFC_BLOB_LIMIT)
-			data->info.sizep = &data->size;
+static int batch_object_excluded(struct batch_options *opt,
+				 struct expand_data *data)
+{
+	switch (opt->objects_filter.choice) {
+	case LOFC_DISABLED:
+		return 0;
+	case LOFC_BLOB_NONE:
+		return data->type == OBJ_BLOB;
+	case LOFC_BLOB_LIMIT:
+		return data->type == OBJ_BLOB &&
+		       data->size >= opt->objects_filter.blob_limit_value;
+	case LOFC_OBJECT_TYPE:
+		return data->type != opt->objects_filter.object_type;
+	default:
+		BUG("unsupported objects filter");
+	}
+}
 
-		if (pack)
-			ret = packed_object_info(pack, offset, &data->info);
+/*
+ * Report an object whose lookup returned "lookup_ret" as missing, or as
+ * excluded by the objects filter. Returns 1 if the object has been
+ * reported and must not be printed.
+ */
+static int batch_object_skip(const char *obj_name,
+			     struct batch_options *opt,
+			     struct expand_data *data,
+			     int lookup_ret)
+{
+	if (lookup_ret < 0) {
+		if (data->mode == S_IFGITLINK)
+			report_object_status(opt, NULL, &data->oid, "submodule");
 		else
-			ret = odb_read_object_info_extended(the_repository->objects,
-							    &data->oid, &data->info,
-							    OBJECT_INFO_LOOKUP_REPLACE);
-		if (ret < 0) {
-			if (data->mode == S_IFGITLINK)
-				report_object_status(opt, NULL, &data->oid, "submodule");
-			else
-				report_object_status(opt, obj_name, &data->oid, "missing");
-			return;
-		}
-
-		switch (opt->objects_filter.choice) {
-		case LOFC_DISABLED:
-			break;
-		case LOFC_BLOB_NONE:
-			if (data->type == OBJ_BLOB) {
-				if (!opt->all_objects)
-					report_object_status(opt, obj_name,
-							     &data->oid, "excluded");
-				return;
-			}
-			break;
-		case LOFC_BLOB_LIMIT:
-			if (data->type == OBJ_BLOB &&
-			    data->size >= opt->objects_filter.blob_limit_value) {
-				if (!opt->all_objects)
-					report_object_status(opt, obj_name,
-							     &data->oid, "excluded");
-				return;
-			}
-			break;
-		case LOFC_OBJECT_TYPE:
-			if (data->type != opt->objects_filter.object_type) {
-				if (!opt->all_objects)
-					report_object_status(opt, obj_name,
-							     &data->oid, "excluded");
-				return;
-			}
-			break;
-		default:
-			BUG("unsupported objects filter");
-		}
-
-		if (use_mailmap && (data->type == OBJ_COMMIT || data->type == OBJ_TAG)) {
-			char *buf = NULL;
-
-			buf = odb_read_object(the_repository->objects, &data->oid,
-					      &data->type, &data->size);
-			if (!buf)
-				die(_("unable to read %s"), oid_to_hex(&data->oid));
-			buf = replace_idents_using_mailmap(buf, &data->size);
+			report_object_status(opt, obj_name, &data->oid, "missing");
+		return 1;
+	}
 
-			free(buf);
-		}
+	if (batch_object_excluded(opt, data)) {
+		if (!opt->all_objects)
+			report_object_status(opt, obj_name, &data->oid, "excluded");
+		return 1;
 	}
 
+	return 0;
+}
+
+/*
+ * Print the header line for "data" and, in contents mode, the object
+ * itself. If "contents" is non-NULL it holds the object as read by the
+ * caller; otherwise the object is read (or streamed) here.
+ */
+static void batch_object_print(struct strbuf *scratch,
+			       struct batch_options *opt,
+			       struct expand_data *data,
+			       const void *contents, size_t size)
+{
 	strbuf_reset(scratch);
 
 	if (!opt->format) {
@@ -567,24 +569,53 @@ static void batch_object_write(const char *obj_name,
 	batch_write(opt, scratch->buf, scratch->len);
 
 	if (opt->batch_mode == BATCH_MODE_CONTENTS) {
-		print_object_or_die(opt, data);
+		if (contents)
+			batch_write(opt, contents, size);
+		else
+			print_object_or_die(opt, data);
 		batch_write(opt, &opt->output_delim, 1);
 	}
 }
 
-static void batch_one_object(const char *obj_name,
-			     struct strbuf *scratch,
-			     struct batch_options *opt,
-			     struct expand_data *data)
+static void batch_object_write(const char *obj_name,
+			       struct strbuf *scratch,
+			       struct batch_options *opt,
+			       struct expand_data *data,
+			       struct packed_git *pack,
+			       off_t offset)
 {
-	struct object_context ctx = {0};
-	int flags =
-		GET_OID_HASH_ANY |
-		(opt->follow_symlinks ? GET_OID_FOLLOW_SYMLINKS : 0);
-	enum get_oid_result result;
+	if (!data->skip_object_info) {
+		int ret = batch_object_lookup(opt, data, pack, offset);
 
-	result = get_oid_with_context(the_repository, obj_name,
-				      flags, &data->oid, &ctx);
+		if (batch_object_skip(obj_name, opt, data, ret))
+			return;
+
+		if (use_mailmap && (data->type == OBJ_COMMIT || data->type == OBJ_TAG)) {
+			char *buf = NULL;
+
+			buf = odb_read_object(the_repository->objects, &data->oid,
+					      &data->type, &data->size);
+			if (!buf)
+				die(_("unable to read %s"), oid_to_hex(&data->oid));
+			buf = replace_idents_using_mailmap(buf, &data->size);
+
+			free(buf);
+		}
+	}
+
+	batch_object_print(scratch, opt, data, NULL, 0);
+}
+
+/*
+ * Report the outcome of resolving "obj_name" unless it names an object
+ * that should be printed. Returns 1 if something has been reported.
+ */
+static int report_unresolved_object(const char *obj_name,
+				    struct batch_options *opt,
+				    enum get_oid_result result,
+				    struct object_context *ctx,
+				    struct expand_data *data)
+{
 	if (result != FOUND) {
 		switch (result) {
 		case MISSING_OBJECT:
@@ -614,22 +645,47 @@ static void batch_one_object(const char *obj_name,
 			break;
 		}
 		fflush(stdout);
-
-		goto out;
+		return 1;
 	}
 
-	if (ctx.mode == 0) {
+	if (ctx->mode == 0) {
 		printf("symlink %"PRIuMAX"%c%s%c",
-		       (uintmax_t)ctx.symlink_path.len,
-		       opt->output_delim, ctx.symlink_path.buf, opt->output_delim);
+		       (uintmax_t)ctx->symlink_path.len,
+		       opt->output_delim, ctx->symlink_path.buf, opt->output_delim);
 		fflush(stdout);
-		goto out;
+		return 1;
 	}
 
-	data->mode = ctx.mode;
-	batch_object_write(obj_name, scratch, opt, data, NULL, 0);
+	return 0;
+}
+
+static enum get_oid_result resolve_batch_object(const char *obj_name,
+						 struct batch_options *opt,
+						 struct expand_data *data,
+						 struct object_context *ctx)
+{
+	int flags =
+		GET_OID_HASH_ANY |
+		(opt->follow_symlinks ? GET_OID_FOLLOW_SYMLINKS : 0);
+
+	return get_oid_with_context(the_repository, obj_name,
+				    flags, &data->oid, ctx);
+}
+
+static void batch_one_object(const char *obj_name,
+			     struct strbuf *scratch,
+			     struct batch_options *opt,
+			     struct expand_data *data)
+{
+	struct object_context ctx = {0};
+	enum get_oid_result result;
+
+	result = resolve_batch_object(obj_name, opt, data, &ctx);
+	if (!report_unresolved_object(obj_name, opt, result, &ctx, data)) {
+		data->mode = ctx.mode;
+		batch_object_write(obj_name, scratch, opt, data, NULL, 0);
+	}
 
-out:
 	object_context_release(&ctx);
 }
 
@@ -920,6 +976,265 @@ static void batch_each_object(struct batch_options *opt,
 	free_bitmap_index(bitmap);
 }
 
+/*
+ * Split at first whitespace, tying off the beginning of the string and
+ * saving the remainder (or NULL) in data->rest.
+ */
+static void split_batch_input(struct strbuf *input, struct expand_data *data)
+{
+	char *p = strpbrk(input->buf, " \t");
+	if (p) {
+		while (*p && strchr(" \t", *p))
+			*p++ = '\0';
+	}
+	data->rest = p;
+}
+
+/*
+ * With --batch-parallel, names read from stdin are resolved by the main
+ * thread and queued. Worker threads look up (and, for --batch, read)
+ * the queued objects, and the main thread prints them in input order
+ * as they become ready. Objects that would be streamed because they are
+ * larger than core.bigFileThreshold are left for the main thread.
+ */
+#define BATCH_PARALLEL_QUEUE_SIZE 128
+
+struct batch_parallel_item {
+	struct strbuf input;
+	struct object_context ctx;
+	enum get_oid_result result;
+	struct expand_data data;
+	int lookup_ret;
+	void *contents;
+	enum object_type contents_type;
+	size_t contents_size;
+	int done;
+};
+
+struct batch_parallel {
+	struct batch_options *opt;
+	unsigned long big_file_threshold;
+	struct batch_parallel_item items[BATCH_PARALLEL_QUEUE_SIZE];
+
+	/*
+	 * Items [written, added) are in the queue; those before "fetched"
+	 * have been picked up by a worker. Only the main thread modifies
+	 * "added" and "written"; the rest is protected by "mutex".
+	 */
+	size_t added, fetched, written;
+	int all_added;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond_add;
+	pthread_cond_t cond_done;
+};
+
+static void batch_parallel_fetch(struct batch_parallel *p,
+				 struct batch_parallel_item *item)
+{
+	struct batch_options *opt = p->opt;
+	struct expand_data *data = &item->data;
+
+	if (item->result != FOUND || !item->ctx.mode)
+		return;
+
+	item->lookup_ret = batch_object_lookup(opt, data, NULL, 0);
+	if (item->lookup_ret < 0 ||
+	    opt->batch_mode != BATCH_MODE_CONTENTS ||
+	    batch_object_excluded(opt, data))
+		return;
+	if (data->type == OBJ_BLOB && data->size >= p->big_file_threshold)
+		return;
+
+	item->contents = odb_read_object(the_repository->objects, &data->oid,
+					 &item->contents_type,
+					 &item->contents_size);
+}
+
+static void *batch_parallel_worker(void *arg)
+{
+	struct batch_parallel *p = arg;
+
+	pthread_mutex_lock(&p->mutex);
+	for (;;) {
+		struct batch_parallel_item *item;
+
+		while (p->fetched == p->added && !p->all_added)
+			pthread_cond_wait(&p->cond_add, &p->mutex);
+		if (p->fetched == p->added)
+			break;
+		item = &p->items[p->fetched++ % BATCH_PARALLEL_QUEUE_SIZE];
+		pthread_mutex_unlock(&p->mutex);
+
+		batch_parallel_fetch(p, item);
+
+		pthread_mutex_lock(&p->mutex);
+		item->done = 1;
+		pthread_cond_signal(&p->cond_done);
+	}
+	pthread_mutex_unlock(&p->mutex);
+
+	return NULL;
+}
+
+static void batch_parallel_print(struct batch_parallel *p,
+				 struct batch_parallel_item *item,
+				 struct strbuf *scratch)
+{
+	struct batch_options *opt = p->opt;
+	struct expand_data *data = &item->data;
+	const char *obj_name = item->input.buf;
+
+	if (report_unresolved_object(obj_name, opt, item->result,
+				     &item->ctx, data))
+		return;
+	if (batch_object_skip(obj_name, opt, data, item->lookup_ret))
+		return;
+
+	if (item->contents) {
+		if (item->contents_type != data->type)
+			die("object %s changed type!?", oid_to_hex(&data->oid));
+		if (item->contents_size != data->size)
+			die("object %s changed size!?", oid_to_hex(&data->oid));
+		batch_object_print(scratch, opt, data,
+				   item->contents, item->contents_size);
+	} else {
+		/* We may have to stream the object alongside the workers. */
+		obj_read_lock();
+		batch_object_print(scratch, opt, data, NULL, 0);
+		obj_read_unlock();
+	}
+}
+
+/*
+ * Print the oldest queued item, waiting for a worker to finish it if
+ * "wait" is set. Returns 1 if an item has been printed.
+ */
+static int batch_parallel_print_next(struct batch_parallel *p,
+				     struct strbuf *scratch, int wait)
+{
+	struct batch_parallel_item *item;
+
+	if (p->written == p->added)
+		return 0;
+	item = &p->items[p->written % BATCH_PARALLEL_QUEUE_SIZE];
+
+	pthread_mutex_lock(&p->mutex);
+	while (!item->done) {
+		if (!wait) {
+			pthread_mutex_unlock(&p->mutex);
+			return 0;
+		}
+		pthread_cond_wait(&p->cond_done, &p->mutex);
+	}
+	pthread_mutex_unlock(&p->mutex);
+
+	batch_parallel_print(p, item, scratch);
+
+	object_context_release(&item->ctx);
+	FREE_AND_NULL(item->contents);
+	item->done = 0;
+	p->written++;
+	return 1;
+}
+
+static void batch_parallel_add(struct batch_parallel *p,
+			       struct strbuf *input,
+			       struct strbuf *scratch,
+			       const struct expand_data *tmpl)
+{
+	struct batch_parallel_item *item;
+	struct expand_data *data;
+
+	while (p->added - p->written == BATCH_PARALLEL_QUEUE_SIZE)
+		batch_parallel_print_next(p, scratch, 1);
+
+	item = &p->items[p->added % BATCH_PARALLEL_QUEUE_SIZE];
+	strbuf_swap(&item->input, input);
+
+	/* Point the object_info requests at this item's own answers. */
+	data = &item->data;
+	*data = *tmpl;
+	if (tmpl->info.typep)
+		data->info.typep = &data->type;
+	if (tmpl->info.sizep || p->opt->batch_mode == BATCH_MODE_CONTENTS)
+		data->info.sizep = &data->size;
+	if (tmpl->info.disk_sizep)
+		data->info.disk_sizep = &data->disk_size;
+	if (tmpl->info.delta_base_oid)
+		data->info.delta_base_oid = &data->delta_base_oid;
+	if (data->split_on_whitespace)
+		split_batch_input(&item->input, data);
+
+	obj_read_lock();
+	item->result = resolve_batch_object(item->input.buf, p->opt,
+					    data, &item->ctx);
+	obj_read_unlock();
+	data->mode = item->ctx.mode;
+
+	pthread_mutex_lock(&p->mutex);
+	p->added++;
+	pthread_cond_signal(&p->cond_add);
+	pthread_mutex_unlock(&p->mutex);
+
+	while (batch_parallel_print_next(p, scratch, 0))
+		; /* nothing */
+}
+
+static void batch_objects_parallel(struct batch_options *opt,
+				   struct strbuf *scratch,
+				   struct expand_data *tmpl)
+{
+	struct batch_parallel *p;
+	struct strbuf input = STRBUF_INIT;
+	pthread_t *threads;
+	int i;
+
+	CALLOC_ARRAY(p, 1);
+	p->opt = opt;
+	p->big_file_threshold =
+		repo_settings_get_big_file_threshold(the_repository);
+	for (i = 0; i < BATCH_PARALLEL_QUEUE_SIZE; i++)
+		strbuf_init(&p->items[i].input, 0);
+	pthread_mutex_init(&p->mutex, NULL);
+	pthread_cond_init(&p->cond_add, NULL);
+	pthread_cond_init(&p->cond_done, NULL);
+	enable_obj_read_lock();
+
+	CALLOC_ARRAY(threads, opt->parallel);
+	for (i = 0; i < opt->parallel; i++) {
+		int err = pthread_create(&threads[i], NULL,
+					 batch_parallel_worker, p);
+		if (err)
+			die(_("cat-file: failed to create thread: %s"),
+			    strerror(err));
+	}
+
+	while (strbuf_getdelim_strip_crlf(&input, stdin, opt->input_delim) != EOF)
+		batch_parallel_add(p, &input, scratch, tmpl);
+
+	pthread_mutex_lock(&p->mutex);
+	p->all_added = 1;
+	pthread_cond_broadcast(&p->cond_add);
+	pthread_mutex_unlock(&p->mutex);
+
+	while (batch_parallel_print_next(p, scratch, 1))
+		; /* nothing */
+
+	for (i = 0; i < opt->parallel; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	disable_obj_read_lock();
+	pthread_cond_destroy(&p->cond_done);
+	pthread_cond_destroy(&p->cond_add);
+	pthread_mutex_destroy(&p->mutex);
+	for (i = 0; i < BATCH_PARALLEL_QUEUE_SIZE; i++)
+		strbuf_release(&p->items[i].input);
+	strbuf_release(&input);
+	free(p);
+}
+
 static int batch_objects(struct batch_options *opt)
 {
 	struct strbuf input = STRBUF_INIT;
@@ -1006,20 +1321,14 @@ static int batch_objects(struct batch_options *opt)
 		goto cleanup;
 	}
 
+	if (opt->parallel > 1) {
+		batch_objects_parallel(opt, &output, &data);
+		goto cleanup;
+	}
+
 	while (strbuf_getdelim_strip_crlf(&input, stdin, opt->input_delim) != EOF) {
-		if (data.split_on_whitespace) {
-			/*
-			 * Split at first whitespace, tying off the beginning
-			 * of the string and saving the remainder (or NULL) in
-			 * data.rest.
-			 */
-			char *p = strpbrk(input.buf, " \t");
-			if (p) {
-				while (*p && strchr(" \t", *p))
-					*p++ = '\0';
-			}
-			data.rest = p;
-		}
+		if (data.split_on_whitespace)
+			split_batch_input(&input, &data);
 
 		batch_one_object(input.buf, &output, opt, &data);
 	}
@@ -1079,6 +1388,7 @@ int cmd_cat_file(int argc,
 	const char *exp_type = NULL, *obj_name = NULL;
 	struct batch_options batch = {
 		.objects_filter = LIST_OBJECTS_FILTER_INIT,
+		.parallel = 1,
 	};
 	int unknown_type = 0;
 	int input_nul_terminated = 0;
@@ -1092,6 +1402,7 @@ int cmd_cat_file(int argc,
 		   "             [<rev>:<path|tree-ish> | --path=<path|tree-ish> <rev>]"),
 		N_("git cat-file (--batch | --batch-check | --batch-command) [--batch-all-objects]\n"
 		   "             [--buffer] [--follow-symlinks] [--unordered]\n"
+		   "             [--batch-parallel=<n>]\n"
 		   "             [--textconv | --filters] [-Z]"),
 		NULL
 	};
@@ -1135,6 +1446,8 @@ int cmd_cat_file(int argc,
 			 N_("follow in-tree symlinks")),
 		OPT_BOOL(0, "unordered", &batch.unordered,
 			 N_("do not order objects before emitting them")),
+		OPT_INTEGER(0, "batch-parallel", &batch.parallel,
+			    N_("look up objects with <n> worker threads")),
 		/* Textconv options, stand-ole*/
 		OPT_GROUP(N_("Emit object (blob or tree) with conversion or filter (stand-alone, or with batch)")),
 		OPT_CMDMODE(0, "textconv", &opt,
@@ -1195,6 +1508,9 @@ int cmd_cat_file(int argc,
 	else if (batch.all_objects)
 		usage_msg_optf(_("'%s' requires a batch mode"), builtin_catfile_usage,
 			       options, "--batch-all-objects");
+	else if (batch.parallel != 1)
+		usage_msg_optf(_("'%s' requires a batch mode"), builtin_catfile_usage,
+			       options, "--batch-parallel");
 	else if (input_nul_terminated)
 		usage_msg_optf(_("'%s' requires a batch mode"), builtin_catfile_usage,
 			       options, "-z");
@@ -1208,6 +1524,26 @@ int cmd_cat_file(int argc,
 	if (nul_terminated)
 		batch.input_delim = batch.output_delim = '\0';
 
+	if (batch.parallel < 0)
+		die(_("invalid number of threads specified (%d)"), batch.parallel);
+	else if (batch.parallel == 0)
+		batch.parallel = HAVE_THREADS ? online_cpus() : 1;
+	else if (!HAVE_THREADS && batch.parallel > 1) {
+		warning(_("no threads support, ignoring %s"), "--batch-parallel");
+		batch.parallel = 1;
+	}
+	if (batch.parallel > 1) {
+		die_for_incompatible_opt2(1, "--batch-parallel",
+					  batch.batch_mode == BATCH_MODE_QUEUE_AND_DISPATCH,
+					  "--batch-command");
+		die_for_incompatible_opt2(1, "--batch-parallel",
+					  batch.all_objects, "--batch-all-objects");
+		die_for_incompatible_opt2(1, "--batch-parallel",
+					  opt_cw, opt == 'c' ? "--textconv" : "--filters");
+		die_for_incompatible_opt2(1, "--batch-parallel",
+					  use_mailmap, "--use-mailmap");
+	}
+
 	/* Batch defaults */
 	if (batch.buffer_output < 0)
 		batch.buffer_output = batch.all_objects;
@@ -7,6 +7,7 @@
 #include "dir.h"
 #include "environment.h"
 #include "gettext.h"
+#include "lockfile.h"
 #include "parse-options.h"
 #include "fsmonitor-ll.h"
 #include "fsmonitor-ipc.h"
@@ -42,6 +43,9 @@ static int fsmonitor__start_timeout_sec = 60;
 #define FSMONITOR__ANNOUNCE_STARTUP "fsmonitor.announcestartup"
 static int fsmonitor__announce_startup = 0;
 
+#define FSMONITOR__JOURNAL "fsmonitor.journal"
+static int fsmonitor__journal = 1;
+
 static int fsmonitor_config(const char *var, const char *value,
 			    const struct config_context *ctx, void *cb)
 {
@@ -73,6 +77,11 @@ static int fsmonitor_config(const char *var, const char *value,
 		return 0;
 	}
 
+	if (!strcmp(var, FSMONITOR__JOURNAL)) {
+		fsmonitor__journal = git_config_bool(var, value);
+		return 0;
+	}
+
 	return git_default_config(var, value, ctx, cb);
 }
 
@@ -348,7 +357,8 @@ static void with_lock__abort_all_cookies(struct fsmonitor_daemon_state *state)
  *
  * A new token_id is created:
  *
- * [1] each time the daemon is started.
+ * [1] each time the daemon is started (unless it can pick up the
+ *     token journal left behind by the previous daemon, see below).
  *
  * [2] any time that the daemon must re-sync with the filesystem
  *     (such as when the kernel drops or we miss events on a very
@@ -371,6 +381,17 @@ struct fsmonitor_token_data {
 	struct fsmonitor_batch *batch_head;
 	struct fsmonitor_batch *batch_tail;
 	uint64_t client_ref_count;
+
+	/*
+	 * The token journal on disk allows sequence numbers up to
+	 * `journal_reserved_seq_nr` to be handed out.  A token restored
+	 * from a journal does not know about the sequence numbers in
+	 * (`journal_gap_start`, `journal_gap_end`], which the previous
+	 * daemon may have handed out after it last wrote its journal.
+	 */
+	uint64_t journal_reserved_seq_nr;
+	uint64_t journal_gap_start;
+	uint64_t journal_gap_end;
 };
 
 struct fsmonitor_batch {
@@ -630,6 +651,421 @@ void fsmonitor_force_resync(struct fsmonitor_daemon_state *state)
 	pthread_mutex_unlock(&state->main_lock);
 }
 
+/*
+ * Token Journal
+ * =============
+ *
+ * The daemon periodically writes the current <token_id> and its
+ * batch list to "<gitdir>/fsmonitor--daemon/journal", together with
+ * the time at which it was known to be in sync with the filesystem
+ * (that is, a cookie it created at that time had been seen) and the
+ * identity of the worktree root directory.
+ *
+ * A newly started daemon that finds a journal for the same worktree
+ * root adopts its <token_id> and batches instead of starting a new
+ * series, so that clients holding a recent token do not receive a
+ * trivial response.  Changes made while no daemon was running are
+ * found by looking for files and directories whose mtime or ctime is
+ * not older than the journal.  Changing the contents, mode, or name
+ * of a file updates its ctime, and creating, deleting, or renaming
+ * an entry updates the mtime of its directory, which we report as
+ * a whole.  This scan runs only once the listener is known to be
+ * receiving events, and clients wait until it is done.
+ *
+ * Sequence numbers are reserved in the journal ahead of use, so that
+ * tokens handed out after the last write cannot be confused with the
+ * ones issued by the new daemon.  Those tokens get a trivial response.
+ *
+ * This relies on ctime being the inode change time, which is not
+ * what it means on Windows, so the journal is not used there.
+ */
+#define JOURNAL_VERSION 1
+#define JOURNAL_RESERVE_SEQ_NR (1024)
+#define JOURNAL_WRITE_INTERVAL (30) /* seconds */
+#define JOURNAL_TIME_SLACK (2) /* seconds */
+
+#ifdef GIT_WINDOWS_NATIVE
+#define journal_enabled() (0)
+#else
+#define journal_enabled() (fsmonitor__journal)
+#endif
+
+struct journal_root_id {
+	uintmax_t dev;
+	uintmax_t ino;
+	uint64_t generation;
+};
+
+static int journal_get_root_id(struct fsmonitor_daemon_state *state,
+			       struct journal_root_id *id)
+{
+	struct stat st;
+
+	if (lstat(state->path_worktree_watch.buf, &st))
+		return error_errno(_("lstat('%s') failed"),
+				   state->path_worktree_watch.buf);
+	id->dev = st.st_dev;
+	id->ino = st.st_ino;
+	return fsmonitor__get_inode_generation(state->path_worktree_watch.buf,
+					       &id->generation);
+}
+
+static int with_lock__write_journal(struct fsmonitor_daemon_state *state,
+				    struct fsmonitor_token_data *token,
+				    time_t synced)
+{
+	/* assert current thread holding state->main_lock */
+
+	struct lock_file lk = LOCK_INIT;
+	struct strbuf buf = STRBUF_INIT;
+	struct journal_root_id id;
+	const struct fsmonitor_batch *batch;
+	uint64_t reserved;
+	size_t k;
+	int ret = -1;
+
+	if (journal_get_root_id(state, &id))
+		goto done;
+
+	reserved = token->batch_head->batch_seq_nr + JOURNAL_RESERVE_SEQ_NR;
+
+	strbuf_addf(&buf, "fsmonitor-journal %d\n", JOURNAL_VERSION);
+	strbuf_addf(&buf, "root %"PRIuMAX" %"PRIuMAX" %"PRIu64"\n",
+		    id.dev, id.ino, id.generation);
+	strbuf_addf(&buf, "time %"PRIuMAX"\n", (uintmax_t)synced);
+	strbuf_addf(&buf, "token %s\n", token->token_id.buf);
+	strbuf_addf(&buf, "reserved %"PRIu64"\n", reserved);
+	for (batch = token->batch_head; batch; batch = batch->next) {
+		strbuf_addf(&buf, "batch %"PRIu64" %"PRIuMAX"\n",
+			    batch->batch_seq_nr, (uintmax_t)batch->nr);
+		for (k = 0; k < batch->nr; k++)
+			strbuf_add(&buf, batch->interned_paths[k],
+				   strlen(batch->interned_paths[k]) + 1);
+	}
+
+	if (hold_lock_file_for_update(&lk, state->path_journal.buf, 0) < 0) {
+		error_errno(_("could not lock '%s'"), state->path_journal.buf);
+		goto done;
+	}
+	if (write_in_full(get_lock_file_fd(&lk), buf.buf, buf.len) < 0 ||
+	    commit_lock_file(&lk) < 0) {
+		error_errno(_("could not write '%s'"), state->path_journal.buf);
+		rollback_lock_file(&lk);
+		goto done;
+	}
+
+	trace_printf_key(&trace_fsmonitor, "journal: wrote '%s' reserved %"PRIu64,
+			 token->token_id.buf, reserved);
+	token->journal_reserved_seq_nr = reserved;
+	state->journal_last_write = time(NULL);
+	ret = 0;
+
+done:
+	strbuf_release(&buf);
+	return ret;
+}
+
+/*
+ * Called whenever a batch has been pinned for a client.  `synced` is
+ * the time at which we last knew to be in sync with the filesystem,
+ * or zero if we could not sync.
+ */
+static void with_lock__update_journal(struct fsmonitor_daemon_state *state,
+				      struct fsmonitor_token_data *token,
+				      time_t synced)
+{
+	/* assert current thread holding state->main_lock */
+
+	int must_write = token->batch_head->batch_seq_nr >
+		token->journal_reserved_seq_nr;
+
+	if (!journal_enabled())
+		return;
+
+	if (synced &&
+	    (must_write ||
+	     synced - state->journal_last_write >= JOURNAL_WRITE_INTERVAL) &&
+	    !with_lock__write_journal(state, token, synced))
+		return;
+
+	if (must_write) {
+		/*
+		 * We are about to hand out a sequence number that the
+		 * journal does not account for.  Rather than let a later
+		 * daemon reuse it, make sure that there is no journal.
+		 */
+		if (unlink(state->path_journal.buf) && errno != ENOENT)
+			error_errno(_("could not remove '%s'"),
+				    state->path_journal.buf);
+		token->journal_reserved_seq_nr = UINT64_MAX;
+	}
+}
+
+static const char *journal_next_line(const char **p, const char *end,
+				     const char *prefix)
+{
+	const char *eol = memchr(*p, '\n', end - *p);
+	const char *value;
+
+	if (!eol || !skip_prefix(*p, prefix, &value) || value > eol)
+		return NULL;
+	*p = eol + 1;
+	return value;
+}
+
+static struct fsmonitor_token_data *journal_parse(
+	struct fsmonitor_daemon_state *state, const char *p, const char *end,
+	time_t *synced)
+{
+	struct fsmonitor_token_data *token;
+	struct fsmonitor_batch **tail;
+	struct journal_root_id id;
+	const char *v;
+	char *v_end;
+	uintmax_t dev, ino;
+	uint64_t generation, prev_seq_nr;
+	time_t now = time(NULL);
+
+	if (journal_get_root_id(state, &id))
+		return NULL;
+
+	if (!(v = journal_next_line(&p, end, "fsmonitor-journal ")) ||
+	    strtol(v, &v_end, 10) != JOURNAL_VERSION || *v_end != '\n')
+		return NULL;
+
+	if (!(v = journal_next_line(&p, end, "root ")))
+		return NULL;
+	dev = strtoumax(v, &v_end, 10);
+	ino = strtoumax(v_end, &v_end, 10);
+	generation = strtoumax(v_end, &v_end, 10);
+	if (*v_end != '\n' || dev != id.dev || ino != id.ino ||
+	    generation != id.generation) {
+		trace_printf_key(&trace_fsmonitor,
+				 "journal: worktree root has changed");
+		return NULL;
+	}
+
+	if (!(v = journal_next_line(&p, end, "time ")))
+		return NULL;
+	*synced = strtoumax(v, &v_end, 10);
+	if (*v_end != '\n' || *synced <= JOURNAL_TIME_SLACK || *synced > now)
+		return NULL;
+
+	if (!(v = journal_next_line(&p, end, "token ")) || *v == '\n')
+		return NULL;
+
+	CALLOC_ARRAY(token, 1);
+	strbuf_init(&token->token_id, 0);
+	strbuf_add(&token->token_id, v, p - 1 - v);
+
+	if (!(v = journal_next_line(&p, end, "reserved ")))
+		goto corrupt;
+	token->journal_reserved_seq_nr = strtoumax(v, &v_end, 10);
+	if (*v_end != '\n' || !token->journal_reserved_seq_nr ||
+	    token->journal_reserved_seq_nr >= UINT64_MAX - 1)
+		goto corrupt;
+
+	prev_seq_nr = token->journal_reserved_seq_nr + 1;
+	tail = &token->batch_head;
+	while (p < end) {
+		struct fsmonitor_batch *batch;
+		uintmax_t nr;
+
+		if (!(v = journal_next_line(&p, end, "batch ")))
+			goto corrupt;
+
+		batch = fsmonitor_batch__new();
+		batch->pinned_time = now;
+		*tail = batch;
+		tail = &batch->next;
+		token->batch_tail = batch;
+
+		batch->batch_seq_nr = strtoumax(v, &v_end, 10);
+		nr = strtoumax(v_end, &v_end, 10);
+		if (*v_end != '\n' || batch->batch_seq_nr >= prev_seq_nr)
+			goto corrupt;
+		prev_seq_nr = batch->batch_seq_nr;
+
+		while (nr--) {
+			const char *nul = memchr(p, '\0', end - p);
+
+			if (!nul)
+				goto corrupt;
+			ALLOC_GROW(batch->interned_paths, batch->nr + 1,
+				   batch->alloc);
+			batch->interned_paths[batch->nr++] = strintern(p);
+			p = nul + 1;
+		}
+	}
+	if (!token->batch_head)
+		goto corrupt;
+
+	return token;
+
+corrupt:
+	trace_printf_key(&trace_fsmonitor, "journal: corrupt");
+	strbuf_release(&token->token_id);
+	fsmonitor_batch__free_list(token->batch_head);
+	free(token);
+	return NULL;
+}
+
+/*
+ * Try to pick up the token journal of a previous daemon.  The journal
+ * is removed either way, as it would not be valid for the daemon
+ * after us.
+ */
+static void journal_restore(struct fsmonitor_daemon_state *state)
+{
+	struct strbuf buf = STRBUF_INIT;
+	struct fsmonitor_token_data *token;
+	struct fsmonitor_batch *batch;
+	time_t synced;
+
+	if (!journal_enabled() ||
+	    strbuf_read_file(&buf, state->path_journal.buf, 0) < 0)
+		goto done;
+	unlink(state->path_journal.buf);
+
+	token = journal_parse(state, buf.buf, buf.buf + buf.len, &synced);
+	if (!token)
+		goto done;
+
+	/*
+	 * Start our own batches past the reserved sequence numbers.
+	 * This head batch collects the changes that we missed while
+	 * no daemon was running.
+	 */
+	token->journal_gap_start = token->batch_head->batch_seq_nr;
+	token->journal_gap_end = token->journal_reserved_seq_nr;
+
+	batch = fsmonitor_batch__new();
+	batch->batch_seq_nr = token->journal_reserved_seq_nr + 1;
+	batch->next = token->batch_head;
+	token->batch_head = batch;
+
+	fsmonitor_free_token_data(state->current_token_data);
+	state->current_token_data = token;
+	state->journal_time = synced;
+	state->journal_catch_up = 1;
+
+	trace_printf_key(&trace_fsmonitor, "journal: restored '%s'",
+			 token->token_id.buf);
+	trace2_data_string("fsmonitor", the_repository, "journal/restored",
+			   token->token_id.buf);
+
+done:
+	strbuf_release(&buf);
+}
+
+static int journal_scan_dir(struct fsmonitor_daemon_state *state,
+			    struct strbuf *path, time_t cutoff,
+			    struct fsmonitor_batch *batch)
+{
+	size_t len = path->len;
+	struct dirent *de;
+	DIR *dir;
+	int ret = 0;
+
+	dir = opendir(path->buf);
+	if (!dir) {
+		if (errno == ENOENT || errno == ENOTDIR)
+			return 0; /* the listener will tell */
+		return error_errno(_("opendir('%s') failed"), path->buf);
+	}
+
+	while (!ret && (de = readdir_skip_dot_and_dotdot(dir))) {
+		struct stat st;
+
+		if (len == state->path_worktree_watch.len &&
+		    !fspathcmp(de->d_name, ".git"))
+			continue;
+
+		strbuf_setlen(path, len);
+		strbuf_addf(path, "/%s", de->d_name);
+		if (lstat(path->buf, &st)) {
+			if (errno == ENOENT)
+				continue;
+			ret = error_errno(_("lstat('%s') failed"), path->buf);
+			break;
+		}
+
+		if (st.st_mtime >= cutoff || st.st_ctime >= cutoff)
+			fsmonitor_batch__add_path(batch, path->buf +
+						  state->path_worktree_watch.len + 1);
+		if (S_ISDIR(st.st_mode))
+			ret = journal_scan_dir(state, path, cutoff, batch);
+	}
+
+	closedir(dir);
+	strbuf_setlen(path, len);
+	return ret;
+}
+
+/*
+ * Find what changed since the restored journal was written.  We have
+ * to be sure that the listener is receiving events before we look,
+ * so that nothing can slip past both.
+ */
+static void journal_catch_up(struct fsmonitor_daemon_state *state)
+{
+	struct fsmonitor_batch *batch = fsmonitor_batch__new();
+	struct string_list no_cookies = STRING_LIST_INIT_NODUP;
+	struct strbuf path = STRBUF_INIT;
+	time_t cutoff = state->journal_time - JOURNAL_TIME_SLACK;
+	enum fsmonitor_cookie_item_result result = FCIR_INIT;
+	struct stat st;
+	int tries = 0;
+	int ret = -1;
+
+	trace2_region_enter("fsmonitor", "journal/catch-up", the_repository);
+
+	/*
+	 * Some listeners only start to receive events when their thread
+	 * is running, so the first cookies may go unseen.
+	 */
+	pthread_mutex_lock(&state->main_lock);
+	while (result != FCIR_SEEN && tries++ < 5)
+		result = with_lock__wait_for_cookie(state);
+	pthread_mutex_unlock(&state->main_lock);
+	if (result != FCIR_SEEN)
+		goto done;
+
+	/*
+	 * Entries deleted from the worktree root have no directory
+	 * that we could report instead.
+	 */
+	strbuf_addbuf(&path, &state->path_worktree_watch);
+	if (lstat(path.buf, &st) ||
+	    st.st_mtime >= cutoff || st.st_ctime >= cutoff) {
+		trace_printf_key(&trace_fsmonitor,
+				 "journal: worktree root has changed");
+		goto done;
+	}
+
+	if (journal_scan_dir(state, &path, cutoff, batch))
+		goto done;
+
+	trace2_data_intmax("fsmonitor", the_repository, "journal/catch-up",
+			   batch->nr);
+	fsmonitor_publish(state, batch, &no_cookies);
+	batch = NULL;
+	ret = 0;
+
+done:
+	pthread_mutex_lock(&state->main_lock);
+	if (ret)
+		with_lock__do_force_resync(state);
+	state->journal_catch_up = 0;
+	pthread_cond_broadcast(&state->journal_cond);
+	pthread_mutex_unlock(&state->main_lock);
+
+	trace2_region_leave("fsmonitor", "journal/catch-up", the_repository);
+
+	fsmonitor_batch__free_list(batch);
+	strbuf_release(&path);
+}
+
 /*
  * Format an opaque token string to send to the client.
  */
@@ -695,6 +1131,7 @@ static int do_handle_client(struct fsmonitor_daemon_state *state,
 	int do_flush = 0;
 	int do_cookie = 0;
 	enum fsmonitor_cookie_item_result cookie_result;
+	time_t synced = 0;
 
 	/*
 	 * We expect `command` to be of the form:
@@ -763,6 +1200,13 @@ static int do_handle_client(struct fsmonitor_daemon_state *state,
 
 	pthread_mutex_lock(&state->main_lock);
 
+	/*
+	 * A restored token journal does not know about the changes
+	 * made while no daemon was running until we have caught up.
+	 */
+	while (state->journal_catch_up)
+		pthread_cond_wait(&state->journal_cond, &state->main_lock);
+
 	if (!state->current_token_data)
 		BUG("fsmonitor state does not have a current token");
 
@@ -782,11 +1226,15 @@ static int do_handle_client(struct fsmonitor_daemon_state *state,
 	 * on the FS still in flight.
 	 */
 	if (do_cookie) {
+		time_t before = time(NULL);
+
 		cookie_result = with_lock__wait_for_cookie(state);
 		if (cookie_result != FCIR_SEEN) {
 			error(_("fsmonitor: cookie_result '%d' != SEEN"),
 			      cookie_result);
 			do_trivial = 1;
+		} else {
+			synced = before;
 		}
 	}
 
@@ -803,6 +1251,8 @@ static int do_handle_client(struct fsmonitor_daemon_state *state,
 	batch_head = token_data->batch_head;
 	((struct fsmonitor_batch *)batch_head)->pinned_time = time(NULL);
 
+	with_lock__update_journal(state, token_data, synced);
+
 	/*
 	 * FSMonitor Protocol V2 requires that we send a response header
 	 * with a "new current token" and then all of the paths that changed
@@ -832,6 +1282,19 @@ static int do_handle_client(struct fsmonitor_daemon_state *state,
 					   "response/token", "different");
 			do_trivial = 1;
 
+		} else if (requested_oldest_seq_nr >
+			   token_data->journal_gap_start &&
+			   requested_oldest_seq_nr <=
+			   token_data->journal_gap_end) {
+			/*
+			 * The client got this token from the previous
+			 * daemon after it last wrote its journal, so we
+			 * do not know what it has already seen.
+			 */
+			trace_printf_key(&trace_fsmonitor,
+					 "client token is past the journal");
+			do_trivial = 1;
+
 		} else if (requested_oldest_seq_nr <
 			   token_data->batch_tail->batch_seq_nr) {
 			/*
@@ -1008,6 +1471,7 @@ static int handle_client(void *data,
 
 #define FSMONITOR_DIR           "fsmonitor--daemon"
 #define FSMONITOR_COOKIE_DIR    "cookies"
+#define FSMONITOR_JOURNAL_FILE  "journal"
 #define FSMONITOR_COOKIE_PREFIX (FSMONITOR_DIR "/" FSMONITOR_COOKIE_DIR "/")
 
 enum fsmonitor_path_type fsmonitor_classify_path_workdir_relative(
@@ -1256,6 +1720,9 @@ static int fsmonitor_run_daemon_1(struct fsmonitor_daemon_state *state)
 	}
 	health_started = 1;
 
+	if (state->journal_catch_up)
+		journal_catch_up(state);
+
 	/*
 	 * The daemon is now fully functional in background threads.
 	 * Our primary thread should now just wait while the threads
@@ -1303,6 +1770,7 @@ static int fsmonitor_run_daemon(void)
 	hashmap_init(&state.cookies, cookies_cmp, NULL, 0);
 	pthread_mutex_init(&state.main_lock, NULL);
 	pthread_cond_init(&state.cookies_cond, NULL);
+	pthread_cond_init(&state.journal_cond, NULL);
 	state.listen_error_code = 0;
 	state.health_error_code = 0;
 	state.current_token_data = fsmonitor_new_token_data();
@@ -1368,6 +1836,10 @@ static int fsmonitor_run_daemon(void)
 	strbuf_addstr(&state.path_cookie_prefix, FSMONITOR_DIR);
 	mkdir(state.path_cookie_prefix.buf, 0777);
 
+	strbuf_init(&state.path_journal, 0);
+	strbuf_addf(&state.path_journal, "%s/%s",
+		    state.path_cookie_prefix.buf, FSMONITOR_JOURNAL_FILE);
+
 	strbuf_addch(&state.path_cookie_prefix, '/');
 	strbuf_addstr(&state.path_cookie_prefix, FSMONITOR_COOKIE_DIR);
 	mkdir(state.path_cookie_prefix.buf, 0777);
@@ -1398,6 +1870,12 @@ static int fsmonitor_run_daemon(void)
 		goto done;
 	}
 
+	/*
+	 * The listener has been set up, so we can tell whether the
+	 * previous daemon left us a token history to continue.
+	 */
+	journal_restore(&state);
+
 	/*
 	 * CD out of the worktree root directory.
 	 *
@@ -1419,6 +1897,7 @@ static int fsmonitor_run_daemon(void)
 
 done:
 	pthread_cond_destroy(&state.cookies_cond);
+	pthread_cond_destroy(&state.journal_cond);
 	pthread_mutex_destroy(&state.main_lock);
 	{
 		struct hashmap_iter iter;
@@ -1437,6 +1916,7 @@ static int fsmonitor_run_daemon(void)
 	strbuf_release(&state.path_worktree_watch);
 	strbuf_release(&state.path_gitdir_watch);
 	strbuf_release(&state.path_cookie_prefix);
+	strbuf_release(&state.path_journal);
 	strbuf_release(&state.path_ipc);
 	strbuf_release(&state.alias.alias);
 	strbuf_release(&state.alias.points_to);
@@ -468,8 +468,14 @@ static int is_delta_type(enum object_type type)
 	return (type == OBJ_REF_DELTA || type == OBJ_OFS_DELTA);
 }
 
+/*
+ * Inflate the entry data at the current position. Non-delta objects are
+ * hashed into "oid" on the way, unless "hash_later" is set and the whole
+ * object is returned, in which case the caller has to hash it.
+ */
 static void *unpack_entry_data(off_t offset, size_t size,
-			       enum object_type type, struct object_id *oid)
+			       enum object_type type, struct object_id *oid,
+			       int hash_later)
 {
 	static char fixed_buf[8192];
 	int status;
@@ -479,17 +485,18 @@ static void *unpack_entry_data(off_t offset, size_t size,
 	char hdr[32];
 	int hdrlen;
 
-	if (!is_delta_type(type)) {
-		hdrlen = format_object_header(hdr, sizeof(hdr), type, size);
-		the_hash_algo->init_fn(&c);
-		git_hash_update(&c, hdr, hdrlen);
-	} else
-		oid = NULL;
 	if (type == OBJ_BLOB &&
 	    size > repo_settings_get_big_file_threshold(the_repository))
 		buf = fixed_buf;
 	else
 		buf = xmallocz(size);
+	if (is_delta_type(type) || (hash_later && buf != fixed_buf))
+		oid = NULL;
+	if (oid) {
+		hdrlen = format_object_header(hdr, sizeof(hdr), type, size);
+		the_hash_algo->init_fn(&c);
+		git_hash_update(&c, hdr, hdrlen);
+	}
 
 	memset(&stream, 0, sizeof(stream));
 	git_inflate_init(&stream);
@@ -520,7 +527,8 @@ static void *unpack_entry_data(off_t offset, size_t size,
 static void *unpack_raw_entry(struct object_entry *obj,
 			      off_t *ofs_offset,
 			      struct object_id *ref_oid,
-			      struct object_id *oid)
+			      struct object_id *oid,
+			      int hash_later)
 {
 	unsigned char *p;
 	size_t size, c;
@@ -582,7 +590,8 @@ static void *unpack_raw_entry(struct object_entry *obj,
 	}
 	obj->hdr_size = consumed_bytes - obj->idx.offset;
 
-	data = unpack_entry_data(obj->idx.offset, obj->size, obj->type, oid);
+	data = unpack_entry_data(obj->idx.offset, obj->size, obj->type, oid,
+				 hash_later);
 	obj->idx.crc32 = input_crc32;
 	return data;
 }
@@ -1241,6 +1250,114 @@ static void *threaded_second_pass(void *data)
 	return NULL;
 }
 
+/*
+ * In the first pass, the entries have to be inflated in order while the
+ * pack is read to find where each of them ends. Hashing and checking the
+ * non-delta objects can be left to worker threads, though; the reader
+ * hands them over through a bounded queue.
+ */
+#define FIRST_PASS_JOBS 256
+#define FIRST_PASS_BYTES (64 * 1024 * 1024)
+
+struct first_pass_job {
+	struct object_entry *obj;
+	void *data;
+};
+
+static struct first_pass_job first_pass_jobs[FIRST_PASS_JOBS];
+static unsigned int first_pass_first, first_pass_nr;
+static size_t first_pass_bytes;
+static int first_pass_done;
+static pthread_t *first_pass_threads;
+
+static pthread_mutex_t first_pass_mutex;
+static pthread_cond_t first_pass_more_work;
+static pthread_cond_t first_pass_more_room;
+
+static void *threaded_first_pass(void *data UNUSED)
+{
+	for (;;) {
+		struct first_pass_job job;
+
+		pthread_mutex_lock(&first_pass_mutex);
+		while (!first_pass_nr && !first_pass_done)
+			pthread_cond_wait(&first_pass_more_work,
+					  &first_pass_mutex);
+		if (!first_pass_nr) {
+			pthread_mutex_unlock(&first_pass_mutex);
+			break;
+		}
+		job = first_pass_jobs[first_pass_first];
+		first_pass_first = (first_pass_first + 1) % FIRST_PASS_JOBS;
+		first_pass_nr--;
+		first_pass_bytes -= job.obj->size;
+		pthread_cond_signal(&first_pass_more_room);
+		pthread_mutex_unlock(&first_pass_mutex);
+
+		hash_object_file(the_hash_algo, job.data, job.obj->size,
+				 job.obj->type, &job.obj->idx.oid);
+		sha1_object(job.data, NULL, job.obj->size, job.obj->type,
+			    &job.obj->idx.oid);
+		free(job.data);
+	}
+	return NULL;
+}
+
+static void queue_first_pass(struct object_entry *obj, void *data)
+{
+	pthread_mutex_lock(&first_pass_mutex);
+	/* let a single object through even if it is larger than the limit */
+	while (first_pass_nr == FIRST_PASS_JOBS ||
+	       (first_pass_nr &&
+		first_pass_bytes + obj->size > FIRST_PASS_BYTES))
+		pthread_cond_wait(&first_pass_more_room, &first_pass_mutex);
+	first_pass_jobs[(first_pass_first + first_pass_nr) % FIRST_PASS_JOBS] =
+		(struct first_pass_job) { .obj = obj, .data = data };
+	first_pass_nr++;
+	first_pass_bytes += obj->size;
+	pthread_cond_signal(&first_pass_more_work);
+	pthread_mutex_unlock(&first_pass_mutex);
+}
+
+static void start_first_pass_threads(void)
+{
+	int i;
+
+	init_recursive_mutex(&read_mutex);
+	pthread_mutex_init(&first_pass_mutex, NULL);
+	pthread_cond_init(&first_pass_more_work, NULL);
+	pthread_cond_init(&first_pass_more_room, NULL);
+	CALLOC_ARRAY(first_pass_threads, nr_threads);
+	threads_active = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		int ret = pthread_create(&first_pass_threads[i], NULL,
+					 threaded_first_pass, NULL);
+		if (ret)
+			die(_("unable to create thread: %s"), strerror(ret));
+	}
+}
+
+static void finish_first_pass_threads(void)
+{
+	int i;
+
+	pthread_mutex_lock(&first_pass_mutex);
+	first_pass_done = 1;
+	pthread_cond_broadcast(&first_pass_more_work);
+	pthread_mutex_unlock(&first_pass_mutex);
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(first_pass_threads[i], NULL);
+
+	threads_active = 0;
+	pthread_mutex_destroy(&read_mutex);
+	pthread_mutex_destroy(&first_pass_mutex);
+	pthread_cond_destroy(&first_pass_more_work);
+	pthread_cond_destroy(&first_pass_more_room);
+	FREE_AND_NULL(first_pass_threads);
+}
+
 /*
  * First pass:
  * - find locations of all objects;
@@ -1254,6 +1371,8 @@ static void parse_pack_objects(unsigned char *hash)
 	struct object_id ref_delta_oid;
 	struct stat st;
 	struct git_hash_ctx tmp_ctx;
+	int threaded = HAVE_THREADS &&
+		(nr_threads > 1 || getenv("GIT_FORCE_THREADS"));
 
 	if (verbose)
 		progress = start_progress(
@@ -1261,11 +1380,13 @@ static void parse_pack_objects(unsigned char *hash)
 				progress_title ? progress_title :
 				from_stdin ? _("Receiving objects") : _("Indexing objects"),
 				nr_objects);
+	if (threaded)
+		start_first_pass_threads();
 	for (i = 0; i < nr_objects; i++) {
 		struct object_entry *obj = &objects[i];
 		void *data = unpack_raw_entry(obj, &ofs_delta->offset,
 					      &ref_delta_oid,
-					      &obj->idx.oid);
+					      &obj->idx.oid, threaded);
 		obj->real_type = obj->type;
 		if (obj->type == OBJ_OFS_DELTA) {
 			nr_ofs_deltas++;
@@ -1280,6 +1401,9 @@ static void parse_pack_objects(unsigned char *hash)
 			/* large blobs, check later */
 			obj->real_type = OBJ_BAD;
 			nr_delays++;
+		} else if (threaded) {
+			queue_first_pass(obj, data);
+			data = NULL;
 		} else
 			sha1_object(data, NULL, obj->size, obj->type,
 				    &obj->idx.oid);
@@ -1287,6 +1411,8 @@ static void parse_pack_objects(unsigned char *hash)
 		display_progress(progress, i+1);
 	}
 	objects[i].idx.offset = consumed_bytes;
+	if (threaded)
+		finish_first_pass_threads();
 	stop_progress(&progress);
 
 	/* Check pack integrity */
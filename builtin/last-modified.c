@@ -11,6 +11,8 @@
 #include "ewah/ewok.h"
 #include "hashmap.h"
 #include "hex.h"
+#include "notes-cache.h"
+#include "object-file.h"
 #include "object-name.h"
 #include "object.h"
 #include "parse-options.h"
@@ -18,6 +20,18 @@
 #include "quote.h"
 #include "repository.h"
 #include "revision.h"
+#include "strmap.h"
+#include "trace2.h"
+
+/*
+ * With lastModified.cache, the answer for each commit we run on is kept
+ * in a notes cache, keyed by a hash of the commit and of the options
+ * that decide which paths are shown. A later run that reaches that
+ * commit takes the answers for its remaining paths from there, rather
+ * than walking the rest of the history.
+ */
+#define LAST_MODIFIED_CACHE_NAME "last-modified"
+#define LAST_MODIFIED_CACHE_VALIDITY "last-modified v1"
 
 /* Remember to update object flag allocation in object.h */
 #define PARENT1 (1u<<16) /* used instead of SEEN */
@@ -63,6 +77,12 @@ struct last_modified {
 
 	/* 'scratch' to avoid allocating a bitmap every process_parent() */
 	struct bitmap *scratch;
+
+	/* only set when the answers for this run can be cached */
+	struct notes_cache *cache;
+	struct strbuf cache_shape;
+	struct strbuf cache_result;
+	struct object_id tip;
 };
 
 static struct bitmap *active_paths_for(struct last_modified *lm, struct commit *c)
@@ -95,6 +115,14 @@ static void last_modified_release(struct last_modified *lm)
 	release_revisions(&lm->rev);
 
 	free(lm->all_paths);
+
+	if (lm->cache) {
+		free_notes(&lm->cache->tree);
+		free(lm->cache->validity);
+		FREE_AND_NULL(lm->cache);
+	}
+	strbuf_release(&lm->cache_shape);
+	strbuf_release(&lm->cache_result);
 }
 
 struct last_modified_callback_data {
@@ -142,6 +170,7 @@ static int populate_paths_from_revs(struct last_modified *lm)
 
 	for (size_t i = 0; i < lm->rev.pending.nr; i++) {
 		struct object_array_entry *obj = lm->rev.pending.objects + i;
+		struct object *commit;
 
 		if (obj->item->flags & UNINTERESTING)
 			continue;
@@ -151,10 +180,12 @@ static int populate_paths_from_revs(struct last_modified *lm)
 			goto out;
 		}
 
-		if (!repo_peel_to_type(lm->rev.repo, obj->path, 0, obj->item, OBJ_COMMIT)) {
+		commit = repo_peel_to_type(lm->rev.repo, obj->path, 0, obj->item, OBJ_COMMIT);
+		if (!commit) {
 			ret = error(_("revision argument '%s' is a %s, not a commit-ish"), obj->name, type_name(obj->item->type));
 			goto out;
 		}
+		oidcpy(&lm->tip, &commit->oid);
 
 		diff_tree_oid(lm->rev.repo->hash_algo->empty_tree,
 			      &obj->item->oid, "", &diffopt);
@@ -175,6 +206,10 @@ static void last_modified_emit(struct last_modified *lm,
 		putchar('^');
 	printf("%s\t", oid_to_hex(&commit->object.oid));
 
+	if (lm->cache)
+		strbuf_addf(&lm->cache_result, "%s %s%c",
+			    oid_to_hex(&commit->object.oid), path, '\0');
+
 	if (lm->nul_termination)
 		printf("%s%c", path, '\0');
 	else
@@ -206,6 +241,99 @@ static void mark_path(const char *path, const struct object_id *oid,
 	free(ent);
 }
 
+static void last_modified_cache_key(struct last_modified *lm,
+				    const struct object_id *commit,
+				    struct object_id *key)
+{
+	struct strbuf buf = STRBUF_INIT;
+
+	strbuf_addf(&buf, "commit %s\n", oid_to_hex(commit));
+	strbuf_addbuf(&buf, &lm->cache_shape);
+	hash_object_file(lm->rev.repo->hash_algo, buf.buf, buf.len,
+			 OBJ_BLOB, key);
+	strbuf_release(&buf);
+}
+
+/*
+ * If the answers for 'c' are in the cache, use them for all paths that
+ * are still active in 'c' and return 1. A path only reaches 'c' when it
+ * is TREESAME all the way from the commit we started from, so the commit
+ * that last modified it as seen from 'c' is our answer as well.
+ *
+ * Returns 0 without marking any path if 'c' is not cached, or if the
+ * cached entry does not cover all active paths.
+ */
+static int resolve_from_cache(struct last_modified *lm, struct commit *c,
+			      struct bitmap *active,
+			      struct last_modified_callback_data *data)
+{
+	const struct git_hash_algo *algo = lm->rev.repo->hash_algo;
+	struct object_id key, oid;
+	struct strmap cached;
+	struct commit **found = NULL;
+	const char *p, *end, *path;
+	char *buf;
+	size_t size;
+	int ret = 0;
+
+	last_modified_cache_key(lm, &c->object.oid, &key);
+	buf = notes_cache_get(lm->cache, &key, &size);
+	if (!buf)
+		return 0;
+
+	/* Each entry is "<oid> SP <path> NUL", pointing into 'buf'. */
+	strmap_init_with_options(&cached, NULL, 0);
+	for (p = buf, end = buf + size; p < end; p = path + strlen(path) + 1) {
+		if (!memchr(p, '\0', end - p) ||
+		    parse_oid_hex_algop(p, &oid, &path, algo) ||
+		    *path++ != ' ')
+			goto out;
+		strmap_put(&cached, path, (void *)p);
+	}
+
+	CALLOC_ARRAY(found, lm->all_paths_nr);
+	for (size_t i = 0; i < lm->all_paths_nr; i++) {
+		if (!bitmap_get(active, i))
+			continue;
+		p = strmap_get(&cached, lm->all_paths[i]);
+		if (!p || parse_oid_hex_algop(p, &oid, &end, algo))
+			goto out;
+		found[i] = lookup_commit(lm->rev.repo, &oid);
+		if (!found[i])
+			goto out;
+	}
+
+	for (size_t i = 0; i < lm->all_paths_nr; i++) {
+		if (!found[i])
+			continue;
+		data->commit = found[i];
+		mark_path(lm->all_paths[i], NULL, data);
+		bitmap_unset(active, i);
+	}
+	trace2_data_string("last-modified", lm->rev.repo, "cache hit",
+			   oid_to_hex(&c->object.oid));
+	ret = 1;
+
+out:
+	free(found);
+	strmap_clear(&cached, 0);
+	free(buf);
+	return ret;
+}
+
+static void last_modified_cache_store(struct last_modified *lm)
+{
+	struct object_id key;
+
+	last_modified_cache_key(lm, &lm->tip, &key);
+	if (get_note(&lm->cache->tree, &key))
+		return;
+	/* ignore errors, as we might be in a readonly repository */
+	if (!notes_cache_put(lm->cache, &key,
+			     lm->cache_result.buf, lm->cache_result.len))
+		notes_cache_write(lm->cache);
+}
+
 static void last_modified_diff(struct diff_queue_struct *q,
 			       struct diff_options *opt UNUSED, void *cbdata)
 {
@@ -410,6 +538,9 @@ static int last_modified_run(struct last_modified *lm)
 			goto cleanup;
 		}
 
+		if (lm->cache && resolve_from_cache(lm, c, active_c, &data))
+			goto cleanup;
+
 		/*
 		 * Otherwise, make sure that 'c' isn't reachable from anything
 		 * in the '--not' queue.
@@ -465,6 +596,9 @@ static int last_modified_run(struct last_modified *lm)
 	if (hashmap_get_size(&lm->paths))
 		BUG("paths remaining beyond boundary in last-modified");
 
+	if (lm->cache)
+		last_modified_cache_store(lm);
+
 	clear_prio_queue(&not_queue);
 	clear_prio_queue(&queue);
 	clear_active_paths_for_commit(&lm->active_paths);
@@ -473,11 +607,60 @@ static int last_modified_run(struct last_modified *lm)
 	return 0;
 }
 
+/*
+ * Return 1 if 'argv' holds options for setup_revisions(), as opposed to
+ * only revisions and pathspecs.
+ */
+static int has_rev_options(int argc, const char **argv)
+{
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--") ||
+		    !strcmp(argv[i], "--end-of-options"))
+			break;
+		if (argv[i][0] == '-')
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Answers can only be reused for the same set of paths, and only when
+ * they were computed over the whole history of a single commit. Any
+ * revision or diff option (e.g. --diff-filter, -S or -M) may change
+ * which commit is the answer, so these runs are not cached either.
+ */
+static void last_modified_cache_init(struct last_modified *lm,
+				     int rev_options)
+{
+	struct pathspec *ps = &lm->rev.diffopt.pathspec;
+	int enabled = 0;
+
+	if (repo_config_get_bool(lm->rev.repo, "lastmodified.cache", &enabled) ||
+	    !enabled)
+		return;
+	if (rev_options || lm->rev.max_count >= 0)
+		return;
+	for (size_t i = 0; i < lm->rev.pending.nr; i++)
+		if (lm->rev.pending.objects[i].item->flags & UNINTERESTING)
+			return;
+
+	strbuf_addf(&lm->cache_shape, "max-depth %d\nshow-trees %d\nrenames %d\n",
+		    lm->max_depth, lm->show_trees, lm->rev.diffopt.detect_rename);
+	for (int i = 0; i < ps->nr; i++)
+		strbuf_addf(&lm->cache_shape, "pathspec %x %s\n",
+			    ps->items[i].magic, ps->items[i].match);
+
+	CALLOC_ARRAY(lm->cache, 1);
+	notes_cache_init(lm->rev.repo, lm->cache, LAST_MODIFIED_CACHE_NAME,
+			 LAST_MODIFIED_CACHE_VALIDITY);
+}
+
 static int last_modified_init(struct last_modified *lm, struct repository *r,
 			      const char *prefix, int argc, const char **argv)
 {
 	struct hashmap_iter iter;
 	struct last_modified_entry *ent;
+	int rev_options = has_rev_options(argc, argv);
 
 	hashmap_init(&lm->paths, last_modified_entry_hashcmp, NULL, 0);
 
@@ -505,6 +688,8 @@ static int last_modified_init(struct last_modified *lm, struct repository *r,
 	if (populate_paths_from_revs(lm) < 0)
 		return -1;
 
+	last_modified_cache_init(lm, rev_options);
+
 	CALLOC_ARRAY(lm->all_paths, hashmap_get_size(&lm->paths));
 	lm->all_paths_nr = 0;
 	hashmap_for_each_entry(&lm->paths, &iter, ent, hashent) {
@@ -519,7 +704,10 @@ int cmd_last_modified(int argc, const char **argv, const char *prefix,
 		      struct repository *repo)
 {
 	int ret;
-	struct last_modified lm = { 0 };
+	struct last_modified lm = {
+		.cache_shape = STRBUF_INIT,
+		.cache_result = STRBUF_INIT,
+	};
 
 	const char * const last_modified_usage[] = {
 		N_("git last-modified [--recursive] [--show-trees] [--max-depth=<depth>] [-z]\n"
@@ -386,28 +386,23 @@ static void *get_delta(struct object_entry *entry)
 
 static unsigned long do_compress(void **pptr, unsigned long size)
 {
-	git_zstream stream;
 	void *in, *out;
-	unsigned long maxsize;
+	size_t maxsize, len;
 	struct repo_config_values *cfg = repo_config_values(the_repository);
 
-	git_deflate_init(&stream, cfg->pack_compression_level);
-	maxsize = git_deflate_bound(&stream, size);
+	maxsize = git_deflate_buffer_bound(size);
 
 	in = *pptr;
 	out = xmalloc(maxsize);
 	*pptr = out;
 
-	stream.next_in = in;
-	stream.avail_in = size;
-	stream.next_out = out;
-	stream.avail_out = maxsize;
-	while (git_deflate(&stream, Z_FINISH) == Z_OK)
-		; /* nothing */
-	git_deflate_end(&stream);
+	len = git_deflate_buffer(out, maxsize, in, size,
+				 cfg->pack_compression_level);
+	if (!len)
+		BUG("compressed object larger than its bound");
 
 	free(in);
-	return stream.total_out;
+	return len;
 }
 
 static unsigned long write_large_blob_data(struct odb_read_stream *st, struct hashfile *f,
@@ -1328,6 +1323,52 @@ static const char no_split_warning[] = N_(
 "disabling bitmap writing, packs are split due to pack.packSizeLimit"
 );
 
+static struct hashfile *open_stdout_pack(void)
+{
+	/*
+	 * This command is most often invoked via git-upload-pack(1),
+	 * which will typically chunk data into pktlines. As such, we use
+	 * the maximum data length of them as buffer length.
+	 *
+	 * Note that we need to subtract one though to accommodate for
+	 * the sideband byte.
+	 */
+	struct hashfd_options opts = {
+		.progress = progress_state,
+		.buffer_len = LARGE_PACKET_DATA_MAX - 1,
+	};
+	return hashfd_ext(the_repository->hash_algo, 1, "<stdout>", &opts);
+}
+
+/*
+ * The pack header and the objects reused verbatim from existing packs
+ * do not depend on the delta search, so send them out before it starts
+ * instead of holding them back until the rest of the pack is ready.
+ * For large fetches that is usually most of the pack.
+ */
+static struct hashfile *reused_pack_out;
+
+static void write_reused_packs(void)
+{
+	uint32_t j;
+
+	assert(pack_to_stdout);
+	reused_pack_out = open_stdout_pack();
+	write_pack_header(reused_pack_out, nr_result);
+	for (j = 0; j < reuse_packfiles_nr; j++) {
+		reused_chunks_nr = 0;
+		write_reused_pack(&reuse_packfiles[j], reused_pack_out);
+		if (reused_chunks_nr)
+			reuse_packfiles_used_nr++;
+	}
+
+	/* Nothing looks at what we reused from here on. */
+	bitmap_free(reuse_packfile_bitmap);
+	reuse_packfile_bitmap = NULL;
+	FREE_AND_NULL(reused_chunks);
+	reused_chunks_alloc = 0;
+}
+
 static void write_pack_file(void)
 {
 	uint32_t i = 0, j;
@@ -1347,37 +1388,17 @@ static void write_pack_file(void)
 		unsigned char hash[GIT_MAX_RAWSZ];
 		char *pack_tmp_name = NULL;
 
-		if (pack_to_stdout) {
-			/*
-			 * This command is most often invoked via
-			 * git-upload-pack(1), which will typically chunk data
-			 * into pktlines. As such, we use the maximum data
-			 * length of them as buffer length.
-			 *
-			 * Note that we need to subtract one though to
-			 * accommodate for the sideband byte.
-			 */
-			struct hashfd_options opts = {
-				.progress = progress_state,
-				.buffer_len = LARGE_PACKET_DATA_MAX - 1,
-			};
-			f = hashfd_ext(the_repository->hash_algo, 1,
-				       "<stdout>", &opts);
-		} else {
-			f = create_tmp_packfile(the_repository, &pack_tmp_name);
-		}
-
-		offset = write_pack_header(f, nr_remaining);
-
-		if (reuse_packfiles_nr) {
-			assert(pack_to_stdout);
-			for (j = 0; j < reuse_packfiles_nr; j++) {
-				reused_chunks_nr = 0;
-				write_reused_pack(&reuse_packfiles[j], f);
-				if (reused_chunks_nr)
-					reuse_packfiles_used_nr++;
-			}
+		if (reused_pack_out) {
+			f = reused_pack_out;
+			f->tp = progress_state;
 			offset = hashfile_total(f);
+		} else {
+			if (pack_to_stdout)
+				f = open_stdout_pack();
+			else
+				f = create_tmp_packfile(the_repository,
+							&pack_tmp_name);
+			offset = write_pack_header(f, nr_remaining);
 		}
 
 		nr_written = 0;
@@ -3125,6 +3146,11 @@ static void find_deltas(struct object_entry **list, unsigned *list_size,
  *
  * The main thread steals half of the work from the worker that has
  * most work left to hand it to the idle worker.
+ *
+ * "Work" is measured by an estimate of the cost of the delta search,
+ * which grows with the size of the objects, rather than by the number
+ * of objects: a path with many large versions would otherwise keep one
+ * thread busy long after the others ran out of work.
  */
 
 struct thread_params {
@@ -3140,10 +3166,53 @@ struct thread_params {
 	pthread_mutex_t mutex;
 	pthread_cond_t cond;
 	unsigned *processed;
+	unsigned nr_done;
+	uint64_t cost_done;
+	int segments;
 };
 
 static pthread_cond_t progress_cond;
 
+/*
+ * Prefix sums of the estimated delta search cost of the entries in the
+ * list given to ll_find_deltas(), which starts at delta_cost_list.
+ */
+static uint64_t *delta_cost;
+static struct object_entry **delta_cost_list;
+
+static uint64_t segment_cost(struct object_entry **list, unsigned nr)
+{
+	size_t first = list - delta_cost_list;
+	return delta_cost[first + nr] - delta_cost[first];
+}
+
+/* Return the number of leading entries of "list" that cost at least "cost". */
+static unsigned split_by_cost(struct object_entry **list, unsigned nr,
+			      uint64_t cost)
+{
+	unsigned lo = 0, hi = nr;
+
+	while (lo < hi) {
+		unsigned mi = lo + (hi - lo) / 2;
+		if (segment_cost(list, mi) < cost)
+			lo = mi + 1;
+		else
+			hi = mi;
+	}
+	return lo;
+}
+
+/* Move "pos" forward so that it does not split the objects of a path. */
+static unsigned path_boundary(struct object_entry **list, unsigned nr,
+			      unsigned pos)
+{
+	while (pos && pos < nr &&
+	       list[pos]->hash &&
+	       list[pos]->hash == list[pos-1]->hash)
+		pos++;
+	return pos;
+}
+
 /*
  * Mutex and conditional variable can't be statically-initialized on Windows.
  */
@@ -3165,6 +3234,8 @@ static void *threaded_find_deltas(void *arg)
 {
 	struct thread_params *me = arg;
 
+	trace2_thread_start("find_deltas");
+
 	progress_lock();
 	while (me->remaining) {
 		progress_unlock();
@@ -3173,6 +3244,10 @@ static void *threaded_find_deltas(void *arg)
 			    me->window, me->depth, me->processed);
 
 		progress_lock();
+		/* nobody steals from us anymore, so list_size is final */
+		me->nr_done += me->list_size;
+		me->cost_done += segment_cost(me->list, me->list_size);
+		me->segments++;
 		me->working = 0;
 		pthread_cond_signal(&progress_cond);
 		progress_unlock();
@@ -3194,6 +3269,14 @@ static void *threaded_find_deltas(void *arg)
 		progress_lock();
 	}
 	progress_unlock();
+
+	trace2_data_intmax("pack-objects", the_repository,
+			   "delta_objects", me->nr_done);
+	trace2_data_intmax("pack-objects", the_repository,
+			   "delta_cost", me->cost_done);
+	trace2_data_intmax("pack-objects", the_repository,
+			   "delta_segments", me->segments);
+	trace2_thread_exit();
 	/* leave ->working 1 so that this doesn't get more work assigned */
 	return NULL;
 }
@@ -3203,6 +3286,7 @@ static void ll_find_deltas(struct object_entry **list, unsigned list_size,
 {
 	struct thread_params *p;
 	int i, ret, active_threads = 0;
+	unsigned j;
 
 	init_threaded_search();
 
@@ -3216,13 +3300,29 @@ static void ll_find_deltas(struct object_entry **list, unsigned list_size,
 			   delta_search_threads);
 	CALLOC_ARRAY(p, delta_search_threads);
 
+	/*
+	 * Each object in the window is tried as a base for the current
+	 * one, and both creating the delta index and the delta itself are
+	 * linear in the object size.
+	 */
+	ALLOC_ARRAY(delta_cost, list_size + 1);
+	delta_cost_list = list;
+	delta_cost[0] = 0;
+	for (j = 0; j < list_size; j++)
+		delta_cost[j + 1] = delta_cost[j] + SIZE(list[j]) + 1;
+
 	/* Partition the work amongst work threads. */
 	for (i = 0; i < delta_search_threads; i++) {
-		unsigned sub_size = list_size / (delta_search_threads - i);
+		uint64_t share = segment_cost(list, list_size) /
+				 (delta_search_threads - i);
+		unsigned sub_size = split_by_cost(list, list_size, share);
 
-		/* don't use too small segments or no deltas will be found */
+		/*
+		 * don't use too small segments or no deltas will be found,
+		 * even when a few large objects make up a whole share
+		 */
 		if (sub_size < 2*window && i+1 < delta_search_threads)
-			sub_size = 0;
+			sub_size = list_size >= 4*window ? 2*window : 0;
 
 		p[i].window = window;
 		p[i].depth = depth;
@@ -3231,14 +3331,13 @@ static void ll_find_deltas(struct object_entry **list, unsigned list_size,
 		p[i].data_ready = 0;
 
 		/* try to split chunks on "path" boundaries */
-		while (sub_size && sub_size < list_size &&
-		       list[sub_size]->hash &&
-		       list[sub_size]->hash == list[sub_size-1]->hash)
-			sub_size++;
+		sub_size = path_boundary(list, list_size, sub_size);
 
 		p[i].list = list;
 		p[i].list_size = sub_size;
 		p[i].remaining = sub_size;
+		trace2_data_intmax("pack-objects", the_repository,
+				   "delta_share", segment_cost(list, sub_size));
 
 		list += sub_size;
 		list_size -= sub_size;
@@ -3260,14 +3359,15 @@ static void ll_find_deltas(struct object_entry **list, unsigned list_size,
 	/*
 	 * Now let's wait for work completion.  Each time a thread is done
 	 * with its work, we steal half of the remaining work from the
-	 * thread with the largest number of unprocessed objects and give
-	 * it to that newly idle thread.  This ensure good load balancing
-	 * until the remaining object list segments are simply too short
-	 * to be worth splitting anymore.
+	 * thread with the most costly unprocessed objects and give it to
+	 * that newly idle thread.  This ensure good load balancing until
+	 * the remaining object list segments are simply too short to be
+	 * worth splitting anymore.
 	 */
 	while (active_threads) {
 		struct thread_params *target = NULL;
 		struct thread_params *victim = NULL;
+		uint64_t victim_cost = 0;
 		unsigned sub_size = 0;
 
 		progress_lock();
@@ -3280,28 +3380,48 @@ static void ll_find_deltas(struct object_entry **list, unsigned list_size,
 			pthread_cond_wait(&progress_cond, &progress_mutex);
 		}
 
-		for (i = 0; i < delta_search_threads; i++)
-			if (p[i].remaining > 2*window &&
-			    (!victim || victim->remaining < p[i].remaining))
+		for (i = 0; i < delta_search_threads; i++) {
+			struct object_entry **todo;
+			uint64_t cost;
+
+			if (p[i].remaining <= 2*window)
+				continue;
+			todo = p[i].list + p[i].list_size - p[i].remaining;
+			cost = segment_cost(todo, p[i].remaining);
+			if (!victim || victim_cost < cost) {
 				victim = &p[i];
-		if (victim) {
-			sub_size = victim->remaining / 2;
-			list = victim->list + victim->list_size - sub_size;
-			while (sub_size && list[0]->hash &&
-			       list[0]->hash == list[-1]->hash) {
-				list++;
-				sub_size--;
+				victim_cost = cost;
 			}
-			if (!sub_size) {
+		}
+		if (victim) {
+			struct object_entry **todo = victim->list +
+				victim->list_size - victim->remaining;
+			unsigned keep = split_by_cost(todo, victim->remaining,
+						      victim_cost / 2);
+
+			/*
+			 * The stolen part starts without a window of
+			 * objects to try as bases, so neither part may
+			 * be shorter than a window, however large the
+			 * objects around the cost midpoint are.
+			 */
+			if (keep < window)
+				keep = window;
+			if (keep > victim->remaining - window)
+				keep = victim->remaining - window;
+
+			sub_size = victim->remaining -
+				path_boundary(todo, victim->remaining, keep);
+			if (sub_size < window) {
 				/*
 				 * It is possible for some "paths" to have
 				 * so many objects that no hash boundary
-				 * might be found.  Let's just steal the
-				 * exact half in that case.
+				 * might be found.  Let's just split at
+				 * the clamped midpoint in that case.
 				 */
-				sub_size = victim->remaining / 2;
-				list -= sub_size;
+				sub_size = victim->remaining - keep;
 			}
+			list = todo + victim->remaining - sub_size;
 			target->list = list;
 			victim->list_size -= sub_size;
 			victim->remaining -= sub_size;
@@ -3324,6 +3444,7 @@ static void ll_find_deltas(struct object_entry **list, unsigned list_size,
 		}
 	}
 	cleanup_threaded_search();
+	FREE_AND_NULL(delta_cost);
 	free(p);
 }
 
@@ -3620,6 +3741,14 @@ static void prepare_pack(int window, int depth)
 
 	get_object_details();
 
+	/*
+	 * The bitmaps were only needed to find the objects to send and
+	 * which of their bases the other side has; let the delta search
+	 * have their memory.
+	 */
+	free_bitmap_index(bitmap_git);
+	bitmap_git = NULL;
+
 	/*
 	 * If we're locally repacking then we need to be doubly careful
 	 * from now on in order to make sure no stealth corruption gets
@@ -5413,6 +5542,16 @@ int cmd_pack_objects(int argc,
 
 	if (non_empty && !nr_result)
 		goto cleanup;
+
+	write_excluded_by_configs();
+	if (reuse_packfiles_nr) {
+		trace2_region_enter("pack-objects", "write-reused-packs",
+				    the_repository);
+		write_reused_packs();
+		trace2_region_leave("pack-objects", "write-reused-packs",
+				    the_repository);
+	}
+
 	if (nr_result) {
 		trace2_region_enter("pack-objects", "prepare-pack",
 				    the_repository);
@@ -5422,7 +5561,6 @@ int cmd_pack_objects(int argc,
 	}
 
 	trace2_region_enter("pack-objects", "write-pack-file", the_repository);
-	write_excluded_by_configs();
 	write_pack_file();
 	trace2_region_leave("pack-objects", "write-pack-file", the_repository);
 
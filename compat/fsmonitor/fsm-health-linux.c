@@ -5,10 +5,10 @@
 #include "fsmonitor--daemon.h"
 
 /*
- * The Linux fsmonitor implementation uses inotify which has its own
- * mechanisms for detecting filesystem unmount and other events that
- * would require the daemon to shutdown.  Therefore, we don't need
- * a separate health thread like Windows does.
+ * The Linux fsmonitor implementation uses inotify or fanotify, which
+ * have their own mechanisms for detecting queue overflows and other
+ * events that would require the daemon to shutdown.  Therefore, we
+ * don't need a separate health thread like Windows does.
  *
  * These stub functions satisfy the interface requirements.
  */
@@ -1,4 +1,8 @@
+#define USE_THE_REPOSITORY_VARIABLE
+
 #include "git-compat-util.h"
+#include "abspath.h"
+#include "config.h"
 #include "dir.h"
 #include "fsmonitor-ll.h"
 #include "fsm-listen.h"
@@ -8,8 +12,11 @@
 #include "simple-ipc.h"
 #include "string-list.h"
 #include "trace.h"
+#include "trace2.h"
 
 #include <sys/inotify.h>
+#include <sys/fanotify.h>
+#include <sys/statfs.h>
 
 /*
  * Safe value to bitwise OR with rest of mask for
@@ -40,12 +47,41 @@ struct rename_entry {
 	const char *dir;
 };
 
+/*
+ * A filesystem we placed a fanotify mark on.  Events identify their
+ * directory by a file handle, which can only be opened relative to
+ * a descriptor on the same filesystem.
+ */
+struct fanotify_mark_fs {
+	__kernel_fsid_t fsid;
+	int mount_fd;
+};
+
+/*
+ * Cached mapping from a (fsid, file handle) pair to the path of the
+ * directory it names, or NULL if that directory is outside of the
+ * paths we watch.
+ */
+struct handle_entry {
+	struct hashmap_entry ent;
+	char *path;
+	size_t key_len;
+	unsigned char key[FLEX_ARRAY];
+};
+
 struct fsm_listen_data {
 	int fd_inotify;
+	int fd_fanotify;
 	enum shutdown_reason shutdown;
 	struct hashmap watches;
 	struct hashmap renames;
 	struct hashmap revwatches;
+
+	struct fanotify_mark_fs marks[2];
+	int nr_marks;
+	struct hashmap handles;
+	struct strbuf real_worktree;
+	struct strbuf real_gitdir;
 };
 
 static int watch_entry_cmp(const void *cmp_data UNUSED,
@@ -84,19 +120,47 @@ static int rename_entry_cmp(const void *cmp_data UNUSED,
 	return e1->cookie != e2->cookie;
 }
 
+struct handle_key {
+	const unsigned char *buf;
+	size_t len;
+};
+
+static int handle_entry_cmp(const void *cmp_data UNUSED,
+			    const struct hashmap_entry *eptr,
+			    const struct hashmap_entry *entry_or_key,
+			    const void *keydata)
+{
+	const struct handle_entry *e1, *e2;
+	const struct handle_key *k = keydata;
+
+	e1 = container_of(eptr, const struct handle_entry, ent);
+	if (k)
+		return e1->key_len != k->len || memcmp(e1->key, k->buf, k->len);
+	e2 = container_of(entry_or_key, const struct handle_entry, ent);
+	return e1->key_len != e2->key_len ||
+		memcmp(e1->key, e2->key, e1->key_len);
+}
+
 /*
  * Register an inotify watch, add watch descriptor to path mapping
  * and the reverse mapping.
  */
 static int add_watch(const char *path, struct fsm_listen_data *data)
 {
-	const char *interned = strintern(path);
+	const char *interned;
 	struct watch_entry *w1, *w2;
+	int wd;
+
+	/* a fanotify filesystem mark already covers every directory */
+	if (data->fd_fanotify >= 0)
+		return 0;
+
+	interned = strintern(path);
 
 	/* add the inotify watch, don't allow watches to be modified */
-	int wd = inotify_add_watch(data->fd_inotify, interned,
-				   (IN_ALL_EVENTS | IN_ONLYDIR | IN_MASK_CREATE)
-				    ^ IN_ACCESS ^ IN_CLOSE ^ IN_OPEN);
+	wd = inotify_add_watch(data->fd_inotify, interned,
+			       (IN_ALL_EVENTS | IN_ONLYDIR | IN_MASK_CREATE)
+				^ IN_ACCESS ^ IN_CLOSE ^ IN_OPEN);
 	if (wd < 0) {
 		if (errno == ENOENT || errno == ENOTDIR)
 			return 0; /* directory was deleted or is not a directory */
@@ -263,7 +327,8 @@ static void rename_dir(uint32_t cookie, const char *path,
 }
 
 /*
- * Recursively add watches to every directory under path
+ * Recursively add watches to every directory under path.  If batch is
+ * given, also add every file found to it.
  */
 static int register_inotify(const char *path,
 			    struct fsmonitor_daemon_state *state,
@@ -399,47 +464,200 @@ static void log_mask_set(const char *path, uint32_t mask)
 	strbuf_release(&msg);
 }
 
+static void clear_handle_cache(struct fsm_listen_data *data)
+{
+	struct hashmap_iter iter;
+	struct handle_entry *e;
+
+	hashmap_for_each_entry(&data->handles, &iter, e, ent)
+		free(e->path);
+	hashmap_partial_clear_and_free(&data->handles, struct handle_entry, ent);
+}
+
+static void stop_fanotify(struct fsm_listen_data *data)
+{
+	int i;
+
+	for (i = 0; i < data->nr_marks; i++)
+		close(data->marks[i].mount_fd);
+	data->nr_marks = 0;
+
+	clear_handle_cache(data);
+	hashmap_clear(&data->handles);
+	strbuf_release(&data->real_worktree);
+	strbuf_release(&data->real_gitdir);
+
+	if (data->fd_fanotify >= 0 && close(data->fd_fanotify) < 0)
+		error_errno(_("closing fanotify file descriptor failed"));
+	data->fd_fanotify = -1;
+}
+
+#ifdef FAN_REPORT_DFID_NAME
+
+/*
+ * The events we ask fanotify for.  Like the inotify watches, this
+ * leaves out accesses, opens and closes.
+ */
+#define FANOTIFY_EVENTS (FAN_MODIFY | FAN_ATTRIB | FAN_MOVED_FROM | \
+			 FAN_MOVED_TO | FAN_CREATE | FAN_DELETE | FAN_ONDIR)
+
+/*
+ * Forget all resolved directory handles once the cache holds this
+ * many, so that a filesystem mark on a busy filesystem does not
+ * grow it without bound.
+ */
+#define HANDLE_CACHE_MAX (64 * 1024)
+
+/*
+ * Mark the whole filesystem that path lives on.  Mount marks cannot
+ * report directory entry events, so a filesystem mark (which needs
+ * CAP_SYS_ADMIN) is the only kind that gives us what we need.
+ */
+static int add_fanotify_mark(const char *path, struct fsm_listen_data *data)
+{
+	struct fanotify_mark_fs *m;
+	struct statfs sfs;
+	int i;
+
+	if (fanotify_mark(data->fd_fanotify, FAN_MARK_ADD | FAN_MARK_FILESYSTEM,
+			  FANOTIFY_EVENTS, AT_FDCWD, path))
+		return error_errno(_("fanotify_mark('%s') failed"), path);
+	if (statfs(path, &sfs))
+		return error_errno(_("statfs('%s') failed"), path);
+
+	for (i = 0; i < data->nr_marks; i++)
+		if (!memcmp(&data->marks[i].fsid, &sfs.f_fsid, sizeof(sfs.f_fsid)))
+			return 0; /* already marked */
+	if (data->nr_marks == ARRAY_SIZE(data->marks))
+		BUG("too many fanotify marks");
+
+	m = &data->marks[data->nr_marks];
+	memcpy(&m->fsid, &sfs.f_fsid, sizeof(m->fsid));
+	m->mount_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (m->mount_fd < 0)
+		return error_errno(_("could not open '%s'"), path);
+	data->nr_marks++;
+
+	return 0;
+}
+
+static int start_fanotify(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_listen_data *data = state->listen_data;
+
+	data->fd_fanotify = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC |
+					  FAN_NONBLOCK | FAN_REPORT_DFID_NAME,
+					  O_RDONLY | O_CLOEXEC);
+	if (data->fd_fanotify < 0)
+		return error_errno(_("fanotify_init() failed"));
+
+	/*
+	 * Handles resolve to canonical paths, which we map back onto
+	 * the (possibly symlinked) paths we were asked to watch.
+	 */
+	if (add_fanotify_mark(state->path_worktree_watch.buf, data) ||
+	    !strbuf_realpath(&data->real_worktree,
+			     state->path_worktree_watch.buf, 0))
+		goto failed;
+	if (state->nr_paths_watching > 1 &&
+	    (add_fanotify_mark(state->path_gitdir_watch.buf, data) ||
+	     !strbuf_realpath(&data->real_gitdir,
+			      state->path_gitdir_watch.buf, 0)))
+		goto failed;
+
+	return 0;
+
+failed:
+	stop_fanotify(data);
+	return -1;
+}
+
+#else
+
+static int start_fanotify(struct fsmonitor_daemon_state *state UNUSED)
+{
+	return error(_("fanotify is not supported by this build"));
+}
+
+#endif
+
+static int use_fanotify(void)
+{
+	const char *backend;
+
+	if (repo_config_get_string_tmp(the_repository, "fsmonitor.linuxbackend",
+				       &backend) ||
+	    !strcmp(backend, "inotify"))
+		return 0;
+	if (!strcmp(backend, "fanotify"))
+		return 1;
+	return error(_("invalid value for '%s': '%s'"),
+		     "fsmonitor.linuxBackend", backend);
+}
+
+static int start_inotify(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_listen_data *data = state->listen_data;
+
+	data->fd_inotify = inotify_init1(O_NONBLOCK);
+	if (data->fd_inotify < 0)
+		return error_errno(_("inotify_init1() failed"));
+
+	if (add_watch(state->path_worktree_watch.buf, data) ||
+	    register_inotify(state->path_worktree_watch.buf, state, NULL))
+		return -1;
+	if (state->nr_paths_watching > 1 &&
+	    (add_watch(state->path_gitdir_watch.buf, data) ||
+	     register_inotify(state->path_gitdir_watch.buf, state, NULL)))
+		return -1;
+
+	return 0;
+}
+
 int fsm_listen__ctor(struct fsmonitor_daemon_state *state)
 {
-	int fd;
-	int ret = 0;
 	struct fsm_listen_data *data;
+	const char *backend = "inotify";
+	int want_fanotify;
+	int ret;
+
+	want_fanotify = use_fanotify();
+	if (want_fanotify < 0)
+		return -1;
 
 	CALLOC_ARRAY(data, 1);
 	state->listen_data = data;
 	state->listen_error_code = -1;
 	data->fd_inotify = -1;
+	data->fd_fanotify = -1;
 	data->shutdown = SHUTDOWN_ERROR;
-
-	fd = inotify_init1(O_NONBLOCK);
-	if (fd < 0) {
-		FREE_AND_NULL(state->listen_data);
-		return error_errno(_("inotify_init1() failed"));
-	}
-
-	data->fd_inotify = fd;
+	strbuf_init(&data->real_worktree, 0);
+	strbuf_init(&data->real_gitdir, 0);
 
 	hashmap_init(&data->watches, watch_entry_cmp, NULL, 0);
 	hashmap_init(&data->renames, rename_entry_cmp, NULL, 0);
 	hashmap_init(&data->revwatches, revwatches_entry_cmp, NULL, 0);
+	hashmap_init(&data->handles, handle_entry_cmp, NULL, 0);
 
-	if (add_watch(state->path_worktree_watch.buf, data))
-		ret = -1;
-	else if (register_inotify(state->path_worktree_watch.buf, state, NULL))
-		ret = -1;
-	else if (state->nr_paths_watching > 1) {
-		if (add_watch(state->path_gitdir_watch.buf, data))
-			ret = -1;
-		else if (register_inotify(state->path_gitdir_watch.buf, state, NULL))
-			ret = -1;
+	if (want_fanotify && !start_fanotify(state)) {
+		backend = "fanotify";
+		ret = 0;
+	} else {
+		if (want_fanotify)
+			warning(_("fanotify is not available, falling back to inotify"));
+		ret = start_inotify(state);
 	}
 
-	if (!ret) {
-		state->listen_error_code = 0;
-		data->shutdown = SHUTDOWN_CONTINUE;
+	if (ret) {
+		fsm_listen__dtor(state);
+		return ret;
 	}
 
-	return ret;
+	trace2_data_string("fsmonitor", NULL, "listen/backend", backend);
+	state->listen_error_code = 0;
+	data->shutdown = SHUTDOWN_CONTINUE;
+
+	return 0;
 }
 
 void fsm_listen__dtor(struct fsmonitor_daemon_state *state)
@@ -480,6 +698,8 @@ void fsm_listen__dtor(struct fsmonitor_daemon_state *state)
 
 	hashmap_clear_and_free(&data->renames, struct rename_entry, ent);
 
+	stop_fanotify(data);
+
 	FREE_AND_NULL(state->listen_data);
 
 	if (fd >= 0 && (close(fd) < 0))
@@ -494,10 +714,13 @@ void fsm_listen__stop_async(struct fsmonitor_daemon_state *state)
 }
 
 /*
- * Process a single inotify event and queue for publication.
+ * Process a single event and queue for publication.  The fanotify
+ * event bits we ask for have the same values as their inotify
+ * counterparts (and FAN_ONDIR matches IN_ISDIR), so both backends
+ * share this.
  */
 static int process_event(const char *path,
-			 const struct inotify_event *event,
+			 uint32_t mask, uint32_t cookie,
 			 struct fsmonitor_batch **batch,
 			 struct string_list *cookie_list,
 			 struct fsmonitor_daemon_state *state)
@@ -522,14 +745,14 @@ static int process_event(const char *path,
 		 * If .git directory is deleted or renamed away,
 		 * we have to quit.
 		 */
-		if (em_dir_deleted(event->mask)) {
+		if (em_dir_deleted(mask)) {
 			trace_printf_key(&trace_fsmonitor,
 					 "event: gitdir removed");
 			state->listen_data->shutdown = SHUTDOWN_FORCE;
 			goto done;
 		}
 
-		if (em_dir_renamed(event->mask)) {
+		if (em_dir_renamed(mask)) {
 			trace_printf_key(&trace_fsmonitor,
 					 "event: gitdir renamed");
 			state->listen_data->shutdown = SHUTDOWN_FORCE;
@@ -539,7 +762,7 @@ static int process_event(const char *path,
 	case IS_WORKDIR_PATH:
 		/* normal events in the working directory */
 		if (trace_pass_fl(&trace_fsmonitor))
-			log_mask_set(path, event->mask);
+			log_mask_set(path, mask);
 
 		if (!*batch)
 			*batch = fsmonitor_batch__new();
@@ -547,23 +770,38 @@ static int process_event(const char *path,
 		rel = path + state->path_worktree_watch.len + 1;
 		fsmonitor_batch__add_path(*batch, rel);
 
-		if (em_dir_deleted(event->mask))
+		if (em_dir_deleted(mask))
+			break;
+
+		/*
+		 * A fanotify filesystem mark needs no watch bookkeeping,
+		 * and sees the contents of a new directory being
+		 * populated on its own.  Only a directory moved in from
+		 * elsewhere has to be walked to report what it holds.
+		 */
+		if (state->listen_data->fd_fanotify >= 0) {
+			if (em_rename_dir_to(mask) &&
+			    register_inotify(path, state, *batch)) {
+				state->listen_data->shutdown = SHUTDOWN_ERROR;
+				goto done;
+			}
 			break;
+		}
 
 		/* received IN_MOVE_FROM, add tracking for expected IN_MOVE_TO */
-		if (em_rename_dir_from(event->mask))
-			add_dir_rename(event->cookie, path, state->listen_data);
+		if (em_rename_dir_from(mask))
+			add_dir_rename(cookie, path, state->listen_data);
 
 		/* received IN_MOVE_TO, update watch to reflect new path */
-		if (em_rename_dir_to(event->mask)) {
-			rename_dir(event->cookie, path, state->listen_data);
+		if (em_rename_dir_to(mask)) {
+			rename_dir(cookie, path, state->listen_data);
 			if (register_inotify(path, state, *batch)) {
 				state->listen_data->shutdown = SHUTDOWN_ERROR;
 				goto done;
 			}
 		}
 
-		if (em_dir_created(event->mask)) {
+		if (em_dir_created(mask)) {
 			if (add_watch(path, state->listen_data)) {
 				state->listen_data->shutdown = SHUTDOWN_ERROR;
 				goto done;
@@ -658,7 +896,8 @@ static void handle_events(struct fsmonitor_daemon_state *state)
 			if (!p)
 				p = strbuf_detach(&path, NULL);
 
-			if (process_event(p, event, &batch, &cookie_list, state)) {
+			if (process_event(p, event->mask, event->cookie,
+					  &batch, &cookie_list, state)) {
 				free(p);
 				goto done;
 			}
@@ -675,9 +914,252 @@ static void handle_events(struct fsmonitor_daemon_state *state)
 	string_list_clear(&cookie_list, 0);
 }
 
+#ifdef FAN_REPORT_DFID_NAME
+
 /*
- * Non-blocking read of the inotify events stream. The inotify fd is polled
- * frequently to help minimize the number of queue overflows.
+ * Map the canonical path of a directory back onto the paths we were
+ * asked to watch, or return NULL if it is outside of them.
+ */
+static char *watched_path(const char *real, struct fsmonitor_daemon_state *state)
+{
+	struct fsm_listen_data *data = state->listen_data;
+	const char *rest;
+
+	if (skip_prefix(real, data->real_worktree.buf, &rest) &&
+	    (!*rest || *rest == '/'))
+		return xstrfmt("%s%s", state->path_worktree_watch.buf, rest);
+	if (data->real_gitdir.len &&
+	    skip_prefix(real, data->real_gitdir.buf, &rest) &&
+	    (!*rest || *rest == '/'))
+		return xstrfmt("%s%s", state->path_gitdir_watch.buf, rest);
+	return NULL;
+}
+
+/*
+ * Resolve the directory handle of an event to its path.  Returns 0 and
+ * sets *out (NULL for directories outside of the watched paths), or -1
+ * if the directory no longer exists.
+ */
+static int resolve_dir_handle(struct fsmonitor_daemon_state *state,
+			      const __kernel_fsid_t *fsid,
+			      struct file_handle *fh,
+			      const char **out)
+{
+	struct fsm_listen_data *data = state->listen_data;
+	unsigned char keybuf[sizeof(*fsid) + sizeof(*fh) + MAX_HANDLE_SZ];
+	struct handle_key k;
+	struct handle_entry *e;
+	struct strbuf proc = STRBUF_INIT, real = STRBUF_INIT;
+	char *path = NULL;
+	unsigned int hash;
+	int i, fd = -1, ret = -1;
+
+	memcpy(keybuf, fsid, sizeof(*fsid));
+	memcpy(keybuf + sizeof(*fsid), fh, sizeof(*fh) + fh->handle_bytes);
+	k.buf = keybuf;
+	k.len = sizeof(*fsid) + sizeof(*fh) + fh->handle_bytes;
+	hash = memhash(k.buf, k.len);
+
+	e = hashmap_get_entry_from_hash(&data->handles, hash, &k,
+					struct handle_entry, ent);
+	if (e) {
+		*out = e->path;
+		return 0;
+	}
+
+	for (i = 0; i < data->nr_marks; i++)
+		if (!memcmp(&data->marks[i].fsid, fsid, sizeof(*fsid)))
+			break;
+	if (i < data->nr_marks) {
+		fd = open_by_handle_at(data->marks[i].mount_fd, fh,
+				       O_PATH | O_CLOEXEC);
+		if (fd < 0) {
+			if (errno != ESTALE && errno != ENOENT)
+				error_errno(_("open_by_handle_at() failed"));
+			goto done;
+		}
+		strbuf_addf(&proc, "/proc/self/fd/%d", fd);
+		if (strbuf_readlink(&real, proc.buf, 0)) {
+			error_errno(_("readlink('%s') failed"), proc.buf);
+			goto done;
+		}
+		if (ends_with(real.buf, " (deleted)"))
+			goto done;
+		path = watched_path(real.buf, state);
+	}
+
+	if (hashmap_get_size(&data->handles) >= HANDLE_CACHE_MAX)
+		clear_handle_cache(data);
+
+	FLEX_ALLOC_MEM(e, key, k.buf, k.len);
+	e->key_len = k.len;
+	e->path = path;
+	hashmap_entry_init(&e->ent, hash);
+	hashmap_add(&data->handles, &e->ent);
+
+	*out = e->path;
+	ret = 0;
+
+done:
+	if (fd >= 0)
+		close(fd);
+	strbuf_release(&proc);
+	strbuf_release(&real);
+	return ret;
+}
+
+/*
+ * Build the path an event refers to from its directory handle and
+ * name.  Returns -1 if the event is to be skipped.
+ */
+static int fanotify_event_path(struct fsmonitor_daemon_state *state,
+			       const struct fanotify_event_metadata *event,
+			       struct strbuf *path)
+{
+	const char *ptr = (const char *)event + event->metadata_len;
+	const char *end = (const char *)event + event->event_len;
+	union {
+		struct file_handle fh;
+		unsigned char buf[sizeof(struct file_handle) + MAX_HANDLE_SZ];
+	} handle;
+
+	while (ptr + sizeof(struct fanotify_event_info_header) <= end) {
+		const struct fanotify_event_info_header *hdr = (const void *)ptr;
+		const struct fanotify_event_info_fid *fid = (const void *)ptr;
+		const char *info_end = ptr + hdr->len;
+		const char *name, *dir;
+
+		if (hdr->len < sizeof(*hdr) || info_end > end)
+			break;
+		ptr = info_end;
+		if (hdr->info_type != FAN_EVENT_INFO_TYPE_DFID_NAME)
+			continue;
+		if (hdr->len < sizeof(*fid) + sizeof(handle.fh))
+			break;
+
+		memcpy(&handle.fh, fid->handle, sizeof(handle.fh));
+		if (handle.fh.handle_bytes > MAX_HANDLE_SZ ||
+		    handle.fh.handle_bytes >= info_end - (const char *)fid->handle -
+					      sizeof(handle.fh))
+			break;
+		memcpy(handle.buf, fid->handle,
+		       sizeof(handle.fh) + handle.fh.handle_bytes);
+		name = (const char *)fid->handle + sizeof(handle.fh) +
+			handle.fh.handle_bytes;
+		if (!memchr(name, '\0', info_end - name))
+			break;
+
+		if (resolve_dir_handle(state, &fid->fsid, &handle.fh, &dir) ||
+		    !dir)
+			return -1;
+
+		strbuf_reset(path);
+		strbuf_addstr(path, dir);
+		if (strcmp(name, "."))
+			strbuf_addf(path, "/%s", name);
+		return 0;
+	}
+
+	return -1;
+}
+
+/*
+ * Read the fanotify event stream.  Unlike inotify there are no watch
+ * descriptors to maintain; every event names its directory by handle
+ * and the entry within it by name.
+ */
+static void handle_fanotify_events(struct fsmonitor_daemon_state *state)
+{
+	char buf[4096]
+		__attribute__ ((aligned(__alignof__(struct fanotify_event_metadata))));
+
+	struct fsm_listen_data *data = state->listen_data;
+	struct fsmonitor_batch *batch = NULL;
+	struct string_list cookie_list = STRING_LIST_INIT_DUP;
+	struct strbuf path = STRBUF_INIT;
+	struct fanotify_event_metadata *event;
+	ssize_t len;
+	char *p;
+
+	for (;;) {
+		len = read(data->fd_fanotify, buf, sizeof(buf));
+		if (len == -1) {
+			if (errno == EAGAIN || errno == EINTR)
+				goto done;
+			error_errno(_("reading fanotify event stream failed"));
+			data->shutdown = SHUTDOWN_ERROR;
+			goto done;
+		}
+
+		/* nothing to read */
+		if (len == 0)
+			goto done;
+
+		for (event = (struct fanotify_event_metadata *)buf;
+		     FAN_EVENT_OK(event, len);
+		     event = FAN_EVENT_NEXT(event, len)) {
+			if (event->vers != FANOTIFY_METADATA_VERSION) {
+				error(_("unexpected fanotify metadata version %d"),
+				      event->vers);
+				data->shutdown = SHUTDOWN_ERROR;
+				goto done;
+			}
+
+			if (event->fd >= 0)
+				close(event->fd);
+
+			/* event queue overflowed */
+			if (em_force_shutdown(event->mask)) {
+				if (trace_pass_fl(&trace_fsmonitor))
+					log_mask_set("forcing shutdown", event->mask);
+				data->shutdown = SHUTDOWN_FORCE;
+				goto done;
+			}
+
+			if (!fanotify_event_path(state, event, &path)) {
+				p = fsmonitor__resolve_alias(path.buf, &state->alias);
+				if (!p)
+					p = strbuf_detach(&path, NULL);
+
+				if (process_event(p, event->mask, 0,
+						  &batch, &cookie_list, state)) {
+					free(p);
+					goto done;
+				}
+				free(p);
+			}
+
+			/*
+			 * Cached paths below a directory that went away
+			 * or moved are stale now.
+			 */
+			if (em_dir_renamed(event->mask) ||
+			    em_dir_deleted(event->mask))
+				clear_handle_cache(data);
+		}
+		strbuf_reset(&path);
+		fsmonitor_publish(state, batch, &cookie_list);
+		string_list_clear(&cookie_list, 0);
+		batch = NULL;
+	}
+done:
+	strbuf_release(&path);
+	fsmonitor_batch__free_list(batch);
+	string_list_clear(&cookie_list, 0);
+}
+
+#else
+
+static void handle_fanotify_events(struct fsmonitor_daemon_state *state UNUSED)
+{
+	BUG("fanotify is not supported by this build");
+}
+
+#endif
+
+/*
+ * Non-blocking read of the inotify or fanotify events stream. The fd is
+ * polled frequently to help minimize the number of queue overflows.
  */
 void fsm_listen__loop(struct fsmonitor_daemon_state *state)
 {
@@ -692,7 +1174,10 @@ void fsm_listen__loop(struct fsmonitor_daemon_state *state)
 	time_t checked = time(NULL);
 	struct pollfd fds[1];
 
-	fds[0].fd = state->listen_data->fd_inotify;
+	if (state->listen_data->fd_fanotify >= 0)
+		fds[0].fd = state->listen_data->fd_fanotify;
+	else
+		fds[0].fd = state->listen_data->fd_inotify;
 	fds[0].events = POLLIN;
 
 	/*
@@ -708,7 +1193,7 @@ void fsm_listen__loop(struct fsmonitor_daemon_state *state)
 			if (poll_num == -1) {
 				if (errno == EINTR)
 					continue;
-				error_errno(_("polling inotify message stream failed"));
+				error_errno(_("polling fs event stream failed"));
 				state->listen_data->shutdown = SHUTDOWN_ERROR;
 				continue;
 			}
@@ -724,8 +1209,12 @@ void fsm_listen__loop(struct fsmonitor_daemon_state *state)
 				}
 			}
 
-			if (poll_num > 0 && (fds[0].revents & POLLIN))
-				handle_events(state);
+			if (poll_num > 0 && (fds[0].revents & POLLIN)) {
+				if (state->listen_data->fd_fanotify >= 0)
+					handle_fanotify_events(state);
+				else
+					handle_events(state);
+			}
 
 			continue;
 		case SHUTDOWN_ERROR:
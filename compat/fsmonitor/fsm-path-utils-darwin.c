@@ -118,6 +118,22 @@ int fsmonitor__get_alias(const char *path, struct alias_info *info)
 	return retval;
 }
 
+/*
+ * APFS and HFS+ report the generation number in st_gen.
+ */
+int fsmonitor__get_inode_generation(const char *path, uint64_t *generation)
+{
+	struct stat st;
+
+	*generation = 0;
+	if (lstat(path, &st))
+		return error_errno(_("lstat('%s') failed"), path);
+
+	/* only visible to the superuser; reads as zero otherwise */
+	*generation = st.st_gen;
+	return 0;
+}
+
 char *fsmonitor__resolve_alias(const char *path,
 	const struct alias_info *info)
 {
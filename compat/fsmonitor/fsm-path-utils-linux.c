@@ -4,7 +4,9 @@
 #include "gettext.h"
 #include "trace.h"
 
+#include <sys/ioctl.h>
 #include <sys/statfs.h>
+#include <linux/fs.h>
 
 #ifdef HAVE_LINUX_MAGIC_H
 #include <linux/magic.h>
@@ -207,6 +209,30 @@ int fsmonitor__get_alias(const char *path UNUSED,
 	return 0;
 }
 
+/*
+ * Use the generation number that ext4, btrfs and others hand out via
+ * FS_IOC_GETVERSION.
+ */
+int fsmonitor__get_inode_generation(const char *path, uint64_t *generation)
+{
+	int fd, version = 0;
+
+	*generation = 0;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return error_errno(_("could not open '%s'"), path);
+
+#ifdef FS_IOC_GETVERSION
+	/* not every filesystem has generation numbers */
+	if (!ioctl(fd, FS_IOC_GETVERSION, &version))
+		*generation = (unsigned int)version;
+#endif
+
+	close(fd);
+	return 0;
+}
+
 /*
  * No-op for Linux - we don't have firmlinks like macOS.
  */
@@ -129,6 +129,16 @@ int fsmonitor__is_fs_remote(const char *path)
 	return fs.is_remote;
 }
 
+/*
+ * NTFS has no inode generation numbers.
+ */
+int fsmonitor__get_inode_generation(const char *path UNUSED,
+				    uint64_t *generation)
+{
+	*generation = 0;
+	return 0;
+}
+
 /*
  * No-op for now.
  */
@@ -146,6 +146,14 @@ void hashwrite(struct hashfile *f, const void *buf, uint32_t count)
 	}
 }
 
+void hashwrite_unhashed(struct hashfile *f, const void *buf, uint32_t count)
+{
+	hashflush(f);
+	if (f->do_crc)
+		f->crc32 = crc32(f->crc32, buf, count);
+	flush(f, buf, count);
+}
+
 struct hashfile *hashfd_check(const struct git_hash_algo *algop,
 			      const char *name)
 {
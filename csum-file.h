@@ -76,6 +76,12 @@ void free_hashfile(struct hashfile *f);
 int finalize_hashfile(struct hashfile *, unsigned char *, enum fsync_component, unsigned int);
 void discard_hashfile(struct hashfile *);
 void hashwrite(struct hashfile *, const void *, uint32_t);
+
+/*
+ * Write data that is not fed to the checksum of the file, e.g. because
+ * it is covered by a checksum of its own that is written separately.
+ */
+void hashwrite_unhashed(struct hashfile *, const void *, uint32_t);
 void hashflush(struct hashfile *f);
 void crc32_begin(struct hashfile *);
 uint32_t crc32_end(struct hashfile *);
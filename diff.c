@@ -3733,6 +3733,13 @@ int diff_filespec_is_binary(struct repository *r,
 	return one->is_binary;
 }
 
+int diff_filespec_binary_attr(struct repository *r,
+			      struct diff_filespec *one)
+{
+	diff_filespec_load_driver(one, r->index);
+	return one->driver->binary;
+}
+
 static const struct userdiff_funcname *
 diff_funcname_pattern(struct diff_options *o, struct diff_filespec *one)
 {
@@ -1,5 +1,6 @@
 #include "git-compat-util.h"
 #include "diffcore.h"
+#include "strbuf.h"
 
 /*
  * Idea here is very simple.
@@ -234,3 +235,60 @@ int diffcore_count_changes(struct repository *r,
 	*literal_added = la;
 	return 0;
 }
+
+void *diffcore_count_data(struct repository *r, struct diff_filespec *one)
+{
+	return hash_chars(r, one);
+}
+
+/*
+ * The persistent form of a "cnt_data" fingerprint is the list of its
+ * (hashval, cnt) pairs in hashval order, as 32-bit network byte order
+ * integers.
+ */
+void diffcore_count_data_write(void *count, struct strbuf *out)
+{
+	struct spanhash_top *top = count;
+	struct spanhash *s;
+
+	for (s = top->data; s->cnt; s++) {
+		unsigned char buf[8];
+
+		put_be32(buf, s->hashval);
+		put_be32(buf + 4, s->cnt);
+		strbuf_add(out, buf, sizeof(buf));
+	}
+}
+
+void *diffcore_count_data_read(const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+	struct spanhash_top *top;
+	size_t nr, i;
+	int log2 = INITIAL_HASH_SIZE;
+
+	if (len % 8)
+		return NULL;
+	nr = len / 8;
+
+	/* Leave at least one zero count to terminate the list. */
+	while (((size_t)1 << log2) <= nr)
+		log2++;
+	top = xcalloc(1, st_add(sizeof(*top),
+				st_mult(sizeof(struct spanhash), (size_t)1 << log2)));
+	top->alloc_log2 = log2;
+	top->free = INITIAL_FREE(log2) - nr;
+
+	for (i = 0; i < nr; i++, p += 8) {
+		struct spanhash *h = &top->data[i];
+
+		h->hashval = get_be32(p);
+		h->cnt = get_be32(p + 4);
+		if (!h->cnt || h->hashval >= HASHBASE ||
+		    (i && h->hashval <= h[-1].hashval)) {
+			free(top);
+			return NULL;
+		}
+	}
+	return top;
+}
@@ -11,11 +11,15 @@
 #include "object-file.h"
 #include "hashmap.h"
 #include "mem-pool.h"
+#include "notes-cache.h"
 #include "oid-array.h"
 #include "progress.h"
 #include "promisor-remote.h"
+#include "config.h"
+#include "environment.h"
 #include "string-list.h"
 #include "strmap.h"
+#include "thread-utils.h"
 #include "trace2.h"
 
 /* Table of rename/copy destinations */
@@ -129,6 +133,114 @@ static void inexact_prefetch(void *prefetch_options)
 	oid_array_clear(&to_fetch);
 }
 
+/*
+ * With diff.renameCache, the fingerprints that estimate_similarity()
+ * computes for blobs are kept in a notes cache keyed by the blob's
+ * object name, so that later rename detection does not have to read
+ * and hash the same blobs again.
+ */
+#define RENAME_CACHE_NAME "rename-fingerprints"
+#define RENAME_CACHE_VALIDITY "spanhash v1"
+
+static struct notes_cache *rename_cache;
+
+static struct notes_cache *get_rename_cache(struct repository *r)
+{
+	static int initialized;
+	int enabled = 0;
+
+	if (initialized)
+		return rename_cache;
+	initialized = 1;
+
+	if (!have_git_dir() ||
+	    repo_config_get_bool(r, "diff.renamecache", &enabled) || !enabled)
+		return NULL;
+
+	rename_cache = xmalloc(sizeof(*rename_cache));
+	notes_cache_init(r, rename_cache, RENAME_CACHE_NAME,
+			 RENAME_CACHE_VALIDITY);
+	return rename_cache;
+}
+
+/*
+ * Only blobs whose text-ness is decided by their contents can be
+ * cached, as the fingerprint of the same blob differs otherwise.
+ */
+static int rename_cacheable(struct repository *r, struct diff_filespec *one)
+{
+	return one->oid_valid && diff_filespec_binary_attr(r, one) < 0;
+}
+
+static void load_cached_fingerprint(struct repository *r,
+				    struct diff_filespec *one)
+{
+	struct notes_cache *c = get_rename_cache(r);
+	char *buf;
+	size_t size;
+
+	if (!c || !rename_cacheable(r, one))
+		return;
+
+	buf = notes_cache_get(c, &one->oid, &size);
+	if (!buf)
+		return;
+	one->cnt_data = diffcore_count_data_read(buf, size);
+	free(buf);
+}
+
+static void store_fingerprint(struct repository *r,
+			      struct diff_filespec *one)
+{
+	struct notes_cache *c = get_rename_cache(r);
+	struct strbuf buf = STRBUF_INIT;
+
+	if (!c || !one->cnt_data || !rename_cacheable(r, one))
+		return;
+
+	diffcore_count_data_write(one->cnt_data, &buf);
+	/* ignore errors, as we might be in a readonly repository */
+	notes_cache_put(c, &one->oid, buf.buf, buf.len);
+	strbuf_release(&buf);
+}
+
+/*
+ * We would not consider edits that change the file size so drastically.
+ * The size difference must be smaller than
+ * (MAX_SCORE-minimum_score)/MAX_SCORE * min(src->size, dst->size).
+ *
+ * Note that a zero minimum size is handled here already and the final
+ * score computation in similarity_score() would not have a
+ * divide-by-zero issue.
+ */
+static int sizes_too_different(struct diff_filespec *src,
+			       struct diff_filespec *dst,
+			       int minimum_score)
+{
+	unsigned long max_size, delta_size, base_size;
+
+	max_size = ((src->size > dst->size) ? src->size : dst->size);
+	base_size = ((src->size < dst->size) ? src->size : dst->size);
+	delta_size = max_size - base_size;
+
+	return max_size * (MAX_SCORE-minimum_score) < delta_size * MAX_SCORE;
+}
+
+/*
+ * How similar are they? What percentage of material in dst are from
+ * source?
+ */
+static int similarity_score(struct diff_filespec *src,
+			    struct diff_filespec *dst,
+			    unsigned long src_copied)
+{
+	unsigned long max_size = ((src->size > dst->size) ? src->size : dst->size);
+
+	if (!dst->size)
+		return 0; /* should not happen */
+	return (int)(src_copied * MAX_SCORE / max_size);
+}
+
 static int estimate_similarity(struct repository *r,
 			       struct diff_filespec *src,
 			       struct diff_filespec *dst,
@@ -148,8 +260,8 @@ static int estimate_similarity(struct repository *r,
 	 * match than anything else; the destination does not even
 	 * call into this function in that case.
 	 */
-	unsigned long max_size, delta_size, base_size, src_copied, literal_added;
-	int score;
+	unsigned long src_copied, literal_added;
+	int new_src, new_dst;
 
 	/* We deal only with regular files.  Symlink renames are handled
 	 * only when they are exact matches --- in other words, no edits
@@ -176,23 +288,18 @@ static int estimate_similarity(struct repository *r,
 	    diff_populate_filespec(r, dst, dpf_opt))
 		return 0;
 
-	max_size = ((src->size > dst->size) ? src->size : dst->size);
-	base_size = ((src->size < dst->size) ? src->size : dst->size);
-	delta_size = max_size - base_size;
-
-	/* We would not consider edits that change the file size so
-	 * drastically.  delta_size must be smaller than
-	 * (MAX_SCORE-minimum_score)/MAX_SCORE * min(src->size, dst->size).
-	 *
-	 * Note that base_size == 0 case is handled here already
-	 * and the final score computation below would not have a
-	 * divide-by-zero issue.
-	 */
-	if (max_size * (MAX_SCORE-minimum_score) < delta_size * MAX_SCORE)
+	if (sizes_too_different(src, dst, minimum_score))
 		return 0;
 
 	dpf_opt->check_size_only = 0;
 
+	if (!src->cnt_data)
+		load_cached_fingerprint(r, src);
+	if (!dst->cnt_data)
+		load_cached_fingerprint(r, dst);
+	new_src = !src->cnt_data;
+	new_dst = !dst->cnt_data;
+
 	if (!src->cnt_data && diff_populate_filespec(r, src, dpf_opt))
 		return 0;
 	if (!dst->cnt_data && diff_populate_filespec(r, dst, dpf_opt))
@@ -203,14 +310,62 @@ static int estimate_similarity(struct repository *r,
 				   &src_copied, &literal_added))
 		return 0;
 
-	/* How similar are they?
-	 * what percentage of material in dst are from source?
-	 */
-	if (!dst->size)
-		score = 0; /* should not happen */
-	else
-		score = (int)(src_copied * MAX_SCORE / max_size);
-	return score;
+	if (new_src)
+		store_fingerprint(r, src);
+	if (new_dst)
+		store_fingerprint(r, dst);
+
+	return similarity_score(src, dst, src_copied);
+}
+
+/*
+ * Like estimate_similarity(), but for filespecs that have already been
+ * through prepare_fingerprint(). This does not touch the filespecs and
+ * is safe to call from several threads at once.
+ */
+static int estimate_prepared_similarity(struct repository *r,
+					struct diff_filespec *src,
+					struct diff_filespec *dst,
+					int minimum_score)
+{
+	unsigned long src_copied, literal_added;
+
+	if (!S_ISREG(src->mode) || !S_ISREG(dst->mode))
+		return 0;
+	if (!src->cnt_data || !dst->cnt_data)
+		return 0;
+	if (sizes_too_different(src, dst, minimum_score))
+		return 0;
+	if (diffcore_count_changes(r, src, dst,
+				   &src->cnt_data, &dst->cnt_data,
+				   &src_copied, &literal_added))
+		return 0;
+	return similarity_score(src, dst, src_copied);
+}
+
+/*
+ * Read "one" and compute its fingerprint (or take it from the rename
+ * cache), so that estimate_prepared_similarity() can use it. The blob
+ * itself is not kept.
+ */
+static void prepare_fingerprint(struct repository *r,
+				struct diff_filespec *one,
+				struct diff_populate_filespec_options *dpf_opt)
+{
+	if (one->cnt_data || !S_ISREG(one->mode))
+		return;
+
+	dpf_opt->check_size_only = 1;
+	if (diff_populate_filespec(r, one, dpf_opt))
+		return;
+	dpf_opt->check_size_only = 0;
+
+	load_cached_fingerprint(r, one);
+	if (!one->cnt_data && !diff_populate_filespec(r, one, dpf_opt)) {
+		one->cnt_data = diffcore_count_data(r, one);
+		store_fingerprint(r, one);
+	}
+	diff_free_filespec_blob(one);
 }
 
 static void record_rename_pair(int dst_index, int src_index, int score)
@@ -1077,6 +1232,198 @@ static void record_if_better(struct diff_score m[], struct diff_score *o)
 		m[worst] = *o;
 }
 
+/*
+ * With diff.renameThreads, the rows of the similarity matrix are scored
+ * by several threads. All fingerprints are computed up front, so that
+ * the threads only ever read the filespecs. Each row is filled in by a
+ * single thread that visits the sources in the same order as a single
+ * thread does, so the result does not depend on the number of threads.
+ */
+struct rename_matrix {
+	struct repository *repo;
+	struct diff_score *mx;
+	int *rows; /* index into rename_dst[] of each row of "mx" */
+	int nr_rows;
+	int next_row;
+	int minimum_score;
+	int skip_unmodified;
+	int used_sources_ok;
+	int num_sources;
+	struct progress *progress;
+	pthread_mutex_t mutex;
+
+	/*
+	 * Only set when scoring in a single thread: the filespecs are then
+	 * populated as they are compared, and their blobs freed right away.
+	 */
+	struct diff_populate_filespec_options *dpf_opt;
+};
+
+static int rename_threads(struct repository *r)
+{
+	static int nr_threads = -1;
+
+	if (nr_threads >= 0)
+		return nr_threads;
+
+	nr_threads = 1;
+	if (repo_config_get_int(r, "diff.renamethreads", &nr_threads))
+		return nr_threads;
+	if (nr_threads < 0)
+		die(_("invalid number of threads specified (%d)"), nr_threads);
+	if (!HAVE_THREADS && nr_threads != 1) {
+		warning(_("no threads support, ignoring %s"), "diff.renameThreads");
+		nr_threads = 1;
+	}
+	if (!nr_threads)
+		nr_threads = online_cpus();
+	return nr_threads;
+}
+
+static void score_rename_row(struct rename_matrix *rm, int row)
+{
+	int i = rm->rows[row];
+	struct diff_filespec *two = rename_dst[i].p->two;
+	struct diff_score *m = &rm->mx[row * NUM_CANDIDATE_PER_DST];
+	int j;
+
+	for (j = 0; j < NUM_CANDIDATE_PER_DST; j++)
+		m[j].dst = -1;
+
+	for (j = 0; j < rename_src_nr; j++) {
+		struct diff_filespec *one = rename_src[j].p->one;
+		struct diff_score this_src;
+
+		assert(!one->rename_used || rm->used_sources_ok);
+
+		if (rm->skip_unmodified &&
+		    diff_unmodified_pair(rename_src[j].p))
+			continue;
+
+		if (rm->dpf_opt)
+			this_src.score = estimate_similarity(rm->repo, one, two,
+							     rm->minimum_score,
+							     rm->dpf_opt);
+		else
+			this_src.score = estimate_prepared_similarity(rm->repo,
+								      one, two,
+								      rm->minimum_score);
+		this_src.name_score = basename_same(one, two);
+		this_src.dst = i;
+		this_src.src = j;
+		record_if_better(m, &this_src);
+		if (rm->dpf_opt) {
+			/*
+			 * Once we run estimate_similarity,
+			 * We do not need the text anymore.
+			 */
+			diff_free_filespec_blob(one);
+			diff_free_filespec_blob(two);
+		}
+	}
+}
+
+static void *rename_matrix_worker(void *arg)
+{
+	struct rename_matrix *rm = arg;
+
+	for (;;) {
+		int row = -1;
+
+		pthread_mutex_lock(&rm->mutex);
+		if (rm->next_row < rm->nr_rows) {
+			row = rm->next_row++;
+			display_progress(rm->progress,
+					 (uint64_t)row * (uint64_t)rm->num_sources);
+		}
+		pthread_mutex_unlock(&rm->mutex);
+
+		if (row < 0)
+			break;
+		score_rename_row(rm, row);
+	}
+
+	return NULL;
+}
+
+/*
+ * Fill in "mx" for all destinations that have not been matched yet,
+ * using "nr_threads" threads. Returns the number of rows filled in.
+ */
+static int score_renames(struct repository *r,
+			 struct diff_score *mx,
+			 int nr_threads,
+			 int minimum_score,
+			 int skip_unmodified,
+			 int used_sources_ok,
+			 int num_sources,
+			 struct progress *progress,
+			 struct diff_populate_filespec_options *dpf_opt)
+{
+	struct rename_matrix rm = {
+		.repo = r,
+		.mx = mx,
+		.minimum_score = minimum_score,
+		.skip_unmodified = skip_unmodified,
+		.used_sources_ok = used_sources_ok,
+		.num_sources = num_sources,
+		.progress = progress,
+	};
+	pthread_t *threads;
+	int i;
+
+	if (nr_threads <= 1) {
+		rm.dpf_opt = dpf_opt;
+		ALLOC_ARRAY(rm.rows, rename_dst_nr);
+		for (i = 0; i < rename_dst_nr; i++) {
+			if (rename_dst[i].is_rename)
+				continue; /* exact or basename match already handled */
+			rm.rows[rm.nr_rows] = i;
+			score_rename_row(&rm, rm.nr_rows++);
+			display_progress(progress,
+					 (uint64_t)rm.nr_rows * (uint64_t)num_sources);
+		}
+		free(rm.rows);
+		return rm.nr_rows;
+	}
+
+	trace2_region_enter("diff", "prepare fingerprints", r);
+	for (i = 0; i < rename_src_nr; i++) {
+		if (skip_unmodified && diff_unmodified_pair(rename_src[i].p))
+			continue;
+		prepare_fingerprint(r, rename_src[i].p->one, dpf_opt);
+	}
+	ALLOC_ARRAY(rm.rows, rename_dst_nr);
+	for (i = 0; i < rename_dst_nr; i++) {
+		if (rename_dst[i].is_rename)
+			continue; /* exact or basename match already handled */
+		prepare_fingerprint(r, rename_dst[i].p->two, dpf_opt);
+		rm.rows[rm.nr_rows++] = i;
+	}
+	trace2_region_leave("diff", "prepare fingerprints", r);
+
+	if (nr_threads > rm.nr_rows)
+		nr_threads = rm.nr_rows;
+	trace2_data_intmax("diff", r, "inexact renames/threads", nr_threads);
+
+	pthread_mutex_init(&rm.mutex, NULL);
+	CALLOC_ARRAY(threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		int err = pthread_create(&threads[i], NULL,
+					 rename_matrix_worker, &rm);
+		if (err)
+			die(_("unable to create rename thread: %s"),
+			    strerror(err));
+	}
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	pthread_mutex_destroy(&rm.mutex);
+
+	free(rm.rows);
+	return rm.nr_rows;
+}
+
 /*
  * Returns:
  * 0 if we are under the limit;
@@ -1389,9 +1736,10 @@ void diffcore_rename_extended(struct diff_options *options,
 	struct diff_queue_struct *q = &diff_queued_diff;
 	struct diff_queue_struct outq = DIFF_QUEUE_INIT;
 	struct diff_score *mx;
-	int i, j, rename_count, skip_unmodified = 0;
+	int i, rename_count, skip_unmodified = 0;
 	int num_destinations, dst_cnt;
 	int num_sources, want_copies;
+	int nr_threads;
 	struct progress *progress = NULL;
 	struct mem_pool local_pool;
 	struct dir_rename_info info;
@@ -1580,46 +1928,13 @@ void diffcore_rename_extended(struct diff_options *options,
 	}
 
 	CALLOC_ARRAY(mx, st_mult(NUM_CANDIDATE_PER_DST, num_destinations));
-	for (dst_cnt = i = 0; i < rename_dst_nr; i++) {
-		struct diff_filespec *two = rename_dst[i].p->two;
-		struct diff_score *m;
-
-		if (rename_dst[i].is_rename)
-			continue; /* exact or basename match already handled */
-
-		m = &mx[dst_cnt * NUM_CANDIDATE_PER_DST];
-		for (j = 0; j < NUM_CANDIDATE_PER_DST; j++)
-			m[j].dst = -1;
-
-		for (j = 0; j < rename_src_nr; j++) {
-			struct diff_filespec *one = rename_src[j].p->one;
-			struct diff_score this_src;
-
-			assert(!one->rename_used || want_copies || break_idx);
-
-			if (skip_unmodified &&
-			    diff_unmodified_pair(rename_src[j].p))
-				continue;
-
-			this_src.score = estimate_similarity(options->repo,
-							     one, two,
-							     minimum_score,
-							     &dpf_options);
-			this_src.name_score = basename_same(one, two);
-			this_src.dst = i;
-			this_src.src = j;
-			record_if_better(m, &this_src);
-			/*
-			 * Once we run estimate_similarity,
-			 * We do not need the text anymore.
-			 */
-			diff_free_filespec_blob(one);
-			diff_free_filespec_blob(two);
-		}
-		dst_cnt++;
-		display_progress(progress,
-				 (uint64_t)dst_cnt * (uint64_t)num_sources);
-	}
+	nr_threads = rename_threads(options->repo);
+	if (num_destinations < 2)
+		nr_threads = 1;
+	dst_cnt = score_renames(options->repo, mx, nr_threads,
+				minimum_score, skip_unmodified,
+				want_copies || break_idx, num_sources,
+				progress, &dpf_options);
 	stop_progress(&progress);
 
 	/* cost matrix sorted by most to least similar pair */
@@ -1634,6 +1949,9 @@ void diffcore_rename_extended(struct diff_options *options,
 	trace2_region_leave("diff", "inexact renames", options->repo);
 
  cleanup:
+	if (rename_cache)
+		notes_cache_write(rename_cache);
+
 	/* At this point, we have found some renames and copies and they
 	 * are recorded in rename_dst.  The original list is still in *q.
 	 */
@@ -10,6 +10,7 @@ struct diff_options;
 struct mem_pool;
 struct oid_array;
 struct repository;
+struct strbuf;
 struct strintmap;
 struct strmap;
 struct userdiff_driver;
@@ -103,6 +104,12 @@ void diff_free_filespec_data(struct diff_filespec *);
 void diff_free_filespec_blob(struct diff_filespec *);
 int diff_filespec_is_binary(struct repository *, struct diff_filespec *);
 
+/*
+ * Returns 1 or 0 if the attributes of "one" say whether it is binary,
+ * and -1 if diff_filespec_is_binary() has to look at its contents.
+ */
+int diff_filespec_binary_attr(struct repository *, struct diff_filespec *);
+
 /**
  * This records a pair of `struct diff_filespec`; the filespec for a file in
  * the "old" set (i.e. preimage) is called `one`, and the filespec for a file
@@ -241,6 +248,22 @@ int diffcore_count_changes(struct repository *r,
 			   unsigned long *src_copied,
 			   unsigned long *literal_added);
 
+/*
+ * Compute the "cnt_data" that diffcore_count_changes() would compute for
+ * "one", whose contents must have been populated. Once both sides have
+ * their "cnt_data", diffcore_count_changes() neither reads nor modifies
+ * the filespecs and may be called from several threads.
+ */
+void *diffcore_count_data(struct repository *r, struct diff_filespec *one);
+
+/*
+ * Convert the "cnt_data" computed by diffcore_count_changes() to and
+ * from a byte string, so that it can be stored outside of the process.
+ * diffcore_count_data_read() returns NULL if "buf" is malformed.
+ */
+void diffcore_count_data_write(void *count, struct strbuf *out);
+void *diffcore_count_data_read(const void *buf, size_t len);
+
 /*
  * If filespec contains an OID and if that object is missing from the given
  * repository, add that OID to to_fetch.
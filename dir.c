@@ -18,6 +18,7 @@
 #include "gettext.h"
 #include "name-hash.h"
 #include "object-file.h"
+#include "odb.h"
 #include "path.h"
 #include "refs.h"
 #include "repository.h"
@@ -33,6 +34,7 @@
 #include "strbuf.h"
 #include "submodule-config.h"
 #include "symlinks.h"
+#include "thread-utils.h"
 #include "trace2.h"
 #include "tree.h"
 #include "hex.h"
@@ -43,6 +45,12 @@
   */
 #define PATTERN_MAX_FILE_SIZE (100 * 1024 * 1024)
 
+/*
+ * Walking the worktree is dominated by system calls, so more threads
+ * than this rarely help.
+ */
+#define MAX_WALK_THREADS 8
+
 /*
  * Tells read_directory_recursive how a file or directory should be treated.
  * Values are ordered by significance, e.g. if a directory contains both
@@ -71,6 +79,36 @@ struct cached_dir {
 	struct untracked_cache_dir *ucd;
 };
 
+/*
+ * State shared by the threads of a parallel read_directory().  The
+ * subdirectories that read_directory_recursive() would recurse into
+ * are queued instead, as long as nobody above them needs to know what
+ * is inside, and each thread walks the directories it takes off the
+ * queues with a dir_struct of its own.
+ */
+struct dir_walk {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct dir_walk_thread *threads;
+	int nr_threads;
+	/* number of directories that are queued or being walked */
+	unsigned pending;
+	struct index_state *istate;
+	const struct pathspec *pathspec;
+};
+
+struct dir_walk_thread {
+	pthread_t pthread;
+	struct dir_walk *shared;
+	struct dir_struct dir;
+	/*
+	 * Directories to walk.  The thread takes them from the end of
+	 * its own queue and steals from the start of the others.
+	 */
+	char **queue;
+	size_t queue_first, queue_nr, queue_alloc;
+};
+
 static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 	struct index_state *istate, const char *path, int len,
 	struct untracked_cache_dir *untracked,
@@ -1022,6 +1060,10 @@ void clear_pattern_list(struct pattern_list *pl)
 	free(pl->patterns);
 	clear_pattern_entry_hashmap(&pl->recursive_hashmap);
 	clear_pattern_entry_hashmap(&pl->parent_hashmap);
+	if (pl->index) {
+		pattern_index_clear(pl->index);
+		free(pl->index);
+	}
 
 	memset(pl, 0, sizeof(*pl));
 }
@@ -1414,6 +1456,215 @@ int match_pathname(const char *pathname, int pathlen,
 				 WM_PATHNAME) == 0;
 }
 
+struct pattern_index_entry {
+	struct hashmap_entry ent;
+	const char *key;
+	int keylen;
+	int *pos;
+	size_t pos_nr, pos_alloc;
+};
+
+static int pattern_index_entry_cmp(const void *cmp_data UNUSED,
+				   const struct hashmap_entry *eptr,
+				   const struct hashmap_entry *entry_or_key,
+				   const void *keydata UNUSED)
+{
+	const struct pattern_index_entry *a, *b;
+
+	a = container_of(eptr, const struct pattern_index_entry, ent);
+	b = container_of(entry_or_key, const struct pattern_index_entry, ent);
+	return a->keylen != b->keylen || fspathncmp(a->key, b->key, a->keylen);
+}
+
+static unsigned int pattern_index_hash(const char *key, int keylen)
+{
+	return ignore_case ? memihash(key, keylen) : memhash(key, keylen);
+}
+
+static struct pattern_index_entry *pattern_index_find(const struct hashmap *map,
+						      const char *key, int keylen)
+{
+	struct pattern_index_entry k;
+
+	hashmap_entry_init(&k.ent, pattern_index_hash(key, keylen));
+	k.key = key;
+	k.keylen = keylen;
+	return hashmap_get_entry(map, &k, ent, NULL);
+}
+
+static void pattern_index_insert(struct hashmap *map, const char *key,
+				 int keylen, int pos)
+{
+	struct pattern_index_entry *e = pattern_index_find(map, key, keylen);
+
+	if (!e) {
+		CALLOC_ARRAY(e, 1);
+		hashmap_entry_init(&e->ent, pattern_index_hash(key, keylen));
+		e->key = key;
+		e->keylen = keylen;
+		hashmap_add(map, &e->ent);
+	}
+	ALLOC_GROW(e->pos, e->pos_nr + 1, e->pos_alloc);
+	e->pos[e->pos_nr++] = pos;
+}
+
+static const char *last_dot(const char *str, int len)
+{
+	while (len--)
+		if (str[len] == '.')
+			return str + len;
+	return NULL;
+}
+
+void pattern_index_init(struct pattern_index *index)
+{
+	memset(index, 0, sizeof(*index));
+	hashmap_init(&index->basenames, pattern_index_entry_cmp, NULL, 0);
+	hashmap_init(&index->extensions, pattern_index_entry_cmp, NULL, 0);
+}
+
+void pattern_index_add(struct pattern_index *index, int pos,
+		       const char *pattern, int patternlen,
+		       int nowildcardlen, unsigned flags)
+{
+	const char *dot;
+
+	if (pos < index->nr)
+		BUG("patterns must be indexed in order");
+	index->nr = pos + 1;
+
+	if ((flags & PATTERN_FLAG_NODIR) && nowildcardlen == patternlen) {
+		pattern_index_insert(&index->basenames, pattern, patternlen, pos);
+		return;
+	}
+
+	/*
+	 * A basename that ends in "literal" has its last dot where the
+	 * last dot of "literal" is, if it has one.
+	 */
+	if ((flags & PATTERN_FLAG_NODIR) && (flags & PATTERN_FLAG_ENDSWITH) &&
+	    (dot = last_dot(pattern, patternlen))) {
+		dot++;
+		pattern_index_insert(&index->extensions, dot,
+				     pattern + patternlen - dot, pos);
+		return;
+	}
+
+	ALLOC_GROW(index->others, index->others_nr + 1, index->others_alloc);
+	index->others[index->others_nr++] = pos;
+}
+
+static void pattern_index_free_map(struct hashmap *map)
+{
+	struct hashmap_iter iter;
+	struct pattern_index_entry *e;
+
+	hashmap_for_each_entry(map, &iter, e, ent)
+		free(e->pos);
+	hashmap_clear_and_free(map, struct pattern_index_entry, ent);
+}
+
+void pattern_index_clear(struct pattern_index *index)
+{
+	pattern_index_free_map(&index->basenames);
+	pattern_index_free_map(&index->extensions);
+	free(index->others);
+	pattern_index_init(index);
+}
+
+void pattern_index_lookup(const struct pattern_index *index,
+			  const char *basename, int basenamelen,
+			  struct pattern_candidates *candidates)
+{
+	const struct pattern_index_entry *e;
+	const char *dot = last_dot(basename, basenamelen);
+
+	memset(candidates, 0, sizeof(*candidates));
+	candidates->list[0] = index->others;
+	candidates->nr[0] = index->others_nr;
+
+	e = pattern_index_find(&index->basenames, basename, basenamelen);
+	if (e) {
+		candidates->list[1] = e->pos;
+		candidates->nr[1] = e->pos_nr;
+	}
+
+	if (dot) {
+		dot++;
+		e = pattern_index_find(&index->extensions, dot,
+				       basename + basenamelen - dot);
+		if (e) {
+			candidates->list[2] = e->pos;
+			candidates->nr[2] = e->pos_nr;
+		}
+	}
+}
+
+int pattern_candidates_next(struct pattern_candidates *candidates)
+{
+	int best = -1, from = -1;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(candidates->list); i++) {
+		size_t nr = candidates->nr[i];
+
+		if (nr && candidates->list[i][nr - 1] > best) {
+			best = candidates->list[i][nr - 1];
+			from = i;
+		}
+	}
+	if (from >= 0)
+		candidates->nr[from]--;
+	return best;
+}
+
+static void prepare_pattern_list_index(struct pattern_list *pl)
+{
+	int i;
+
+	if (pl->nr < PATTERN_INDEX_MIN ||
+	    (pl->index && pl->index->nr == pl->nr))
+		return;
+
+	if (pl->index) {
+		pattern_index_clear(pl->index);
+	} else {
+		pl->index = xmalloc(sizeof(*pl->index));
+		pattern_index_init(pl->index);
+	}
+	for (i = 0; i < pl->nr; i++)
+		pattern_index_add(pl->index, i, pl->patterns[i]->pattern,
+				  pl->patterns[i]->patternlen,
+				  pl->patterns[i]->nowildcardlen,
+				  pl->patterns[i]->flags);
+}
+
+static int path_pattern_matches(struct path_pattern *pattern,
+				const char *pathname, int pathlen,
+				const char *basename, int *dtype,
+				struct index_state *istate)
+{
+	if (pattern->flags & PATTERN_FLAG_MUSTBEDIR) {
+		*dtype = resolve_dtype(*dtype, istate, pathname, pathlen);
+		if (*dtype != DT_DIR)
+			return 0;
+	}
+
+	if (pattern->flags & PATTERN_FLAG_NODIR)
+		return match_basename(basename,
+				      pathlen - (basename - pathname),
+				      pattern->pattern, pattern->nowildcardlen,
+				      pattern->patternlen, pattern->flags);
+
+	assert(pattern->baselen == 0 ||
+	       pattern->base[pattern->baselen - 1] == '/');
+	return match_pathname(pathname, pathlen,
+			      pattern->base,
+			      pattern->baselen ? pattern->baselen - 1 : 0,
+			      pattern->pattern, pattern->nowildcardlen,
+			      pattern->patternlen);
+}
+
 /*
  * Scan the given exclude list in reverse to see whether pathname
  * should be ignored.  The first match (i.e. the last on the list), if
@@ -1428,40 +1679,29 @@ static struct path_pattern *last_matching_pattern_from_list(const char *pathname
 						       struct index_state *istate)
 {
 	struct path_pattern *res = NULL; /* undecided */
+	struct pattern_candidates candidates;
 	int i;
 
 	if (!pl->nr)
 		return NULL;	/* undefined */
 
-	for (i = pl->nr - 1; 0 <= i; i--) {
-		struct path_pattern *pattern = pl->patterns[i];
-		const char *exclude = pattern->pattern;
-		int prefix = pattern->nowildcardlen;
-
-		if (pattern->flags & PATTERN_FLAG_MUSTBEDIR) {
-			*dtype = resolve_dtype(*dtype, istate, pathname, pathlen);
-			if (*dtype != DT_DIR)
-				continue;
-		}
-
-		if (pattern->flags & PATTERN_FLAG_NODIR) {
-			if (match_basename(basename,
-					   pathlen - (basename - pathname),
-					   exclude, prefix, pattern->patternlen,
-					   pattern->flags)) {
-				res = pattern;
-				break;
-			}
-			continue;
-		}
+	prepare_pattern_list_index(pl);
+	if (pl->index) {
+		pattern_index_lookup(pl->index, basename,
+				     pathlen - (basename - pathname),
+				     &candidates);
+		while ((i = pattern_candidates_next(&candidates)) >= 0)
+			if (path_pattern_matches(pl->patterns[i], pathname,
+						 pathlen, basename, dtype,
+						 istate))
+				return pl->patterns[i];
+		return NULL;
+	}
 
-		assert(pattern->baselen == 0 ||
-		       pattern->base[pattern->baselen - 1] == '/');
-		if (match_pathname(pathname, pathlen,
-				   pattern->base,
-				   pattern->baselen ? pattern->baselen - 1 : 0,
-				   exclude, prefix, pattern->patternlen)) {
-			res = pattern;
+	for (i = pl->nr - 1; 0 <= i; i--) {
+		if (path_pattern_matches(pl->patterns[i], pathname, pathlen,
+					 basename, dtype, istate)) {
+			res = pl->patterns[i];
 			break;
 		}
 	}
@@ -2019,7 +2259,12 @@ static enum path_treatment treat_directory(struct dir_struct *dir,
 		int nested_repo;
 		struct strbuf sb = STRBUF_INIT;
 		strbuf_addstr(&sb, dirname);
+		/* read_gitfile_gently() uses a static buffer */
+		if (dir->internal.walk)
+			pthread_mutex_lock(&dir->internal.walk->shared->mutex);
 		nested_repo = is_nonbare_repository_dir(&sb);
+		if (dir->internal.walk)
+			pthread_mutex_unlock(&dir->internal.walk->shared->mutex);
 
 		if (nested_repo) {
 			char *real_dirname, *real_gitdir;
@@ -2060,8 +2305,11 @@ static enum path_treatment treat_directory(struct dir_struct *dir,
 			if (!(dir->flags & DIR_HIDE_EMPTY_DIRECTORIES))
 				return path_excluded;
 
-			if (read_directory_recursive(dir, istate, dirname, len,
-						     untracked, 1, 1, pathspec) == path_excluded)
+			dir->internal.walk_nested++;
+			state = read_directory_recursive(dir, istate, dirname, len,
+							 untracked, 1, 1, pathspec);
+			dir->internal.walk_nested--;
+			if (state == path_excluded)
 				return path_excluded;
 
 			return path_none;
@@ -2161,8 +2409,10 @@ static enum path_treatment treat_directory(struct dir_struct *dir,
 	/* Actually recurse into dirname now, we'll fixup the state later. */
 	untracked = lookup_untracked(dir->untracked, untracked,
 				     dirname + baselen, len - baselen);
+	dir->internal.walk_nested++;
 	state = read_directory_recursive(dir, istate, dirname, len, untracked,
 					 check_only, stop_early, pathspec);
+	dir->internal.walk_nested--;
 
 	/* There are a variety of reasons we may need to fixup the state... */
 	if (state == path_excluded) {
@@ -2676,6 +2926,17 @@ static void add_path_to_appropriate_result_list(struct dir_struct *dir,
 	}
 }
 
+static void queue_directory(struct dir_walk_thread *t,
+			    const char *path, size_t len)
+{
+	pthread_mutex_lock(&t->shared->mutex);
+	ALLOC_GROW(t->queue, t->queue_nr + 1, t->queue_alloc);
+	t->queue[t->queue_nr++] = xmemdupz(path, len);
+	t->shared->pending++;
+	pthread_cond_signal(&t->shared->cond);
+	pthread_mutex_unlock(&t->shared->mutex);
+}
+
 /*
  * Read a directory tree. We currently ignore anything but
  * directories, regular files and symlinks. That's because git
@@ -2727,6 +2988,16 @@ static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 		if (state > dir_state)
 			dir_state = state;
 
+		/*
+		 * When nobody needs to know what is inside the subdir,
+		 * leave it to whichever thread gets to it first.
+		 */
+		if (state == path_recurse && dir->internal.walk &&
+		    !dir->internal.walk_nested) {
+			queue_directory(dir->internal.walk, path.buf, path.len);
+			continue;
+		}
+
 		/* recurse into subdir if instructed by treat_path */
 		if (state == path_recurse) {
 			struct untracked_cache_dir *ud;
@@ -3132,6 +3403,187 @@ static void emit_traversal_statistics(struct dir_struct *dir,
 			   "opendir", dir->untracked->dir_opened);
 }
 
+/* Called with the mutex held. */
+static char *next_directory(struct dir_walk_thread *t)
+{
+	struct dir_walk *walk = t->shared;
+	int i;
+
+	for (i = 0; i < walk->nr_threads; i++) {
+		struct dir_walk_thread *from =
+			&walk->threads[(t - walk->threads + i) % walk->nr_threads];
+		char *path;
+
+		if (from->queue_first == from->queue_nr)
+			continue;
+		if (from == t)
+			path = from->queue[--from->queue_nr];
+		else
+			path = from->queue[from->queue_first++];
+		if (from->queue_first == from->queue_nr)
+			from->queue_first = from->queue_nr = 0;
+		return path;
+	}
+	return NULL;
+}
+
+static void *walk_thread(void *data)
+{
+	struct dir_walk_thread *t = data;
+	struct dir_walk *walk = t->shared;
+
+	trace2_thread_start("read_directory");
+	pthread_mutex_lock(&walk->mutex);
+	while (1) {
+		char *path = next_directory(t);
+
+		if (!path) {
+			if (!walk->pending)
+				break;
+			pthread_cond_wait(&walk->cond, &walk->mutex);
+			continue;
+		}
+		pthread_mutex_unlock(&walk->mutex);
+
+		read_directory_recursive(&t->dir, walk->istate, path,
+					 strlen(path), NULL, 0, 0,
+					 walk->pathspec);
+		free(path);
+
+		pthread_mutex_lock(&walk->mutex);
+		if (!--walk->pending)
+			pthread_cond_broadcast(&walk->cond);
+	}
+	pthread_mutex_unlock(&walk->mutex);
+	trace2_thread_exit();
+	return NULL;
+}
+
+/*
+ * The command line and fallback exclude lists are only read during the
+ * walk and can be shared, but every thread loads the per-directory ones
+ * on its own.
+ */
+static void init_walk_dir(struct dir_struct *dst, const struct dir_struct *src)
+{
+	memset(dst, 0, sizeof(*dst));
+	dst->flags = src->flags;
+	dst->exclude_per_dir = src->exclude_per_dir;
+	dst->internal.exclude_list_group[EXC_CMDL] =
+		src->internal.exclude_list_group[EXC_CMDL];
+	dst->internal.exclude_list_group[EXC_FILE] =
+		src->internal.exclude_list_group[EXC_FILE];
+}
+
+static void merge_walk_dir(struct dir_struct *dst, struct dir_struct *src)
+{
+	struct exclude_list_group *group = &src->internal.exclude_list_group[EXC_DIRS];
+	struct exclude_stack *stk;
+	int i;
+
+	ALLOC_GROW(dst->entries, dst->nr + src->nr, dst->internal.alloc);
+	COPY_ARRAY(dst->entries + dst->nr, src->entries, src->nr);
+	dst->nr += src->nr;
+	ALLOC_GROW(dst->ignored, dst->ignored_nr + src->ignored_nr,
+		   dst->internal.ignored_alloc);
+	COPY_ARRAY(dst->ignored + dst->ignored_nr, src->ignored, src->ignored_nr);
+	dst->ignored_nr += src->ignored_nr;
+	dst->internal.visited_paths += src->internal.visited_paths;
+	dst->internal.visited_directories += src->internal.visited_directories;
+
+	for (i = 0; i < group->nr; i++) {
+		free((char *)group->pl[i].src);
+		clear_pattern_list(&group->pl[i]);
+	}
+	free(group->pl);
+	while ((stk = src->internal.exclude_stack)) {
+		src->internal.exclude_stack = stk->prev;
+		free(stk);
+	}
+	strbuf_release(&src->internal.basebuf);
+	free(src->entries);
+	free(src->ignored);
+}
+
+static int walk_threads(struct dir_struct *dir, struct index_state *istate,
+			const struct pathspec *pathspec)
+{
+	int threads = 1;
+
+	/*
+	 * The untracked cache is updated as the walk goes and already
+	 * spares us most of it, a sparse index may need expanding by
+	 * the lookups, and attributes cannot be matched from several
+	 * threads.
+	 */
+	if (!HAVE_THREADS || dir->untracked || istate->sparse_index ||
+	    (pathspec && (pathspec->magic & PATHSPEC_ATTR)))
+		return 1;
+
+	repo_config_get_int(istate->repo, "core.untrackedthreads", &threads);
+	if (threads < 1) {
+		threads = online_cpus();
+		if (threads > MAX_WALK_THREADS)
+			threads = MAX_WALK_THREADS;
+	}
+	return threads;
+}
+
+static void read_directory_threaded(struct dir_struct *dir,
+				    struct index_state *istate,
+				    const char *path, int len,
+				    const struct pathspec *pathspec,
+				    int nr_threads)
+{
+	struct dir_walk walk = {
+		.nr_threads = nr_threads,
+		.istate = istate,
+		.pathspec = pathspec,
+	};
+	int i, err;
+
+	pthread_mutex_init(&walk.mutex, NULL);
+	pthread_cond_init(&walk.cond, NULL);
+	CALLOC_ARRAY(walk.threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		walk.threads[i].shared = &walk;
+		init_walk_dir(&walk.threads[i].dir, dir);
+		walk.threads[i].dir.internal.walk = &walk.threads[i];
+	}
+
+	/* make the index lookups of the threads read-only */
+	prepare_name_hash(istate);
+	for (i = 0; i < dir->internal.exclude_list_group[EXC_CMDL].nr; i++)
+		prepare_pattern_list_index(&dir->internal.exclude_list_group[EXC_CMDL].pl[i]);
+	for (i = 0; i < dir->internal.exclude_list_group[EXC_FILE].nr; i++)
+		prepare_pattern_list_index(&dir->internal.exclude_list_group[EXC_FILE].pl[i]);
+
+	dir->internal.walk = &walk.threads[0];
+	read_directory_recursive(dir, istate, path, len, NULL, 0, 0, pathspec);
+	dir->internal.walk = NULL;
+
+	if (walk.pending) {
+		enable_obj_read_lock();
+		for (i = 0; i < nr_threads; i++) {
+			err = pthread_create(&walk.threads[i].pthread, NULL,
+					     walk_thread, &walk.threads[i]);
+			if (err)
+				die(_("unable to create thread: %s"), strerror(err));
+		}
+		for (i = 0; i < nr_threads; i++)
+			pthread_join(walk.threads[i].pthread, NULL);
+		disable_obj_read_lock();
+	}
+
+	for (i = 0; i < nr_threads; i++) {
+		merge_walk_dir(dir, &walk.threads[i].dir);
+		free(walk.threads[i].queue);
+	}
+	free(walk.threads);
+	pthread_cond_destroy(&walk.cond);
+	pthread_mutex_destroy(&walk.mutex);
+}
+
 int read_directory(struct dir_struct *dir, struct index_state *istate,
 		   const char *path, int len, const struct pathspec *pathspec)
 {
@@ -3153,8 +3605,16 @@ int read_directory(struct dir_struct *dir, struct index_state *istate,
 		 * e.g. prep_exclude()
 		 */
 		dir->untracked = NULL;
-	if (!len || treat_leading_path(dir, istate, path, len, pathspec))
-		read_directory_recursive(dir, istate, path, len, untracked, 0, 0, pathspec);
+	if (!len || treat_leading_path(dir, istate, path, len, pathspec)) {
+		int nr_threads = walk_threads(dir, istate, pathspec);
+
+		if (nr_threads > 1)
+			read_directory_threaded(dir, istate, path, len,
+						pathspec, nr_threads);
+		else
+			read_directory_recursive(dir, istate, path, len,
+						 untracked, 0, 0, pathspec);
+	}
 	QSORT(dir->entries, dir->nr, cmp_dir_entry);
 	QSORT(dir->ignored, dir->ignored_nr, cmp_dir_entry);
 
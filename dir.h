@@ -8,6 +8,7 @@
 #include "strbuf.h"
 
 struct repository;
+struct dir_walk_thread;
 
 /**
  * The directory listing API is used to enumerate paths in the work tree,
@@ -118,6 +119,9 @@ struct pattern_list {
 	 * Used to check single-level parents of blobs.
 	 */
 	struct hashmap parent_hashmap;
+
+	/* Built on demand for long lists, see PATTERN_INDEX_MIN. */
+	struct pattern_index *index;
 };
 
 /*
@@ -353,6 +357,10 @@ struct dir_struct {
 		/* Stats about the traversal */
 		unsigned visited_paths;
 		unsigned visited_directories;
+
+		/* Set while read_directory() walks in several threads */
+		struct dir_walk_thread *walk;
+		int walk_nested;
 	} internal;
 };
 
@@ -442,6 +450,50 @@ int match_pathname(const char *, int,
 		   const char *, int,
 		   const char *, int, int);
 
+/*
+ * Trying a long list of patterns one by one against every path gets
+ * expensive, so lists of at least this many patterns are indexed to
+ * narrow down which of them can match a path at all.
+ */
+#define PATTERN_INDEX_MIN 16
+
+/*
+ * Patterns without wildcards that are matched against the basename
+ * are found by the basename, and "*.ext"-style patterns by the part of
+ * the basename after its last dot.  All other patterns are candidates
+ * for every path.  Patterns are identified by their position in the
+ * list and must be added in ascending order.
+ */
+struct pattern_index {
+	struct hashmap basenames;
+	struct hashmap extensions;
+	int *others;
+	size_t others_nr, others_alloc;
+	/* one past the last position added */
+	int nr;
+};
+
+void pattern_index_init(struct pattern_index *index);
+void pattern_index_add(struct pattern_index *index, int pos,
+		       const char *pattern, int patternlen,
+		       int nowildcardlen, unsigned flags);
+void pattern_index_clear(struct pattern_index *index);
+
+struct pattern_candidates {
+	const int *list[3];
+	size_t nr[3];
+};
+
+/*
+ * Find the patterns that may match a path with the given basename.
+ * pattern_candidates_next() returns their positions, from the last to
+ * the first, and -1 when there are no more.
+ */
+void pattern_index_lookup(const struct pattern_index *index,
+			  const char *basename, int basenamelen,
+			  struct pattern_candidates *candidates);
+int pattern_candidates_next(struct pattern_candidates *candidates);
+
 struct path_pattern *last_matching_pattern(struct dir_struct *dir,
 					   struct index_state *istate,
 					   const char *name, int *dtype);
@@ -18,6 +18,7 @@
  */
 #include "git-compat-util.h"
 #include "ewok.h"
+#include "ewok_rlw.h"
 
 #define EWAH_MASK(x) ((eword_t)1 << (x % BITS_IN_EWORD))
 #define EWAH_BLOCK(x) (x / BITS_IN_EWORD)
@@ -99,42 +100,113 @@ struct ewah_bitmap *bitmap_to_ewah(struct bitmap *bitmap)
 	return ewah;
 }
 
+/*
+ * The functions below that take an `ewah_bitmap` walk its run-length
+ * words directly instead of going through `ewah_iterator_next()` one
+ * word at a time, so that a clean run is handled as a single block and
+ * the literal words following it are read straight out of the
+ * compressed buffer.
+ *
+ * The buffer is not validated when it is read from disk; clamp the
+ * number of literal words to what is actually left in it.
+ */
+static size_t rlw_literal_words_in(struct ewah_bitmap *ewah, size_t pointer)
+{
+	size_t lw = rlw_get_literal_words(&ewah->buffer[pointer]);
+	size_t left = ewah->buffer_size - pointer - 1;
+
+	return lw < left ? lw : left;
+}
+
+static size_t ewah_word_count(struct ewah_bitmap *ewah)
+{
+	size_t pointer = 0, nr = 0;
+
+	while (pointer < ewah->buffer_size) {
+		size_t lw = rlw_literal_words_in(ewah, pointer);
+
+		nr += rlw_get_running_len(&ewah->buffer[pointer]) + lw;
+		pointer += lw + 1;
+	}
+
+	return nr;
+}
+
 struct bitmap *ewah_to_bitmap(struct ewah_bitmap *ewah)
 {
-	struct bitmap *bitmap = bitmap_new();
-	struct ewah_iterator it;
-	eword_t blowup;
-	size_t i = 0;
+	struct bitmap *bitmap = bitmap_word_alloc(ewah_word_count(ewah));
+	size_t pointer = 0, i = 0;
+
+	while (pointer < ewah->buffer_size) {
+		const eword_t *rlw = &ewah->buffer[pointer];
+		size_t rl = rlw_get_running_len(rlw);
+		size_t lw = rlw_literal_words_in(ewah, pointer);
 
-	ewah_iterator_init(&it, ewah);
+		if (rlw_get_run_bit(rlw))
+			memset(bitmap->words + i, 0xff, st_mult(rl, sizeof(eword_t)));
+		i += rl;
 
-	while (ewah_iterator_next(&blowup, &it)) {
-		ALLOC_GROW(bitmap->words, i + 1, bitmap->word_alloc);
-		bitmap->words[i++] = blowup;
+		COPY_ARRAY(bitmap->words + i, rlw + 1, lw);
+		i += lw;
+		pointer += lw + 1;
 	}
 
-	bitmap->word_alloc = i;
 	return bitmap;
 }
 
+/*
+ * The word loops below handle four words per iteration, loading all of
+ * them before storing any. That is safe even when `self` and `other`
+ * are the same bitmap, and it leaves the compiler free to use wider
+ * registers where the platform has them.
+ */
 void bitmap_and_not(struct bitmap *self, struct bitmap *other)
 {
 	const size_t count = (self->word_alloc < other->word_alloc) ?
 		self->word_alloc : other->word_alloc;
-
+	eword_t *dst = self->words;
+	const eword_t *src = other->words;
 	size_t i;
 
-	for (i = 0; i < count; ++i)
-		self->words[i] &= ~other->words[i];
+	for (i = 0; i + 4 <= count; i += 4) {
+		eword_t a0 = dst[i] & ~src[i];
+		eword_t a1 = dst[i + 1] & ~src[i + 1];
+		eword_t a2 = dst[i + 2] & ~src[i + 2];
+		eword_t a3 = dst[i + 3] & ~src[i + 3];
+
+		dst[i] = a0;
+		dst[i + 1] = a1;
+		dst[i + 2] = a2;
+		dst[i + 3] = a3;
+	}
+	for (; i < count; ++i)
+		dst[i] &= ~src[i];
 }
 
 void bitmap_or(struct bitmap *self, const struct bitmap *other)
 {
+	const size_t count = other->word_alloc;
+	eword_t *dst;
+	const eword_t *src;
 	size_t i;
 
-	bitmap_grow(self, other->word_alloc);
-	for (i = 0; i < other->word_alloc; i++)
-		self->words[i] |= other->words[i];
+	bitmap_grow(self, count);
+	dst = self->words;
+	src = other->words;
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		eword_t o0 = dst[i] | src[i];
+		eword_t o1 = dst[i + 1] | src[i + 1];
+		eword_t o2 = dst[i + 2] | src[i + 2];
+		eword_t o3 = dst[i + 3] | src[i + 3];
+
+		dst[i] = o0;
+		dst[i + 1] = o1;
+		dst[i + 2] = o2;
+		dst[i + 3] = o3;
+	}
+	for (; i < count; i++)
+		dst[i] |= src[i];
 }
 
 int ewah_bitmap_is_subset(struct ewah_bitmap *self, struct bitmap *other)
@@ -184,9 +256,7 @@ void bitmap_or_ewah(struct bitmap *self, struct ewah_bitmap *other)
 {
 	size_t original_size = self->word_alloc;
 	size_t other_final = (other->bit_size / BITS_IN_EWORD) + 1;
-	size_t i = 0;
-	struct ewah_iterator it;
-	eword_t word;
+	size_t pointer = 0, i = 0;
 
 	if (self->word_alloc < other_final) {
 		self->word_alloc = other_final;
@@ -195,32 +265,75 @@ void bitmap_or_ewah(struct bitmap *self, struct ewah_bitmap *other)
 			      self->word_alloc - original_size);
 	}
 
-	ewah_iterator_init(&it, other);
+	while (pointer < other->buffer_size) {
+		const eword_t *rlw = &other->buffer[pointer];
+		size_t rl = rlw_get_running_len(rlw);
+		size_t lw = rlw_literal_words_in(other, pointer);
+		size_t k;
 
-	while (ewah_iterator_next(&word, &it))
-		self->words[i++] |= word;
+		/* `bit_size` disagreeing with the words is a corrupt bitmap */
+		if (self->word_alloc < i + rl + lw)
+			bitmap_grow(self, i + rl + lw);
+
+		if (rlw_get_run_bit(rlw))
+			memset(self->words + i, 0xff, st_mult(rl, sizeof(eword_t)));
+		i += rl;
+
+		for (k = 0; k < lw; k++)
+			self->words[i + k] |= rlw[k + 1];
+		i += lw;
+		pointer += lw + 1;
+	}
 }
 
-size_t bitmap_popcount(struct bitmap *self)
+/*
+ * Count the bits set in `nr` words. This does the first three steps of
+ * ewah_bit_popcount64() on every word, but accumulates the resulting
+ * per-byte counts of up to 31 words (31 * 8 < 256) before folding them
+ * into a total, rather than paying for the fold on each word.
+ */
+static size_t popcount_words(const eword_t *words, size_t nr)
 {
-	size_t i, count = 0;
+	size_t count = 0;
+
+	while (nr) {
+		size_t batch = nr < 31 ? nr : 31;
+		uint64_t acc = 0;
+
+		nr -= batch;
+		while (batch--) {
+			uint64_t x = *words++;
+
+			x = x - ((x >> 1) & 0x5555555555555555ULL);
+			x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+			acc += (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+		}
 
-	for (i = 0; i < self->word_alloc; ++i)
-		count += ewah_bit_popcount64(self->words[i]);
+		acc = (acc & 0x00FF00FF00FF00FFULL) + ((acc >> 8) & 0x00FF00FF00FF00FFULL);
+		count += (acc * 0x0001000100010001ULL) >> 48;
+	}
 
 	return count;
 }
 
+size_t bitmap_popcount(struct bitmap *self)
+{
+	return popcount_words(self->words, self->word_alloc);
+}
+
 size_t ewah_bitmap_popcount(struct ewah_bitmap *self)
 {
-	struct ewah_iterator it;
-	eword_t word;
-	size_t count = 0;
+	size_t pointer = 0, count = 0;
 
-	ewah_iterator_init(&it, self);
+	while (pointer < self->buffer_size) {
+		const eword_t *rlw = &self->buffer[pointer];
+		size_t lw = rlw_literal_words_in(self, pointer);
 
-	while (ewah_iterator_next(&word, &it))
-		count += ewah_bit_popcount64(word);
+		if (rlw_get_run_bit(rlw))
+			count += rlw_get_running_len(rlw) * BITS_IN_EWORD;
+		count += popcount_words(rlw + 1, lw);
+		pointer += lw + 1;
+	}
 
 	return count;
 }
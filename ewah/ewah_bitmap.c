@@ -256,12 +256,14 @@ void ewah_each_bit(struct ewah_bitmap *self, void (*callback)(size_t, void*), vo
 		++pointer;
 
 		for (k = 0; k < rlw_get_literal_words(word); ++k) {
-			/* todo: zero count optimization */
-			for (size_t c = 0; c < BITS_IN_EWORD; ++c, ++pos) {
-				if ((self->buffer[pointer] & ((eword_t)1 << c)) != 0)
-					callback(pos, payload);
+			eword_t literal = self->buffer[pointer];
+
+			while (literal) {
+				callback(pos + ewah_bit_ctz64(literal), payload);
+				literal &= literal - 1;
 			}
 
+			pos += BITS_IN_EWORD;
 			++pointer;
 		}
 	}
@@ -59,6 +59,18 @@ struct fsmonitor_daemon_state {
 	struct ipc_server_data *ipc_server_data;
 	struct strbuf path_ipc;
 
+	/*
+	 * The token journal lets a restarted daemon keep answering
+	 * requests relative to tokens issued by its predecessor.
+	 * While `journal_catch_up` is set, the restored history does
+	 * not yet include changes made while no daemon was running,
+	 * and clients wait on `journal_cond`.
+	 */
+	struct strbuf path_journal;
+	time_t journal_time;
+	time_t journal_last_write;
+	int journal_catch_up;
+	pthread_cond_t journal_cond;
 };
 
 /*
@@ -31,6 +31,16 @@ int fsmonitor__get_fs_info(const char *path, struct fs_info *fs_info);
  */
 int fsmonitor__is_fs_remote(const char *path);
 
+/*
+ * Get the inode generation number of the given path, if the filesystem
+ * has one.  Together with the device and inode numbers, it tells a
+ * directory apart from another one that was later created in its place.
+ *
+ * Sets *generation to 0 if the filesystem does not expose generation
+ * numbers.  Returns -1 on error, 0 otherwise.
+ */
+int fsmonitor__get_inode_generation(const char *path, uint64_t *generation);
+
 /*
  * Get the alias in given path, if any.
  *
@@ -5,6 +5,11 @@
 #include "git-compat-util.h"
 #include "git-zlib.h"
 
+#ifdef HAVE_LIBDEFLATE
+#include "thread-utils.h"
+#include <libdeflate.h>
+#endif
+
 static const char *zerr_to_string(int status)
 {
 	switch (status) {
@@ -288,3 +293,175 @@ int git_deflate(git_zstream *strm, int flush)
 	      strm->z.msg ? strm->z.msg : "no message");
 	return status;
 }
+
+#ifdef HAVE_LIBDEFLATE
+/*
+ * libdeflate levels go up to 12, but the ones zlib knows about mean
+ * roughly the same thing, so hand them through as they are.
+ */
+static int libdeflate_level(int level)
+{
+	return level == Z_DEFAULT_COMPRESSION ? 6 : level;
+}
+
+/*
+ * Setting up a (de)compressor is expensive compared to running it on a
+ * small object, so every thread keeps the ones it used last around.
+ */
+struct libdeflate_state {
+	struct libdeflate_decompressor *decompressor;
+	struct libdeflate_compressor *compressor;
+	int level;
+};
+
+static pthread_key_t libdeflate_key;
+
+static void libdeflate_state_free(void *data)
+{
+	struct libdeflate_state *state = data;
+
+	if (state->decompressor)
+		libdeflate_free_decompressor(state->decompressor);
+	if (state->compressor)
+		libdeflate_free_compressor(state->compressor);
+	free(state);
+}
+
+static struct libdeflate_state *libdeflate_state(void)
+{
+	static struct libdeflate_state nothread_state;
+	struct libdeflate_state *state;
+
+	if (!HAVE_THREADS)
+		return &nothread_state;
+	state = pthread_getspecific(libdeflate_key);
+	if (!state) {
+		CALLOC_ARRAY(state, 1);
+		pthread_setspecific(libdeflate_key, state);
+	}
+	return state;
+}
+
+static struct libdeflate_compressor *libdeflate_compressor(int level)
+{
+	struct libdeflate_state *state = libdeflate_state();
+
+	if (state->compressor && state->level != level) {
+		libdeflate_free_compressor(state->compressor);
+		state->compressor = NULL;
+	}
+	if (!state->compressor) {
+		state->compressor = libdeflate_alloc_compressor(level);
+		state->level = level;
+	}
+	return state->compressor;
+}
+
+static int libdeflate_inflate_buffer(void *out, size_t out_len,
+				     const void *in, size_t in_len)
+{
+	struct libdeflate_state *state = libdeflate_state();
+	enum libdeflate_result res;
+	size_t used, produced;
+
+	if (!state->decompressor)
+		state->decompressor = libdeflate_alloc_decompressor();
+	if (!state->decompressor)
+		return Z_MEM_ERROR;
+	res = libdeflate_zlib_decompress_ex(state->decompressor,
+					    in, in_len, out, out_len,
+					    &used, &produced);
+
+	switch (res) {
+	case LIBDEFLATE_SUCCESS:
+		return produced == out_len ? Z_STREAM_END : Z_DATA_ERROR;
+	case LIBDEFLATE_INSUFFICIENT_SPACE:
+		return Z_BUF_ERROR;
+	default:
+		return Z_DATA_ERROR;
+	}
+}
+#endif
+
+int git_inflate_buffer(void *out, size_t out_len,
+		       const void *in, size_t in_len)
+{
+	git_zstream strm;
+	int status;
+
+#ifdef HAVE_LIBDEFLATE
+	status = libdeflate_inflate_buffer(out, out_len, in, in_len);
+	if (status != Z_MEM_ERROR)
+		return status;
+	/* otherwise let zlib have a go */
+#endif
+
+	memset(&strm, 0, sizeof(strm));
+	strm.next_in = (unsigned char *)in;
+	strm.avail_in = in_len;
+	strm.next_out = out;
+	strm.avail_out = out_len;
+	git_inflate_init(&strm);
+	do {
+		zlib_pre_call(&strm);
+		/* Never say Z_FINISH unless we are feeding everything */
+		status = inflate(&strm.z,
+				 (strm.z.avail_in != strm.avail_in)
+				 ? 0 : Z_FINISH);
+		if (status == Z_MEM_ERROR)
+			die("inflate: out of memory");
+		zlib_post_call(&strm, status);
+	} while (status == Z_OK);
+	git_inflate_end(&strm);
+
+	if (status == Z_STREAM_END && strm.total_out != out_len)
+		status = Z_DATA_ERROR;
+	return status;
+}
+
+size_t git_deflate_buffer_bound(size_t in_len)
+{
+	size_t bound = deflateBound(NULL, in_len);
+
+#ifdef HAVE_LIBDEFLATE
+	size_t libdeflate_bound = libdeflate_zlib_compress_bound(NULL, in_len);
+
+	if (libdeflate_bound > bound)
+		bound = libdeflate_bound;
+#endif
+	return bound;
+}
+
+size_t git_deflate_buffer(void *out, size_t out_len,
+			  const void *in, size_t in_len, int level)
+{
+	git_zstream strm;
+	int status;
+
+#ifdef HAVE_LIBDEFLATE
+	struct libdeflate_compressor *c;
+
+	c = libdeflate_compressor(libdeflate_level(level));
+	if (c)
+		return libdeflate_zlib_compress(c, in, in_len, out, out_len);
+	/* e.g. a level this libdeflate does not support; use zlib */
+#endif
+
+	git_deflate_init(&strm, level);
+	strm.next_in = (unsigned char *)in;
+	strm.avail_in = in_len;
+	strm.next_out = out;
+	strm.avail_out = out_len;
+	while ((status = git_deflate(&strm, Z_FINISH)) == Z_OK)
+		; /* nothing */
+	git_deflate_end(&strm);
+
+	return status == Z_STREAM_END ? strm.total_out : 0;
+}
+
+void git_zlib_start(void)
+{
+#ifdef HAVE_LIBDEFLATE
+	pthread_key_create(&libdeflate_key, libdeflate_state_free);
+#endif
+}
@@ -27,4 +27,29 @@ int git_deflate_end_gently(git_zstream *);
 int git_deflate(git_zstream *, int flush);
 unsigned long git_deflate_bound(git_zstream *, unsigned long);
 
+/*
+ * One-shot helpers for callers that have the whole input in memory and
+ * know the exact size of the output, e.g. pack entries. They use a
+ * faster DEFLATE implementation when Git is built with one, and plain
+ * zlib otherwise; the output is a regular zlib stream either way.
+ *
+ * git_inflate_buffer() inflates the zlib stream at the start of `in`
+ * into `out`, which must receive exactly `out_len` bytes. `in_len` may
+ * extend past the end of the stream. Returns Z_STREAM_END on success
+ * and another zlib status otherwise; callers can then retry with the
+ * streaming API to handle input that is split or report the error.
+ *
+ * git_deflate_buffer() compresses `in` into `out` and returns the
+ * compressed size, or 0 if it did not fit. `out` must have room for
+ * git_deflate_buffer_bound() bytes to guarantee success.
+ */
+int git_inflate_buffer(void *out, size_t out_len,
+		       const void *in, size_t in_len);
+size_t git_deflate_buffer_bound(size_t in_len);
+size_t git_deflate_buffer(void *out, size_t out_len,
+			  const void *in, size_t in_len, int level);
+
+/* Set up the per-thread state of the helpers above; called on startup. */
+void git_zlib_start(void);
+
 #endif /* GIT_ZLIB_H */
@@ -46,6 +46,7 @@ static struct mp_block *mem_pool_alloc_block(struct mem_pool *pool,
 
 	p->next_free = (char *)p->space;
 	p->end = p->next_free + block_alloc;
+	p->mapped = NULL;
 
 	if (insert_after) {
 		p->next_block = insert_after->next_block;
@@ -77,7 +78,10 @@ void mem_pool_discard(struct mem_pool *pool, int invalidate_memory)
 		block_to_free = block;
 		block = block->next_block;
 
-		if (invalidate_memory)
+		if (block_to_free->mapped)
+			munmap(block_to_free->mapped,
+			       block_to_free->end - block_to_free->mapped);
+		else if (invalidate_memory)
 			memset(block_to_free->space, 0xDD, ((char *)block_to_free->end) - ((char *)block_to_free->space));
 
 		free(block_to_free);
@@ -177,13 +181,33 @@ char *mem_pool_strndup(struct mem_pool *pool, const char *str, size_t len)
 	return memcpy(ret, str, actual_len);
 }
 
+void mem_pool_adopt_mapping(struct mem_pool *pool, void *map, size_t len)
+{
+	struct mp_block *p = xmalloc(sizeof(*p));
+
+	p->mapped = map;
+	p->next_free = p->end = p->mapped + len;
+
+	/*
+	 * Keep the current block at the head, as it is the one
+	 * allocations are served from.
+	 */
+	if (pool->mp_block) {
+		p->next_block = pool->mp_block->next_block;
+		pool->mp_block->next_block = p;
+	} else {
+		p->next_block = NULL;
+		pool->mp_block = p;
+	}
+}
+
 int mem_pool_contains(struct mem_pool *pool, void *mem)
 {
 	struct mp_block *p;
 
 	/* Check if memory is allocated in a block */
 	for (p = pool->mp_block; p; p = p->next_block)
-		if ((mem >= ((void *)p->space)) &&
+		if ((mem >= (p->mapped ? (void *)p->mapped : (void *)p->space)) &&
 		    (mem < ((void *)p->end)))
 			return 1;
 
@@ -5,6 +5,8 @@ struct mp_block {
 	struct mp_block *next_block;
 	char *next_free;
 	char *end;
+	/* start of a region handed over by mem_pool_adopt_mapping() */
+	char *mapped;
 	uintmax_t space[FLEX_ARRAY]; /* more */
 };
 
@@ -60,6 +62,14 @@ char *mem_pool_strfmt(struct mem_pool *pool, const char *fmt, ...);
  */
 void mem_pool_combine(struct mem_pool *dst, struct mem_pool *src);
 
+/*
+ * Hand a region obtained from xmmap() over to the pool. Nothing is
+ * allocated from it, but it counts as part of the pool for
+ * `mem_pool_contains`, moves along in `mem_pool_combine` and is
+ * unmapped by `mem_pool_discard`.
+ */
+void mem_pool_adopt_mapping(struct mem_pool *pool, void *map, size_t len);
+
 /*
  * Check if a memory pointed at by 'mem' is part of the range of
  * memory managed by the specified mem_pool.
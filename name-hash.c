@@ -619,6 +619,11 @@ static void lazy_init_name_hash(struct index_state *istate)
 	trace_performance_leave("initialize name hash");
 }
 
+void prepare_name_hash(struct index_state *istate)
+{
+	lazy_init_name_hash(istate);
+}
+
 /*
  * A test routine for t/helper/ sources.
  *
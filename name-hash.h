@@ -13,6 +13,12 @@ int index_dir_find(struct index_state *istate, const char *name, int namelen,
 void adjust_dirname_case(struct index_state *istate, char *name);
 struct cache_entry *index_file_exists(struct index_state *istate, const char *name, int namelen, int igncase);
 
+/*
+ * Build the name hash now rather than on the first lookup, so that it
+ * can be looked up from several threads.
+ */
+void prepare_name_hash(struct index_state *istate);
+
 int test_lazy_init_name_hash(struct index_state *istate, int try_threaded);
 void add_name_hash(struct index_state *istate, struct cache_entry *ce);
 void remove_name_hash(struct index_state *istate, struct cache_entry *ce);
@@ -20,6 +20,7 @@
 #include "object-file-convert.h"
 #include "object-file.h"
 #include "odb.h"
+#include "odb/source-inmemory.h"
 #include "odb/streaming.h"
 #include "odb/transaction.h"
 #include "pack.h"
@@ -497,6 +498,14 @@ struct odb_transaction_files {
 
 	struct tmp_objdir *objdir;
 	struct transaction_packfile packfile;
+
+	/*
+	 * With "core.transactionObjects=pack", objects written while the
+	 * transaction is pending are buffered in memory and only written
+	 * out as a packfile when the transaction is committed.
+	 */
+	struct odb_source *pending;
+	size_t pending_size;
 };
 
 static void prepare_loose_object_transaction(struct odb_transaction *base)
@@ -1355,6 +1364,159 @@ static int odb_transaction_files_write_object_stream(struct odb_transaction *bas
 	return 0;
 }
 
+/*
+ * Buffered objects are written out to a packfile once they take up more
+ * than this many bytes, even while the transaction is still pending.
+ */
+#define PENDING_OBJECTS_LIMIT (64 * 1024 * 1024)
+
+static struct odb_transaction_files *pending_transaction(struct odb_source *source)
+{
+	struct odb_transaction *base = source->odb->transaction;
+	struct odb_transaction_files *transaction;
+
+	if (!base || base->source != source)
+		return NULL;
+	transaction = container_of(base, struct odb_transaction_files, base);
+	return transaction->pending ? transaction : NULL;
+}
+
+static void write_object_to_pack(struct transaction_packfile *state,
+				 const struct object_id *oid,
+				 enum object_type type,
+				 const void *buf, size_t size)
+{
+	struct repo_config_values *cfg = repo_config_values(the_repository);
+	unsigned char hdr[MAX_PACK_OBJECT_HEADER];
+	struct pack_idx_entry *idx;
+	unsigned char *zbuf;
+	size_t bound, zlen;
+	int hdrlen;
+
+	bound = git_deflate_buffer_bound(size);
+	zbuf = xmalloc(bound);
+	zlen = git_deflate_buffer(zbuf, bound, buf, size,
+				  cfg->pack_compression_level);
+	if (!zlen)
+		die(_("unable to deflate new object %s"), oid_to_hex(oid));
+	hdrlen = encode_in_pack_object_header(hdr, sizeof(hdr), type, size);
+
+	CALLOC_ARRAY(idx, 1);
+	oidcpy(&idx->oid, oid);
+	idx->offset = state->offset;
+	crc32_begin(state->f);
+	hashwrite(state->f, hdr, hdrlen);
+	hashwrite(state->f, zbuf, zlen);
+	idx->crc32 = crc32_end(state->f);
+	state->offset += hdrlen + zlen;
+
+	ALLOC_GROW(state->written, state->nr_written + 1, state->alloc_written);
+	state->written[state->nr_written++] = idx;
+	free(zbuf);
+}
+
+struct write_pending_data {
+	struct odb_transaction_files *transaction;
+	/* Number of leading packfile entries that were streamed into it. */
+	uint32_t nr_streamed;
+	enum object_type type;
+	size_t size;
+	void *content;
+};
+
+static int write_pending_object(const struct object_id *oid,
+				struct object_info *oi UNUSED,
+				void *cb_data)
+{
+	struct write_pending_data *data = cb_data;
+	struct odb_transaction_files *transaction = data->transaction;
+	struct transaction_packfile *state = &transaction->packfile;
+
+	/* The object may have been written by other means in the meantime */
+	if (odb_freshen_object(transaction->base.source->odb, oid))
+		goto out;
+	for (uint32_t i = 0; i < data->nr_streamed; i++)
+		if (oideq(&state->written[i]->oid, oid))
+			goto out;
+
+	if (state->nr_written && pack_size_limit_cfg &&
+	    pack_size_limit_cfg < state->offset + data->size) {
+		flush_packfile_transaction(transaction);
+		data->nr_streamed = 0;
+	}
+	prepare_packfile_transaction(transaction);
+	write_object_to_pack(state, oid, data->type, data->content, data->size);
+
+out:
+	FREE_AND_NULL(data->content);
+	return 0;
+}
+
+/*
+ * Move all buffered objects into the packfile of the transaction. The
+ * caller is expected to flush the packfile afterwards to make them
+ * visible again.
+ */
+static void flush_pending_objects(struct odb_transaction_files *transaction)
+{
+	struct object_database *odb = transaction->base.source->odb;
+	struct write_pending_data data = {
+		.transaction = transaction,
+		.nr_streamed = transaction->packfile.nr_written,
+	};
+	struct object_info oi = OBJECT_INFO_INIT;
+	struct odb_for_each_object_options opts = { 0 };
+
+	if (!transaction->pending_size)
+		return;
+
+	oi.typep = &data.type;
+	oi.sizep = &data.size;
+	oi.contentp = &data.content;
+	odb_source_for_each_object(transaction->pending, &oi,
+				   write_pending_object, &data, &opts);
+
+	odb_source_free(transaction->pending);
+	transaction->pending = &odb_source_inmemory_new(odb)->base;
+	transaction->pending_size = 0;
+}
+
+int odb_transaction_files_write_object(struct odb_source *source,
+				       const void *buf, unsigned long len,
+				       enum object_type type,
+				       struct object_id *oid)
+{
+	struct odb_transaction_files *transaction = pending_transaction(source);
+	int ret;
+
+	if (!transaction)
+		return 1;
+
+	ret = odb_source_write_object(transaction->pending, buf, len, type,
+				      oid, NULL, 0);
+	if (ret < 0)
+		return ret;
+
+	transaction->pending_size += len;
+	if (transaction->pending_size > PENDING_OBJECTS_LIMIT) {
+		flush_pending_objects(transaction);
+		flush_packfile_transaction(transaction);
+	}
+	return 0;
+}
+
+int odb_transaction_files_read_object_info(struct odb_source *source,
+					   const struct object_id *oid,
+					   struct object_info *oi,
+					   enum object_info_flags flags)
+{
+	struct odb_transaction_files *transaction = pending_transaction(source);
+
+	if (!transaction)
+		return -1;
+	return odb_source_read_object_info(transaction->pending, oid, oi, flags);
+}
+
 int index_fd(struct index_state *istate, struct object_id *oid,
 	     int fd, struct stat *st,
 	     enum object_type type, const char *path, unsigned flags)
@@ -1676,6 +1838,11 @@ static void odb_transaction_files_commit(struct odb_transaction *base)
 		container_of(base, struct odb_transaction_files, base);
 
 	flush_loose_object_transaction(transaction);
+	if (transaction->pending) {
+		flush_pending_objects(transaction);
+		odb_source_free(transaction->pending);
+		transaction->pending = NULL;
+	}
 	flush_packfile_transaction(transaction);
 }
 
@@ -1692,5 +1859,14 @@ struct odb_transaction *odb_transaction_files_begin(struct odb_source *source)
 	transaction->base.commit = odb_transaction_files_commit;
 	transaction->base.write_object_stream = odb_transaction_files_write_object_stream;
 
+	/*
+	 * Objects are only buffered when there is no compatibility hash, as
+	 * the mapping for those is recorded along with loose objects.
+	 */
+	prepare_repo_settings(odb->repo);
+	if (odb->repo->settings.core_transaction_objects == TRANSACTION_OBJECTS_PACK &&
+	    !odb->repo->compat_hash_algo)
+		transaction->pending = &odb_source_inmemory_new(odb)->base;
+
 	return &transaction->base;
 }
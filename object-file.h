@@ -199,4 +199,28 @@ struct odb_transaction;
  */
 struct odb_transaction *odb_transaction_files_begin(struct odb_source *source);
 
+/*
+ * Write an object into the pending transaction of the given source when
+ * that transaction buffers objects ("core.transactionObjects=pack"). The
+ * object stays readable via odb_transaction_files_read_object_info() until
+ * the transaction is committed and it has been written to a packfile.
+ *
+ * Returns 0 on success and a negative error code on failure. Returns 1
+ * without doing anything if the object is not buffered, in which case the
+ * caller is expected to write it as a loose object.
+ */
+int odb_transaction_files_write_object(struct odb_source *source,
+				       const void *buf, unsigned long len,
+				       enum object_type type,
+				       struct object_id *oid);
+
+/*
+ * Look up an object buffered in the pending transaction of the given
+ * source. Returns 0 if found, -1 otherwise.
+ */
+int odb_transaction_files_read_object_info(struct odb_source *source,
+					   const struct object_id *oid,
+					   struct object_info *oi,
+					   enum object_info_flags flags);
+
 #endif /* OBJECT_FILE_H */
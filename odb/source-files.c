@@ -56,7 +56,8 @@ static int odb_source_files_read_object_info(struct odb_source *source,
 	struct odb_source_files *files = odb_source_files_downcast(source);
 
 	if (!packfile_store_read_object_info(files->packed, oid, oi, flags) ||
-	    !odb_source_read_object_info(&files->loose->base, oid, oi, flags))
+	    !odb_source_read_object_info(&files->loose->base, oid, oi, flags) ||
+	    !odb_transaction_files_read_object_info(source, oid, oi, flags))
 		return 0;
 
 	return -1;
@@ -166,6 +167,11 @@ static int odb_source_files_write_object(struct odb_source *source,
 					 enum odb_write_object_flags flags)
 {
 	struct odb_source_files *files = odb_source_files_downcast(source);
+	int ret;
+
+	ret = odb_transaction_files_write_object(source, buf, len, type, oid);
+	if (ret <= 0)
+		return ret;
 	return odb_source_write_object(&files->loose->base, buf, len, type,
 				       oid, compat_oid, flags);
 }
@@ -16,6 +16,7 @@
 #include "object.h"
 #include "tag.h"
 #include "trace.h"
+#include "trace2.h"
 #include "tree-walk.h"
 #include "tree.h"
 #include "object-file.h"
@@ -1476,6 +1477,22 @@ get_delta_base_cache_entry(struct packed_git *p, off_t base_offset)
 	return e ? container_of(e, struct delta_base_cache_entry, ent) : NULL;
 }
 
+/*
+ * Like get_delta_base_cache_entry(), but for callers that want to reuse
+ * the cached base; the outcome is reported to trace2 so that the
+ * effectiveness of core.deltaBaseCacheLimit can be judged per thread.
+ */
+static struct delta_base_cache_entry *
+lookup_delta_base_cache(struct packed_git *p, off_t base_offset)
+{
+	struct delta_base_cache_entry *ent;
+
+	ent = get_delta_base_cache_entry(p, base_offset);
+	trace2_counter_add(ent ? TRACE2_COUNTER_ID_DELTA_BASE_CACHE_HIT :
+				 TRACE2_COUNTER_ID_DELTA_BASE_CACHE_MISS, 1);
+	return ent;
+}
+
 static int delta_base_cache_key_eq(const struct delta_base_cache_key *a,
 				   const struct delta_base_cache_key *b)
 {
@@ -1523,7 +1540,7 @@ static void *cache_or_unpack_entry(struct repository *r, struct packed_git *p,
 {
 	struct delta_base_cache_entry *ent;
 
-	ent = get_delta_base_cache_entry(p, base_offset);
+	ent = lookup_delta_base_cache(p, base_offset);
 	if (!ent)
 		return unpack_entry(r, p, base_offset, type, base_size);
 
@@ -1728,10 +1745,24 @@ static void *unpack_compressed_entry(struct packed_git *p,
 	int st;
 	git_zstream stream;
 	unsigned char *buffer, *in;
+	unsigned long avail;
 
 	buffer = xmallocz_gently(size);
 	if (!buffer)
 		return NULL;
+
+	/*
+	 * Usually the whole entry sits in one window and we know how
+	 * large it inflates to, so try doing it in one go first. Fall
+	 * back to streaming it across windows if that did not work.
+	 */
+	in = use_pack(p, w_curs, curpos, &avail);
+	obj_read_unlock();
+	st = git_inflate_buffer(buffer, size, in, avail);
+	obj_read_lock();
+	if (st == Z_STREAM_END)
+		return buffer;
+
 	memset(&stream, 0, sizeof(stream));
 	stream.next_out = buffer;
 	stream.avail_out = size + 1;
@@ -1804,7 +1835,7 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 		int i;
 		struct delta_base_cache_entry *ent;
 
-		ent = get_delta_base_cache_entry(p, curpos);
+		ent = lookup_delta_base_cache(p, curpos);
 		if (ent) {
 			type = ent->type;
 			data = ent->data;
@@ -1952,8 +1983,17 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 			      (uintmax_t)curpos, p->pack_name);
 			data = NULL;
 		} else {
+			/*
+			 * Neither buffer is shared: "base" was detached from
+			 * the delta base cache (or never was in it) and is only
+			 * added back below. Applying the delta is the bulk of
+			 * the work for deep chains, so let other threads read
+			 * objects in the meantime.
+			 */
+			obj_read_unlock();
 			data = patch_delta(base, base_size, delta_data,
 					   delta_size, &size);
+			obj_read_lock();
 
 			/*
 			 * We could not apply the delta; warn the user, but
@@ -1970,11 +2010,11 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 
 		/*
 		 * We delay adding `base` to the cache until the end of the loop
-		 * because unpack_compressed_entry() momentarily releases the
-		 * obj_read_mutex, giving another thread the chance to access
-		 * the cache. Therefore, if `base` was already there, this other
-		 * thread could free() it (e.g. to make space for another entry)
-		 * before we are done using it.
+		 * because unpack_compressed_entry() and patch_delta() above
+		 * run without the obj_read_mutex, giving another thread the
+		 * chance to access the cache. Therefore, if `base` was already
+		 * there, this other thread could free() it (e.g. to make space
+		 * for another entry) before we are done using it.
 		 */
 		if (!external_base)
 			add_delta_base_cache(p, base_obj_offset, base, base_size,
@@ -7,6 +7,7 @@
 #include "gettext.h"
 #include "hash.h"
 #include "hex.h"
+#include "odb.h"
 #include "parallel-checkout.h"
 #include "pkt-line.h"
 #include "progress.h"
@@ -29,6 +30,10 @@ struct parallel_checkout {
 	size_t nr, alloc;
 	struct progress *progress;
 	unsigned int *progress_cnt;
+
+	/* Used by the threads of checkout.workerMode=threads. */
+	size_t next_item;
+	pthread_mutex_t mutex;
 };
 
 static struct parallel_checkout parallel_checkout;
@@ -267,7 +272,7 @@ static int reset_fd(int fd, const char *path)
 }
 
 static int write_pc_item_to_fd(struct parallel_checkout_item *pc_item, int fd,
-			       const char *path)
+			       const char *path, int allow_streaming)
 {
 	int ret;
 	struct stream_filter *filter;
@@ -279,7 +284,12 @@ static int write_pc_item_to_fd(struct parallel_checkout_item *pc_item, int fd,
 	/* Sanity check */
 	ASSERT(is_eligible_for_parallel_checkout(pc_item->ce, &pc_item->ca));
 
-	filter = get_stream_filter_ca(&pc_item->ca, &pc_item->ce->oid);
+	/*
+	 * Streaming does not take the object read lock, so threads read
+	 * the whole blob instead.
+	 */
+	filter = allow_streaming ?
+		get_stream_filter_ca(&pc_item->ca, &pc_item->ce->oid) : NULL;
 	if (filter) {
 		if (odb_stream_blob_to_fd(the_repository->objects, fd,
 					  &pc_item->ce->oid, filter, 1)) {
@@ -332,8 +342,13 @@ static int close_and_clear(int *fd)
 	return ret;
 }
 
-void write_pc_item(struct parallel_checkout_item *pc_item,
-		   struct checkout *state)
+/*
+ * Threads pass their own 'cache' for the leading directory checks, and
+ * cannot stream (see write_pc_item_to_fd()).
+ */
+static void write_pc_item_1(struct parallel_checkout_item *pc_item,
+			    struct checkout *state, struct cache_def *cache,
+			    int allow_streaming)
 {
 	unsigned int mode = (pc_item->ce->ce_mode & 0100) ? 0777 : 0666;
 	int fd = -1, fstat_done = 0;
@@ -351,8 +366,12 @@ void write_pc_item(struct parallel_checkout_item *pc_item,
 	 * a symlink (checked out after we enqueued this entry for parallel
 	 * checkout). Thus, we must check the leading dirs again.
 	 */
-	if (dir_sep && !has_dirs_only_path(path.buf, dir_sep - path.buf,
-					   state->base_dir_len)) {
+	if (dir_sep && !(cache ?
+			 threaded_has_dirs_only_path(cache, path.buf,
+						     dir_sep - path.buf,
+						     state->base_dir_len) :
+			 has_dirs_only_path(path.buf, dir_sep - path.buf,
+					    state->base_dir_len))) {
 		pc_item->status = PC_ITEM_COLLIDED;
 		trace2_data_string("pcheckout", NULL, "collision/dirname", path.buf);
 		goto out;
@@ -379,7 +398,7 @@ void write_pc_item(struct parallel_checkout_item *pc_item,
 		goto out;
 	}
 
-	if (write_pc_item_to_fd(pc_item, fd, path.buf)) {
+	if (write_pc_item_to_fd(pc_item, fd, path.buf, allow_streaming)) {
 		/* Error was already reported. */
 		pc_item->status = PC_ITEM_FAILED;
 		close_and_clear(&fd);
@@ -407,6 +426,12 @@ void write_pc_item(struct parallel_checkout_item *pc_item,
 	strbuf_release(&path);
 }
 
+void write_pc_item(struct parallel_checkout_item *pc_item,
+		   struct checkout *state)
+{
+	write_pc_item_1(pc_item, state, NULL, 1);
+}
+
 static void send_one_item(int fd, struct parallel_checkout_item *pc_item)
 {
 	size_t len_data;
@@ -648,6 +673,82 @@ static void write_items_sequentially(struct checkout *state)
 	}
 }
 
+/*
+ * With checkout.workerMode=threads, the queue is written by threads of
+ * this process instead of checkout--worker processes. Each thread takes
+ * the next item off the queue, reads the blob through the object read
+ * lock and writes it, so nothing has to be serialized and sent over a
+ * pipe.
+ */
+static void *pc_write_thread(void *data)
+{
+	struct checkout *state = data;
+	struct cache_def cache = CACHE_DEF_INIT;
+
+	trace2_thread_start("pcheckout");
+
+	for (;;) {
+		struct parallel_checkout_item *pc_item;
+
+		pthread_mutex_lock(&parallel_checkout.mutex);
+		if (parallel_checkout.next_item >= parallel_checkout.nr) {
+			pthread_mutex_unlock(&parallel_checkout.mutex);
+			break;
+		}
+		pc_item = &parallel_checkout.items[parallel_checkout.next_item++];
+		pthread_mutex_unlock(&parallel_checkout.mutex);
+
+		write_pc_item_1(pc_item, state, &cache, 0);
+
+		if (pc_item->status != PC_ITEM_COLLIDED) {
+			pthread_mutex_lock(&parallel_checkout.mutex);
+			advance_progress_meter();
+			pthread_mutex_unlock(&parallel_checkout.mutex);
+		}
+	}
+
+	cache_def_clear(&cache);
+	trace2_thread_exit();
+	return NULL;
+}
+
+static void write_items_in_threads(struct checkout *state, int num_threads)
+{
+	pthread_t *threads;
+	int i;
+
+	enable_obj_read_lock();
+	pthread_mutex_init(&parallel_checkout.mutex, NULL);
+	parallel_checkout.next_item = 0;
+
+	CALLOC_ARRAY(threads, num_threads);
+	for (i = 0; i < num_threads; i++) {
+		int err = pthread_create(&threads[i], NULL, pc_write_thread,
+					 state);
+		if (err)
+			die(_("unable to create checkout thread: %s"),
+			    strerror(err));
+	}
+	for (i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	pthread_mutex_destroy(&parallel_checkout.mutex);
+	disable_obj_read_lock();
+}
+
+static int use_worker_threads(void)
+{
+	const char *mode;
+
+	if (repo_config_get_string_tmp(the_repository, "checkout.workermode", &mode) ||
+	    !strcmp(mode, "processes"))
+		return 0;
+	if (strcmp(mode, "threads"))
+		die(_("invalid value for '%s': '%s'"), "checkout.workerMode", mode);
+	return HAVE_THREADS;
+}
+
 int run_parallel_checkout(struct checkout *state, int num_workers, int threshold,
 			  struct progress *progress, unsigned int *progress_cnt)
 {
@@ -665,6 +766,8 @@ int run_parallel_checkout(struct checkout *state, int num_workers, int threshold
 
 	if (num_workers <= 1 || parallel_checkout.nr < threshold) {
 		write_items_sequentially(state);
+	} else if (use_worker_threads()) {
+		write_items_in_threads(state, num_workers);
 	} else {
 		struct pc_worker *workers = setup_workers(state, num_workers);
 		gather_results_from_workers(workers, num_workers);
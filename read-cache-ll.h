@@ -17,7 +17,7 @@ struct cache_header {
 };
 
 #define INDEX_FORMAT_LB 2
-#define INDEX_FORMAT_UB 4
+#define INDEX_FORMAT_UB 5
 
 struct cache_entry {
 	struct hashmap_entry ent;
@@ -139,6 +139,7 @@ struct split_index;
 struct untracked_cache;
 struct progress;
 struct pattern_list;
+struct index_v5_file;
 
 enum sparse_index_mode {
 	/*
@@ -188,6 +189,7 @@ struct index_state {
 	struct progress *progress;
 	struct repository *repo;
 	struct pattern_list *sparse_checkout_patterns;
+	struct index_v5_file *v5_file;
 };
 
 /**
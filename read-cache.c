@@ -1692,12 +1692,186 @@ struct ondisk_cache_entry {
 #define ondisk_data_size_max(len) (ondisk_data_size(CE_EXTENDED, len))
 #define ondisk_ce_size(ce) (ondisk_cache_entry_size(ondisk_data_size((ce)->ce_flags, ce_namelen(ce))))
 
+/*
+ * Version 5 stores every entry as an 8-byte aligned record with these
+ * little-endian fields, preceded by a table of the record offsets.
+ * The layout is that of "struct cache_entry" on the common 64-bit
+ * little-endian platforms, which lets them use the records in place
+ * instead of parsing them; everybody else decodes them one by one.
+ */
+#define V5_ENTRY_CTIME 16
+#define V5_ENTRY_MTIME 24
+#define V5_ENTRY_DEV 32
+#define V5_ENTRY_INO 36
+#define V5_ENTRY_UID 40
+#define V5_ENTRY_GID 44
+#define V5_ENTRY_SIZE 48
+#define V5_ENTRY_MODE 52
+#define V5_ENTRY_FLAGS 56
+#define V5_ENTRY_ONE 60
+#define V5_ENTRY_NAMELEN 64
+#define V5_ENTRY_OID 72
+#define V5_ENTRY_ALGO 104
+#define V5_ENTRY_NAME 108
+#define v5_entry_size(len) ((V5_ENTRY_NAME + (len) + 8) & ~7)
+#define V5_ENTRY_FLAGS_MASK (CE_STAGEMASK | CE_VALID | CE_EXTENDED | \
+			     CE_EXTENDED_FLAGS)
+
+/*
+ * On 64-bit little-endian hosts the layouts must match, so that changing
+ * "struct cache_entry" breaks the build there instead of quietly making
+ * them decode every record.
+ */
+#define V5_ENTRY_NATIVE_HOST \
+	(GIT_BYTE_ORDER == GIT_LITTLE_ENDIAN && \
+	 sizeof(void *) == 8 && sizeof(unsigned int) == 4)
+#define V5_ENTRY_NATIVE_LAYOUT \
+	(GIT_MAX_RAWSZ == 32 && \
+	 offsetof(struct cache_entry, ce_stat_data) == V5_ENTRY_CTIME && \
+	 sizeof(struct stat_data) == V5_ENTRY_MODE - V5_ENTRY_CTIME && \
+	 offsetof(struct cache_entry, ce_mode) == V5_ENTRY_MODE && \
+	 offsetof(struct cache_entry, ce_flags) == V5_ENTRY_FLAGS && \
+	 offsetof(struct cache_entry, mem_pool_allocated) == V5_ENTRY_ONE && \
+	 offsetof(struct cache_entry, ce_namelen) == V5_ENTRY_NAMELEN && \
+	 offsetof(struct cache_entry, oid) == V5_ENTRY_OID && \
+	 offsetof(struct object_id, algo) == V5_ENTRY_ALGO - V5_ENTRY_OID && \
+	 offsetof(struct cache_entry, name) == V5_ENTRY_NAME)
+#define V5_ENTRY_IS_NATIVE \
+	(V5_ENTRY_NATIVE_HOST + \
+	 BUILD_ASSERT_OR_ZERO(!V5_ENTRY_NATIVE_HOST || V5_ENTRY_NATIVE_LAYOUT))
+
+/*
+ * The entries of a version 5 index are checksummed in chunks of this
+ * many, and the checksum of the whole file covers these checksums
+ * instead of the entries, so that only changed chunks need hashing.
+ */
+#define V5_CHUNK_ENTRIES 4096
+
+struct index_v5_file {
+	const char *map;
+	size_t map_size;
+	unsigned int nr;
+	const unsigned char *table;
+	/* file offset and size of the records */
+	size_t entries, entries_len;
+	const unsigned char *chunk_hashes;
+};
+
+static inline size_t v5_entry_offset(const struct index_v5_file *v5,
+				     unsigned int i)
+{
+	return (size_t)get_le32(v5->table + 4 * i) * 8;
+}
+
+/*
+ * In-place version 5 entries are modified by the code using them, so
+ * the index is mapped writable (but private) where the mapping can be
+ * kept around.  Elsewhere the records are copied out as one block.
+ */
+#if defined(NO_MMAP) || defined(MMAP_PREVENTS_DELETE)
+#define INDEX_MMAP_PROT PROT_READ
+#define INDEX_KEEP_MMAP 0
+#else
+#define INDEX_MMAP_PROT (PROT_READ | PROT_WRITE)
+#define INDEX_KEEP_MMAP 1
+#endif
+
+/*
+ * Find the parts of a version 5 index file with `nr` entries that is
+ * mapped at `map`.  Only the offset table and the last record are
+ * looked at.
+ */
+static int locate_v5_parts(struct index_v5_file *v5, const char *map,
+			   size_t map_size, unsigned int nr)
+{
+	size_t start, end = map_size - the_hash_algo->rawsz;
+	size_t len = 0, off = 0, hashes_len;
+	unsigned int i;
+
+	v5->map = map;
+	v5->map_size = map_size;
+	v5->nr = nr;
+	v5->table = (const unsigned char *)map + sizeof(struct cache_header);
+
+	start = st_add(sizeof(struct cache_header), st_mult(nr, 4));
+	start = (start + 7) & ~(size_t)7;
+	if (start > end)
+		return -1;
+
+	for (i = 0; i < nr; i++) {
+		size_t next = v5_entry_offset(v5, i);
+
+		if ((i && next <= off) || end - start < v5_entry_size(0) ||
+		    next > end - start - v5_entry_size(0))
+			return -1;
+		off = next;
+	}
+	if (nr) {
+		len = get_le32(map + start + off + V5_ENTRY_NAMELEN);
+		if (len >= end - start - off - V5_ENTRY_NAME ||
+		    v5_entry_size(len) > end - start - off)
+			return -1;
+		len = off + v5_entry_size(len);
+	}
+
+	hashes_len = st_mult(DIV_ROUND_UP(nr, V5_CHUNK_ENTRIES),
+			     the_hash_algo->rawsz);
+	if (hashes_len > end - start - len)
+		return -1;
+
+	v5->entries = start;
+	v5->entries_len = len;
+	v5->chunk_hashes = (const unsigned char *)map + start + len;
+	return 0;
+}
+
 /* Allow fsck to force verification of the index checksum. */
 int verify_index_checksum;
 
 /* Allow fsck to force verification of the cache entry order. */
 int verify_ce_order;
 
+/*
+ * The trailing checksum of a version 5 index covers the chunk checksums
+ * in place of the records they stand for.
+ */
+static int verify_v5_hashes(const struct cache_header *hdr, size_t size)
+{
+	const unsigned char *map = (const unsigned char *)hdr;
+	const size_t rawsz = the_hash_algo->rawsz;
+	struct index_v5_file v5;
+	struct git_hash_ctx c;
+	unsigned char hash[GIT_MAX_RAWSZ];
+	unsigned int i, nr_chunks;
+	size_t end;
+
+	if (locate_v5_parts(&v5, (const char *)hdr, size, ntohl(hdr->hdr_entries)) < 0)
+		return error(_("index file corrupt"));
+
+	nr_chunks = DIV_ROUND_UP(v5.nr, V5_CHUNK_ENTRIES);
+	for (i = 0; i < nr_chunks; i++) {
+		size_t from = v5_entry_offset(&v5, i * V5_CHUNK_ENTRIES);
+		size_t to = (i + 1) * V5_CHUNK_ENTRIES < v5.nr ?
+			v5_entry_offset(&v5, (i + 1) * V5_CHUNK_ENTRIES) :
+			v5.entries_len;
+
+		the_hash_algo->init_fn(&c);
+		git_hash_update(&c, map + v5.entries + from, to - from);
+		git_hash_final(hash, &c);
+		if (!hasheq(hash, v5.chunk_hashes + i * rawsz, the_hash_algo))
+			return error(_("bad index file sha1 signature"));
+	}
+
+	end = v5.entries + v5.entries_len;
+	the_hash_algo->init_fn(&c);
+	git_hash_update(&c, map, v5.entries);
+	git_hash_update(&c, map + end, size - rawsz - end);
+	git_hash_final(hash, &c);
+	if (!hasheq(hash, map + size - rawsz, the_hash_algo))
+		return error(_("bad index file sha1 signature"));
+	return 0;
+}
+
 static int verify_hdr(const struct cache_header *hdr, unsigned long size)
 {
 	struct git_hash_ctx c;
@@ -1721,6 +1895,9 @@ static int verify_hdr(const struct cache_header *hdr, unsigned long size)
 	if (oideq(&oid, null_oid(the_hash_algo)))
 		return 0;
 
+	if (hdr_version == 5)
+		return verify_v5_hashes(hdr, size);
+
 	the_hash_algo->init_fn(&c);
 	git_hash_update(&c, hdr, size - the_hash_algo->rawsz);
 	git_hash_final(hash, &c);
@@ -2068,6 +2245,152 @@ static unsigned long load_all_cache_entries(struct index_state *istate,
 	return consumed;
 }
 
+static struct cache_entry *create_from_disk_v5(struct mem_pool *ce_mem_pool,
+					       const unsigned char *ondisk)
+{
+	struct cache_entry *ce;
+	size_t len = get_le32(ondisk + V5_ENTRY_NAMELEN);
+
+	ce = mem_pool__ce_alloc(ce_mem_pool, len);
+	ce->ce_stat_data.sd_ctime.sec = get_le32(ondisk + V5_ENTRY_CTIME);
+	ce->ce_stat_data.sd_ctime.nsec = get_le32(ondisk + V5_ENTRY_CTIME + 4);
+	ce->ce_stat_data.sd_mtime.sec = get_le32(ondisk + V5_ENTRY_MTIME);
+	ce->ce_stat_data.sd_mtime.nsec = get_le32(ondisk + V5_ENTRY_MTIME + 4);
+	ce->ce_stat_data.sd_dev = get_le32(ondisk + V5_ENTRY_DEV);
+	ce->ce_stat_data.sd_ino = get_le32(ondisk + V5_ENTRY_INO);
+	ce->ce_stat_data.sd_uid = get_le32(ondisk + V5_ENTRY_UID);
+	ce->ce_stat_data.sd_gid = get_le32(ondisk + V5_ENTRY_GID);
+	ce->ce_stat_data.sd_size = get_le32(ondisk + V5_ENTRY_SIZE);
+	ce->ce_mode = get_le32(ondisk + V5_ENTRY_MODE);
+	ce->ce_flags = get_le32(ondisk + V5_ENTRY_FLAGS) & V5_ENTRY_FLAGS_MASK;
+	ce->ce_namelen = len;
+	ce->index = 0;
+	oidread(&ce->oid, ondisk + V5_ENTRY_OID, the_repository->hash_algo);
+	memcpy(ce->name, ondisk + V5_ENTRY_NAME, len);
+	ce->name[len] = '\0';
+	return ce;
+}
+
+/*
+ * Return the record of entry `i` of a version 5 index, after checking
+ * that its name fits in front of the next record and is terminated.
+ */
+static const char *v5_entry(const struct index_v5_file *v5,
+			    const char *entries, unsigned int i)
+{
+	size_t off = v5_entry_offset(v5, i);
+	size_t end = i + 1 < v5->nr ? v5_entry_offset(v5, i + 1) :
+		v5->entries_len;
+	const char *ondisk = entries + off;
+	size_t len = get_le32(ondisk + V5_ENTRY_NAMELEN);
+
+	if (end - off <= V5_ENTRY_NAME ||
+	    len >= end - off - V5_ENTRY_NAME ||
+	    ondisk[V5_ENTRY_NAME + len])
+		die(_("index file corrupt"));
+	return ondisk;
+}
+
+/*
+ * The fields of an in-place record that are not stored on disk (or
+ * that the decoding path ignores) must not be trusted.  They are only
+ * written to when they differ, to leave the pages of a mapping shared.
+ */
+static struct cache_entry *use_v5_entry(const char *ondisk)
+{
+	struct cache_entry *ce = (struct cache_entry *)ondisk;
+	int algo = hash_algo_by_ptr(the_repository->hash_algo);
+
+	if (ce->ce_flags & ~V5_ENTRY_FLAGS_MASK)
+		ce->ce_flags &= V5_ENTRY_FLAGS_MASK;
+	if (ce->mem_pool_allocated != 1)
+		ce->mem_pool_allocated = 1;
+	if (ce->index)
+		ce->index = 0;
+	if (ce->oid.algo != algo)
+		ce->oid.algo = algo;
+	if (ce->ent.next || ce->ent.hash)
+		hashmap_entry_init(&ce->ent, 0);
+	return ce;
+}
+
+/*
+ * Set up the entries of a version 5 index.  Where the records have the
+ * in-core layout they are used as they are: either right inside the
+ * mapping, in which case `keep_mmap` is set and the caller must hand
+ * the mapping over to the memory pool, or copied into the pool in one
+ * go.  Either way, every record is checked, but only those whose
+ * in-memory fields were not clean on disk are written to.
+ */
+static unsigned long load_cache_entries_v5(struct index_state *istate,
+					   const struct index_v5_file *v5,
+					   int *keep_mmap)
+{
+	const char *entries = v5->map + v5->entries;
+	unsigned int i;
+
+	istate->ce_mem_pool = xmalloc(sizeof(*istate->ce_mem_pool));
+
+	if (!V5_ENTRY_IS_NATIVE) {
+		mem_pool_init(istate->ce_mem_pool, v5->entries_len);
+		for (i = 0; i < istate->cache_nr; i++)
+			set_index_entry(istate, i,
+					create_from_disk_v5(istate->ce_mem_pool,
+							    (const unsigned char *)
+							    v5_entry(v5, entries, i)));
+	} else {
+		mem_pool_init(istate->ce_mem_pool, 0);
+		if (INDEX_KEEP_MMAP)
+			*keep_mmap = 1;
+		else
+			entries = memcpy(mem_pool_alloc(istate->ce_mem_pool,
+							v5->entries_len),
+					 entries, v5->entries_len);
+
+		for (i = 0; i < istate->cache_nr; i++)
+			set_index_entry(istate, i,
+					use_v5_entry(v5_entry(v5, entries, i)));
+	}
+
+	return (const char *)v5->chunk_hashes - v5->map +
+		st_mult(DIV_ROUND_UP(v5->nr, V5_CHUNK_ENTRIES),
+			the_hash_algo->rawsz) - sizeof(struct cache_header);
+}
+
+/*
+ * Keep a read-only mapping of the version 5 index file that `istate`
+ * was read from, so that do_write_index() can tell which chunks of
+ * entries are unchanged.  The entries themselves may live in a
+ * private mapping of the same file, but that one is written to.
+ */
+static void keep_v5_file(struct index_state *istate,
+			 const struct index_v5_file *v5, int fd)
+{
+	const char *map;
+
+	if (!INDEX_KEEP_MMAP)
+		return;
+	map = xmmap_gently(NULL, v5->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		return;
+
+	CALLOC_ARRAY(istate->v5_file, 1);
+	*istate->v5_file = *v5;
+	istate->v5_file->map = map;
+	istate->v5_file->table = (const unsigned char *)map +
+		(v5->table - (const unsigned char *)v5->map);
+	istate->v5_file->chunk_hashes = (const unsigned char *)map +
+		(v5->chunk_hashes - (const unsigned char *)v5->map);
+}
+
+static void release_v5_file(struct index_state *istate)
+{
+	if (!istate->v5_file)
+		return;
+	munmap((void *)istate->v5_file->map, istate->v5_file->map_size);
+	FREE_AND_NULL(istate->v5_file);
+}
+
 /*
  * Mostly randomly chosen maximum thread counts: we
  * cap the parallelism to online_cpus() threads, and we want
@@ -2207,6 +2530,8 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 	size_t extension_offset = 0;
 	int nr_threads, cpus;
 	struct index_entry_offset_table *ieot = NULL;
+	int keep_mmap = 0;
+	struct index_v5_file v5;
 
 	if (istate->initialized)
 		return istate->cache_nr;
@@ -2230,15 +2555,21 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 	if (mmap_size < sizeof(struct cache_header) + the_hash_algo->rawsz)
 		die(_("%s: index file smaller than expected"), path);
 
-	mmap = xmmap_gently(NULL, mmap_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	mmap = xmmap_gently(NULL, mmap_size, INDEX_MMAP_PROT, MAP_PRIVATE, fd, 0);
 	if (mmap == MAP_FAILED)
 		die_errno(_("%s: unable to map index file%s"), path,
 			mmap_os_err());
-	close(fd);
 
 	hdr = (const struct cache_header *)mmap;
 	if (verify_hdr(hdr, mmap_size) < 0)
 		goto unmap;
+	if (ntohl(hdr->hdr_version) == 5) {
+		if (locate_v5_parts(&v5, mmap, mmap_size,
+				    ntohl(hdr->hdr_entries)) < 0)
+			goto unmap;
+		keep_v5_file(istate, &v5, fd);
+	}
+	close(fd);
 
 	oidread(&istate->oid, (const unsigned char *)hdr + mmap_size - the_hash_algo->rawsz,
 		the_repository->hash_algo);
@@ -2265,7 +2596,11 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 			nr_threads = cpus;
 	}
 
-	if (!HAVE_THREADS)
+	/*
+	 * Version 5 entries need no parsing, so there is nothing to
+	 * overlap loading the extensions with.
+	 */
+	if (!HAVE_THREADS || istate->version == 5)
 		nr_threads = 1;
 
 	if (nr_threads > 1) {
@@ -2289,7 +2624,9 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 	if (extension_offset && nr_threads > 1)
 		ieot = read_ieot_extension(mmap, mmap_size, extension_offset);
 
-	if (ieot) {
+	if (istate->version == 5) {
+		src_offset += load_cache_entries_v5(istate, &v5, &keep_mmap);
+	} else if (ieot) {
 		src_offset += load_cache_entries_threaded(istate, mmap, mmap_size, nr_threads, ieot);
 		free(ieot);
 	} else {
@@ -2308,7 +2645,10 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 		p.src_offset = src_offset;
 		load_index_extensions(&p);
 	}
-	munmap((void *)mmap, mmap_size);
+	if (keep_mmap)
+		mem_pool_adopt_mapping(istate->ce_mem_pool, (void *)mmap, mmap_size);
+	else
+		munmap((void *)mmap, mmap_size);
 
 	trace2_data_intmax("index", istate->repo, "read/version",
 			   istate->version);
@@ -2451,6 +2791,8 @@ void release_index(struct index_state *istate)
 		mem_pool_discard(istate->ce_mem_pool, should_validate_cache_entries());
 		FREE_AND_NULL(istate->ce_mem_pool);
 	}
+
+	release_v5_file(istate);
 }
 
 void discard_index(struct index_state *istate)
@@ -2688,6 +3030,121 @@ static int ce_write_entry(struct hashfile *f, struct cache_entry *ce,
 	return 0;
 }
 
+static void ce_write_entry_v5(struct strbuf *out, struct cache_entry *ce)
+{
+	static unsigned char padding[8] = { 0x00 };
+	unsigned char ondisk[V5_ENTRY_NAME] = { 0 };
+	unsigned int len = ce->ce_flags & CE_STRIP_NAME ? 0 : ce_namelen(ce);
+
+	put_le32(ondisk + V5_ENTRY_CTIME, ce->ce_stat_data.sd_ctime.sec);
+	put_le32(ondisk + V5_ENTRY_CTIME + 4, ce->ce_stat_data.sd_ctime.nsec);
+	put_le32(ondisk + V5_ENTRY_MTIME, ce->ce_stat_data.sd_mtime.sec);
+	put_le32(ondisk + V5_ENTRY_MTIME + 4, ce->ce_stat_data.sd_mtime.nsec);
+	put_le32(ondisk + V5_ENTRY_DEV, ce->ce_stat_data.sd_dev);
+	put_le32(ondisk + V5_ENTRY_INO, ce->ce_stat_data.sd_ino);
+	put_le32(ondisk + V5_ENTRY_UID, ce->ce_stat_data.sd_uid);
+	put_le32(ondisk + V5_ENTRY_GID, ce->ce_stat_data.sd_gid);
+	put_le32(ondisk + V5_ENTRY_SIZE, ce->ce_stat_data.sd_size);
+	put_le32(ondisk + V5_ENTRY_MODE, ce->ce_mode);
+	put_le32(ondisk + V5_ENTRY_FLAGS, ce->ce_flags & V5_ENTRY_FLAGS_MASK);
+	put_le32(ondisk + V5_ENTRY_ONE, 1);
+	put_le32(ondisk + V5_ENTRY_NAMELEN, len);
+	hashcpy(ondisk + V5_ENTRY_OID, ce->oid.hash, the_repository->hash_algo);
+	put_le32(ondisk + V5_ENTRY_ALGO,
+		 hash_algo_by_ptr(the_repository->hash_algo));
+
+	strbuf_add(out, ondisk, sizeof(ondisk));
+	strbuf_add(out, ce->name, len);
+	strbuf_add(out, padding, v5_entry_size(len) - V5_ENTRY_NAME - len);
+	ce->ce_flags &= ~CE_STRIP_NAME;
+}
+
+/*
+ * If the index file we were read from has the very same bytes for the
+ * `k`-th chunk of records, copy its checksum to `hash` and return 1.
+ */
+static int find_v5_chunk_hash(const struct index_v5_file *old, unsigned int k,
+			      const struct strbuf *chunk, unsigned char *hash,
+			      const struct git_hash_algo *algop)
+{
+	const unsigned char *old_hash;
+	size_t from, to;
+
+	if (!old || k >= DIV_ROUND_UP(old->nr, V5_CHUNK_ENTRIES))
+		return 0;
+	old_hash = old->chunk_hashes + k * algop->rawsz;
+	if (hasheq(old_hash, null_oid(algop)->hash, algop))
+		return 0;
+
+	from = v5_entry_offset(old, k * V5_CHUNK_ENTRIES);
+	to = (k + 1) * V5_CHUNK_ENTRIES < old->nr ?
+		v5_entry_offset(old, (k + 1) * V5_CHUNK_ENTRIES) :
+		old->entries_len;
+	if (to - from != chunk->len ||
+	    memcmp(old->map + old->entries + from, chunk->buf, chunk->len))
+		return 0;
+
+	hashcpy(hash, old_hash, algop);
+	return 1;
+}
+
+/*
+ * Write the `k`-th chunk of version 5 records and queue its checksum
+ * in `hashes`.  Chunks that are unchanged since the index was read
+ * keep their checksum, which is what keeps writing a large index that
+ * only had a few entries changed cheap.
+ */
+static void write_v5_chunk(struct hashfile *f, struct index_state *istate,
+			   unsigned int k, struct strbuf *chunk,
+			   struct strbuf *hashes, unsigned int *reused)
+{
+	unsigned char hash[GIT_MAX_RAWSZ];
+
+	if (f->skip_hash) {
+		hashclr(hash, f->algop);
+	} else if (find_v5_chunk_hash(istate->v5_file, k, chunk, hash, f->algop)) {
+		(*reused)++;
+	} else {
+		struct git_hash_ctx c;
+
+		f->algop->init_fn(&c);
+		git_hash_update(&c, chunk->buf, chunk->len);
+		git_hash_final(hash, &c);
+	}
+
+	strbuf_add(hashes, hash, f->algop->rawsz);
+	hashwrite_unhashed(f, chunk->buf, chunk->len);
+	strbuf_reset(chunk);
+}
+
+/*
+ * Write the table of version 5 record offsets, in units of 8 bytes
+ * from the first record, and pad it so that the records that follow
+ * are 8-byte aligned.
+ */
+static int write_v5_offset_table(struct hashfile *f, struct index_state *istate)
+{
+	static unsigned char padding[8] = { 0x00 };
+	uint64_t off = 0;
+	int i;
+
+	for (i = 0; i < istate->cache_nr; i++) {
+		struct cache_entry *ce = istate->cache[i];
+		unsigned char buf[4];
+
+		if (ce->ce_flags & CE_REMOVE)
+			continue;
+		if (off / 8 > UINT32_MAX)
+			return error(_("index too large for version 5"));
+		put_le32(buf, off / 8);
+		hashwrite(f, buf, sizeof(buf));
+		off += v5_entry_size(ce->ce_flags & CE_STRIP_NAME ?
+				     0 : ce_namelen(ce));
+	}
+	hashwrite(f, padding, (8 - hashfile_total(f) % 8) % 8);
+	return 0;
+}
+
 /*
  * This function verifies if index_state has the correct sha1 of the
  * index file.  Don't die if we have any other failure, just return 0.
@@ -2823,6 +3280,8 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	struct index_entry_offset_table *ieot = NULL;
 	struct repository *r = istate->repo;
 	struct strbuf sb = STRBUF_INIT;
+	struct strbuf chunk = STRBUF_INIT, chunk_hashes = STRBUF_INIT;
+	unsigned int chunk_nr = 0, nr_chunks = 0, chunks_reused = 0;
 	int nr, nr_threads, ret;
 
 	f = hashfd(the_repository->hash_algo, tempfile->fd, tempfile->filename.buf);
@@ -2860,7 +3319,7 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	if (!HAVE_THREADS || repo_config_get_index_threads(the_repository, &nr_threads))
 		nr_threads = 1;
 
-	if (nr_threads != 1 && record_ieot()) {
+	if (nr_threads != 1 && hdr_version != 5 && record_ieot()) {
 		int ieot_blocks, cpus;
 
 		/*
@@ -2890,6 +3349,11 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 		}
 	}
 
+	if (hdr_version == 5 && write_v5_offset_table(f, istate) < 0) {
+		ret = -1;
+		goto out;
+	}
+
 	offset = hashfile_total(f);
 
 	nr = 0;
@@ -2929,7 +3393,14 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 
 			offset = hashfile_total(f);
 		}
-		if (ce_write_entry(f, ce, previous_name, (struct ondisk_cache_entry *)&ondisk) < 0)
+		if (hdr_version == 5) {
+			ce_write_entry_v5(&chunk, ce);
+			if (++chunk_nr == V5_CHUNK_ENTRIES) {
+				write_v5_chunk(f, istate, nr_chunks++, &chunk,
+					       &chunk_hashes, &chunks_reused);
+				chunk_nr = 0;
+			}
+		} else if (ce_write_entry(f, ce, previous_name, (struct ondisk_cache_entry *)&ondisk) < 0)
 			err = -1;
 
 		if (err)
@@ -2948,6 +3419,17 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 		goto out;
 	}
 
+	if (hdr_version == 5) {
+		if (chunk_nr)
+			write_v5_chunk(f, istate, nr_chunks++, &chunk,
+				       &chunk_hashes, &chunks_reused);
+		hashwrite(f, chunk_hashes.buf, chunk_hashes.len);
+		trace2_data_intmax("index", istate->repo, "write/chunks",
+				   nr_chunks);
+		trace2_data_intmax("index", istate->repo, "write/chunks_reused",
+				   chunks_reused);
+	}
+
 	offset = hashfile_total(f);
 
 	/*
@@ -3100,6 +3582,8 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	if (f)
 		free_hashfile(f);
 	strbuf_release(&sb);
+	strbuf_release(&chunk);
+	strbuf_release(&chunk_hashes);
 	free(eoie_c);
 	free(ieot);
 	return ret;
@@ -3500,6 +3984,9 @@ void move_index_extensions(struct index_state *dst, struct index_state *src)
 	src->untracked = NULL;
 	dst->cache_tree = src->cache_tree;
 	src->cache_tree = NULL;
+	release_v5_file(dst);
+	dst->v5_file = src->v5_file;
+	src->v5_file = NULL;
 }
 
 struct cache_entry *dup_cache_entry(const struct cache_entry *ce,
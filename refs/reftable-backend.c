@@ -22,6 +22,7 @@
 #include "../reftable/reftable-record.h"
 #include "../reftable/reftable-stack.h"
 #include "../repo-settings.h"
+#include "../run-command.h"
 #include "../setup.h"
 #include "../strmap.h"
 #include "../trace2.h"
@@ -46,6 +47,12 @@ static void reftable_backend_on_reload(void *payload)
 	reftable_iterator_destroy(&be->it);
 }
 
+static void reftable_backend_on_log_block_cache(void *payload UNUSED, int hit)
+{
+	trace2_counter_add(hit ? TRACE2_COUNTER_ID_REFTABLE_LOG_BLOCK_CACHE_HIT :
+			   TRACE2_COUNTER_ID_REFTABLE_LOG_BLOCK_CACHE_MISS, 1);
+}
+
 static int reftable_backend_init(struct reftable_backend *be,
 				 const char *path,
 				 const struct reftable_write_options *_opts)
@@ -53,6 +60,7 @@ static int reftable_backend_init(struct reftable_backend *be,
 	struct reftable_write_options opts = *_opts;
 	opts.on_reload = reftable_backend_on_reload;
 	opts.on_reload_payload = be;
+	opts.on_log_block_cache = reftable_backend_on_log_block_cache;
 	return reftable_new_stack(&be->stack, path, &opts);
 }
 
@@ -144,6 +152,8 @@ struct reftable_ref_store {
 
 	unsigned int store_flags;
 	enum log_refs_config log_all_ref_updates;
+	/* Whether we have already spawned a background compaction. */
+	bool compaction_spawned;
 	int err;
 };
 
@@ -330,6 +340,48 @@ static void fill_reftable_log_record(struct reftable_log_record *log, const stru
 	log->value.update.tz_offset = sign * atoi(tz_begin);
 }
 
+/*
+ * Compact the stack in a separate process so that the writer that has
+ * noticed the need for compaction does not have to wait for it. The child
+ * goes through the same locking as inline auto-compaction, so concurrent
+ * writers and compactions are safe.
+ */
+static void reftable_be_on_compaction_required(void *payload)
+{
+	struct reftable_ref_store *refs = payload;
+	struct child_process cmd = CHILD_PROCESS_INIT;
+	int detach;
+
+	if (refs->compaction_spawned)
+		return;
+	refs->compaction_spawned = true;
+
+	/* Honor the same knobs as auto-maintenance to ease testing. */
+	if (repo_config_get_bool(refs->base.repo, "maintenance.autodetach", &detach) &&
+	    repo_config_get_bool(refs->base.repo, "gc.autodetach", &detach))
+		detach = git_env_bool("GIT_TEST_MAINT_AUTO_DETACH", true);
+
+	cmd.git_cmd = 1;
+	cmd.no_stdin = 1;
+	strvec_pushf(&cmd.args, "--git-dir=%s", refs->base.gitdir);
+	strvec_pushl(&cmd.args, "refs", "optimize", "--auto", NULL);
+
+	if (!detach) {
+		run_command(&cmd);
+		return;
+	}
+
+	/*
+	 * Do not wait for the child, and do not let it hold on to our output
+	 * either, as that may be the connection to a client that waits for
+	 * us to finish.
+	 */
+	cmd.no_stdout = 1;
+	cmd.no_stderr = 1;
+	if (!start_command(&cmd))
+		child_process_clear(&cmd);
+}
+
 static int reftable_be_config(const char *var, const char *value,
 			      const struct config_context *ctx,
 			      void *_opts)
@@ -360,6 +412,24 @@ static int reftable_be_config(const char *var, const char *value,
 		if (lock_timeout < 0 && lock_timeout != -1)
 			die("reftable lock timeout does not support negative values other than -1");
 		opts->lock_timeout_ms = lock_timeout;
+	} else if (!strcmp(var, "reftable.autocompaction")) {
+		if (!value)
+			return config_error_nonbool(var);
+		if (!strcmp(value, "background")) {
+			opts->disable_auto_compact = 1;
+			if (git_env_bool("GIT_TEST_REFTABLE_AUTOCOMPACTION", 1))
+				opts->on_compaction_required =
+					reftable_be_on_compaction_required;
+		} else if (!strcmp(value, "inline")) {
+			opts->disable_auto_compact =
+				!git_env_bool("GIT_TEST_REFTABLE_AUTOCOMPACTION", 1);
+			opts->on_compaction_required = NULL;
+		} else {
+			die(_("invalid value for '%s': '%s'"),
+			    "reftable.autoCompaction", value);
+		}
+	} else if (!strcmp(var, "reftable.logblockcachesize")) {
+		opts->log_block_cache_size = git_config_ulong(var, value, ctx->kvi);
 	}
 
 	return 0;
@@ -402,6 +472,9 @@ static struct ref_store *reftable_be_init(struct repository *repo,
 	refs->write_options.disable_auto_compact =
 		!git_env_bool("GIT_TEST_REFTABLE_AUTOCOMPACTION", 1);
 	refs->write_options.lock_timeout_ms = 100;
+	refs->write_options.log_block_cache_size = 1024 * 1024;
+
+	refs->write_options.on_compaction_required_payload = refs;
 
 	repo_config(repo, reftable_be_config, &refs->write_options);
 
@@ -716,7 +789,15 @@ static int reftable_ref_iterator_seek(struct ref_iterator *ref_iterator,
 		iter->prefix = xstrdup_or_null(refname);
 		iter->prefix_len = refname ? strlen(refname) : 0;
 	}
-	iter->err = reftable_iterator_seek_ref(&iter->iter, refname);
+
+	/*
+	 * When iterating over a prefix we stop at the first ref outside of
+	 * it, which allows the library to skip tables without matching refs.
+	 */
+	if (iter->prefix_len)
+		iter->err = reftable_iterator_seek_ref_prefix(&iter->iter, refname);
+	else
+		iter->err = reftable_iterator_seek_ref(&iter->iter, refname);
 
 	return iter->err;
 }
@@ -224,6 +224,74 @@ static int read_block(struct reftable_block_source *source,
 	return block_source_read_data(source, dest, off, sz);
 }
 
+struct reftable_block_cache_entry {
+	char *table_name;
+	uint64_t offset;
+	uint8_t *data;
+	uint32_t len;
+	uint32_t full_block_size;
+	size_t refcount;
+
+	/* LRU list, most recently used first. */
+	struct reftable_block_cache_entry *prev, *next;
+
+	/* Chain of entries in the same hash bucket. */
+	struct reftable_block_cache_entry *bucket_next;
+	uint32_t hash;
+};
+
+struct reftable_block_cache {
+	struct reftable_block_cache_entry *head, *tail;
+	size_t size, max_size;
+	size_t refcount;
+
+	/* Entries hashed by table name and offset. */
+	struct reftable_block_cache_entry **buckets;
+	size_t buckets_nr, nr;
+
+	void (*on_lookup)(void *payload, int hit);
+	void *on_lookup_payload;
+};
+
+static void block_cache_entry_decref(struct reftable_block_cache_entry *e)
+{
+	if (--e->refcount)
+		return;
+	reftable_free(e->table_name);
+	reftable_free(e->data);
+	reftable_free(e);
+}
+
+static void block_release_cache_entry(struct reftable_block *block)
+{
+	struct reftable_block_cache_entry *e = block->cache_entry;
+
+	if (!e)
+		return;
+
+	/* `block_data` points into the entry and has no source to release. */
+	block->cache_entry = NULL;
+	block->block_data.data = NULL;
+	block->block_data.len = 0;
+	block_cache_entry_decref(e);
+}
+
+static void block_init_layout(struct reftable_block *block, uint8_t block_type,
+			      uint32_t block_size, uint32_t full_block_size,
+			      uint32_t header_size, uint32_t hash_size)
+{
+	uint16_t restart_count;
+
+	restart_count = reftable_get_be16(block->block_data.data + block_size - 2);
+
+	block->block_type = block_type;
+	block->hash_size = hash_size;
+	block->restart_off = block_size - 2 - 3 * restart_count;
+	block->full_block_size = full_block_size;
+	block->header_off = header_size;
+	block->restart_count = restart_count;
+}
+
 int reftable_block_init(struct reftable_block *block,
 			struct reftable_block_source *source,
 			uint32_t offset, uint32_t header_size,
@@ -233,12 +301,12 @@ int reftable_block_init(struct reftable_block *block,
 	uint32_t guess_block_size = table_block_size ?
 		table_block_size : DEFAULT_BLOCK_SIZE;
 	uint32_t full_block_size = table_block_size;
-	uint16_t restart_count;
-	uint32_t restart_off;
 	uint32_t block_size;
 	uint8_t block_type;
 	int err;
 
+	block_release_cache_entry(block);
+
 	err = read_block(source, &block->block_data, offset, guess_block_size);
 	if (err < 0)
 		goto done;
@@ -331,16 +399,8 @@ int reftable_block_init(struct reftable_block *block,
 		full_block_size = block_size;
 	}
 
-	restart_count = reftable_get_be16(block->block_data.data + block_size - 2);
-	restart_off = block_size - 2 - 3 * restart_count;
-
-	block->block_type = block_type;
-	block->hash_size = hash_size;
-	block->restart_off = restart_off;
-	block->full_block_size = full_block_size;
-	block->header_off = header_size;
-	block->restart_count = restart_count;
-
+	block_init_layout(block, block_type, block_size, full_block_size,
+			  header_size, hash_size);
 	err = 0;
 
 done:
@@ -349,8 +409,238 @@ int reftable_block_init(struct reftable_block *block,
 	return err;
 }
 
+static void block_cache_unlink(struct reftable_block_cache *cache,
+			       struct reftable_block_cache_entry *e)
+{
+	if (e->prev)
+		e->prev->next = e->next;
+	else
+		cache->head = e->next;
+	if (e->next)
+		e->next->prev = e->prev;
+	else
+		cache->tail = e->prev;
+	e->prev = e->next = NULL;
+}
+
+static void block_cache_push_front(struct reftable_block_cache *cache,
+				   struct reftable_block_cache_entry *e)
+{
+	e->next = cache->head;
+	if (cache->head)
+		cache->head->prev = e;
+	else
+		cache->tail = e;
+	cache->head = e;
+}
+
+static uint32_t block_cache_hash(const char *table_name, uint64_t offset)
+{
+	uint32_t hash = 2166136261u; /* FNV-1a */
+	int i;
+
+	for (; *table_name; table_name++)
+		hash = (hash ^ (unsigned char)*table_name) * 16777619u;
+	for (i = 0; i < 8; i++)
+		hash = (hash ^ ((offset >> (8 * i)) & 0xff)) * 16777619u;
+	return hash;
+}
+
+static void block_cache_rehash(struct reftable_block_cache *cache)
+{
+	struct reftable_block_cache_entry **buckets, *e;
+	size_t buckets_nr = cache->buckets_nr ? 2 * cache->buckets_nr : 64;
+
+	/* Longer chains only make lookups slower, so do not fail here. */
+	REFTABLE_CALLOC_ARRAY(buckets, buckets_nr);
+	if (!buckets)
+		return;
+	for (e = cache->head; e; e = e->next) {
+		size_t idx = e->hash & (buckets_nr - 1);
+		e->bucket_next = buckets[idx];
+		buckets[idx] = e;
+	}
+	reftable_free(cache->buckets);
+	cache->buckets = buckets;
+	cache->buckets_nr = buckets_nr;
+}
+
+static void block_cache_evict(struct reftable_block_cache *cache,
+			      struct reftable_block_cache_entry *e)
+{
+	struct reftable_block_cache_entry **p;
+
+	for (p = &cache->buckets[e->hash & (cache->buckets_nr - 1)];
+	     *p != e; p = &(*p)->bucket_next)
+		; /* nothing */
+	*p = e->bucket_next;
+	cache->nr--;
+
+	block_cache_unlink(cache, e);
+	cache->size -= e->len;
+	block_cache_entry_decref(e);
+}
+
+int block_cache_new(struct reftable_block_cache **out, size_t max_size,
+		    void (*on_lookup)(void *payload, int hit), void *payload)
+{
+	struct reftable_block_cache *cache;
+
+	REFTABLE_CALLOC_ARRAY(cache, 1);
+	if (!cache)
+		return REFTABLE_OUT_OF_MEMORY_ERROR;
+	cache->max_size = max_size;
+	cache->refcount = 1;
+	cache->on_lookup = on_lookup;
+	cache->on_lookup_payload = payload;
+
+	*out = cache;
+	return 0;
+}
+
+void block_cache_incref(struct reftable_block_cache *cache)
+{
+	cache->refcount++;
+}
+
+void block_cache_decref(struct reftable_block_cache *cache)
+{
+	if (!cache || --cache->refcount)
+		return;
+	while (cache->head)
+		block_cache_evict(cache, cache->head);
+	reftable_free(cache->buckets);
+	reftable_free(cache);
+}
+
+void block_cache_drop_table(struct reftable_block_cache *cache,
+			    const char *table_name)
+{
+	struct reftable_block_cache_entry *e, *next;
+
+	if (!cache)
+		return;
+	for (e = cache->head; e; e = next) {
+		next = e->next;
+		if (!strcmp(e->table_name, table_name))
+			block_cache_evict(cache, e);
+	}
+}
+
+static struct reftable_block_cache_entry *
+block_cache_lookup(struct reftable_block_cache *cache, const char *table_name,
+		   uint64_t offset)
+{
+	uint32_t hash;
+	struct reftable_block_cache_entry *e;
+
+	if (!cache->nr)
+		return NULL;
+	hash = block_cache_hash(table_name, offset);
+	for (e = cache->buckets[hash & (cache->buckets_nr - 1)]; e;
+	     e = e->bucket_next) {
+		if (e->hash != hash || e->offset != offset ||
+		    strcmp(e->table_name, table_name))
+			continue;
+		block_cache_unlink(cache, e);
+		block_cache_push_front(cache, e);
+		return e;
+	}
+	return NULL;
+}
+
+/*
+ * Add a copy of the decompressed block to the cache. The cache is only an
+ * optimization, so failing to allocate the entry is not an error.
+ */
+static void block_cache_add(struct reftable_block_cache *cache,
+			    const char *table_name, uint64_t offset,
+			    const struct reftable_block *block)
+{
+	struct reftable_block_cache_entry *e;
+
+	if (block->block_data.len > cache->max_size)
+		return;
+	if (cache->nr >= cache->buckets_nr)
+		block_cache_rehash(cache);
+	if (!cache->buckets)
+		return;
+
+	REFTABLE_CALLOC_ARRAY(e, 1);
+	if (!e)
+		return;
+	e->table_name = reftable_strdup(table_name);
+	REFTABLE_ALLOC_ARRAY(e->data, block->block_data.len);
+	if (!e->table_name || !e->data) {
+		reftable_free(e->table_name);
+		reftable_free(e->data);
+		reftable_free(e);
+		return;
+	}
+	memcpy(e->data, block->block_data.data, block->block_data.len);
+	e->len = block->block_data.len;
+	e->offset = offset;
+	e->full_block_size = block->full_block_size;
+	e->refcount = 1;
+	e->hash = block_cache_hash(table_name, offset);
+	e->bucket_next = cache->buckets[e->hash & (cache->buckets_nr - 1)];
+	cache->buckets[e->hash & (cache->buckets_nr - 1)] = e;
+	cache->nr++;
+
+	block_cache_push_front(cache, e);
+	cache->size += e->len;
+	while (cache->size > cache->max_size)
+		block_cache_evict(cache, cache->tail);
+}
+
+int block_init_cached(struct reftable_block *block,
+		      struct reftable_block_cache *cache, const char *table_name,
+		      struct reftable_block_source *source,
+		      uint32_t offset, uint32_t header_size,
+		      uint32_t table_block_size, uint32_t hash_size,
+		      uint8_t want_type)
+{
+	struct reftable_block_cache_entry *e = NULL;
+	uint8_t block_type;
+	int err;
+
+	/* Only log blocks are ever cached. */
+	if (want_type == REFTABLE_BLOCK_TYPE_LOG ||
+	    want_type == REFTABLE_BLOCK_TYPE_ANY)
+		e = block_cache_lookup(cache, table_name, offset);
+	if (!e) {
+		err = reftable_block_init(block, source, offset, header_size,
+					  table_block_size, hash_size, want_type);
+		if (err || block->block_type != REFTABLE_BLOCK_TYPE_LOG)
+			return err;
+
+		if (cache->on_lookup)
+			cache->on_lookup(cache->on_lookup_payload, 0);
+		block_cache_add(cache, table_name, offset, block);
+		return 0;
+	}
+
+	block_type = e->data[header_size];
+	if (want_type != REFTABLE_BLOCK_TYPE_ANY && block_type != want_type)
+		return 1;
+	if (cache->on_lookup)
+		cache->on_lookup(cache->on_lookup_payload, 1);
+
+	block_release_cache_entry(block);
+	block_source_release_data(&block->block_data);
+	e->refcount++;
+	block->cache_entry = e;
+	block->block_data.data = e->data;
+	block->block_data.len = e->len;
+
+	block_init_layout(block, block_type, e->len, e->full_block_size,
+			  header_size, hash_size);
+	return 0;
+}
+
 void reftable_block_release(struct reftable_block *block)
 {
+	block_release_cache_entry(block);
 	inflateEnd(block->zstream);
 	reftable_free(block->zstream);
 	reftable_free(block->uncompressed_data);
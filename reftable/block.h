@@ -106,6 +106,39 @@ void block_iter_reset(struct block_iter *it);
 /* deallocate memory for `it`. The block reader and its block is left intact. */
 void block_iter_close(struct block_iter *it);
 
+/*
+ * A bounded cache of decompressed log blocks. It is owned by a stack and
+ * shared by its tables so that visiting the same log block again, e.g. from
+ * a new iterator, does not inflate it again. Entries are keyed by table name
+ * and block offset, both of which identify immutable data, and are evicted
+ * least recently used first once `max_size` bytes are exceeded.
+ *
+ * Both the cache and its entries are refcounted: tables keep the cache alive,
+ * and blocks served from the cache keep their entry alive even after it has
+ * been evicted.
+ */
+struct reftable_block_cache;
+
+int block_cache_new(struct reftable_block_cache **out, size_t max_size,
+		    void (*on_lookup)(void *payload, int hit), void *payload);
+void block_cache_incref(struct reftable_block_cache *cache);
+void block_cache_decref(struct reftable_block_cache *cache);
+
+/* Evict all entries belonging to the given table. */
+void block_cache_drop_table(struct reftable_block_cache *cache,
+			    const char *table_name);
+
+/*
+ * Like `reftable_block_init()`, but serve log blocks from `cache` when
+ * possible and add newly decompressed log blocks to it.
+ */
+int block_init_cached(struct reftable_block *block,
+		      struct reftable_block_cache *cache, const char *table_name,
+		      struct reftable_block_source *source,
+		      uint32_t offset, uint32_t header_size,
+		      uint32_t table_block_size, uint32_t hash_size,
+		      uint8_t want_type);
+
 /* size of file header, depending on format version */
 size_t header_size(int version);
 
@@ -254,6 +254,20 @@ int reftable_iterator_seek_ref(struct reftable_iterator *it,
 	return it->ops->seek(it->iter_arg, &want);
 }
 
+int reftable_iterator_seek_ref_prefix(struct reftable_iterator *it,
+				      const char *prefix)
+{
+	struct reftable_record want = {
+		.type = REFTABLE_BLOCK_TYPE_REF,
+		.u.ref = {
+			.refname = (char *)prefix,
+		},
+	};
+	if (it->ops->seek_prefix)
+		return it->ops->seek_prefix(it->iter_arg, &want);
+	return it->ops->seek(it->iter_arg, &want);
+}
+
 int reftable_iterator_next_ref(struct reftable_iterator *it,
 			       struct reftable_ref_record *ref)
 {
@@ -20,6 +20,11 @@
  */
 struct reftable_iterator_vtable {
 	int (*seek)(void *iter_arg, struct reftable_record *want);
+	/*
+	 * Optional. Like `seek()`, but the caller only wants records whose key
+	 * starts with the key of `want`. Falls back to `seek()` if unset.
+	 */
+	int (*seek_prefix)(void *iter_arg, struct reftable_record *want);
 	int (*next)(void *iter_arg, struct reftable_record *rec);
 	void (*close)(void *iter_arg);
 };
@@ -20,6 +20,7 @@
 struct merged_subiter {
 	struct reftable_iterator iter;
 	struct reftable_record rec;
+	struct reftable_table *table;
 };
 
 struct merged_iter {
@@ -38,6 +39,7 @@ static void merged_iter_close(void *p)
 	for (size_t i = 0; i < mi->subiters_len; i++) {
 		reftable_iterator_destroy(&mi->subiters[i].iter);
 		reftable_record_release(&mi->subiters[i].rec);
+		reftable_table_decref(mi->subiters[i].table);
 	}
 	reftable_free(mi->subiters);
 }
@@ -61,30 +63,58 @@ static int merged_iter_advance_subiter(struct merged_iter *mi, size_t idx)
 	return 0;
 }
 
-static int merged_iter_seek(struct merged_iter *mi, struct reftable_record *want)
+/*
+ * Seek all subiterators to `want`. If `prefix_only` is set, the caller is
+ * only interested in ref records whose name starts with the wanted name, so
+ * we can skip tables that cannot contain any such record altogether.
+ */
+static int merged_iter_seek(struct merged_iter *mi, struct reftable_record *want,
+			    int prefix_only)
 {
+	struct reftable_buf prefix = REFTABLE_BUF_INIT;
 	int err;
 
+	if (prefix_only && reftable_record_type(want) == REFTABLE_BLOCK_TYPE_REF) {
+		err = reftable_record_key(want, &prefix);
+		if (err < 0)
+			goto out;
+	} else {
+		prefix_only = 0;
+	}
+
 	mi->advance_index = -1;
 	while (!merged_iter_pqueue_is_empty(mi->pq)) {
 		err = merged_iter_pqueue_remove(&mi->pq, NULL);
 		if (err < 0)
-			return err;
+			goto out;
 	}
 
 	for (size_t i = 0; i < mi->subiters_len; i++) {
+		if (prefix_only) {
+			err = table_may_contain_ref_prefix(mi->subiters[i].table,
+							   &prefix);
+			if (err < 0)
+				goto out;
+			if (!err)
+				continue;
+		}
+
 		err = iterator_seek(&mi->subiters[i].iter, want);
 		if (err < 0)
-			return err;
+			goto out;
 		if (err > 0)
 			continue;
 
 		err = merged_iter_advance_subiter(mi, i);
 		if (err < 0)
-			return err;
+			goto out;
 	}
 
-	return 0;
+	err = 0;
+
+out:
+	reftable_buf_release(&prefix);
+	return err;
 }
 
 static int merged_iter_next_entry(struct merged_iter *mi,
@@ -161,7 +191,12 @@ static int merged_iter_next_entry(struct merged_iter *mi,
 
 static int merged_iter_seek_void(void *it, struct reftable_record *want)
 {
-	return merged_iter_seek(it, want);
+	return merged_iter_seek(it, want, 0);
+}
+
+static int merged_iter_seek_prefix_void(void *it, struct reftable_record *want)
+{
+	return merged_iter_seek(it, want, 1);
 }
 
 static int merged_iter_next_void(void *p, struct reftable_record *rec)
@@ -179,6 +214,7 @@ static int merged_iter_next_void(void *p, struct reftable_record *rec)
 
 static struct reftable_iterator_vtable merged_iter_vtable = {
 	.seek = merged_iter_seek_void,
+	.seek_prefix = merged_iter_seek_prefix_void,
 	.next = &merged_iter_next_void,
 	.close = &merged_iter_close,
 };
@@ -270,6 +306,9 @@ int merged_table_init_iter(struct reftable_merged_table *mt,
 		ret = table_init_iter(mt->tables[i], &subiters[i].iter, typ);
 		if (ret < 0)
 			goto out;
+
+		reftable_table_incref(mt->tables[i]);
+		subiters[i].table = mt->tables[i];
 	}
 
 	REFTABLE_CALLOC_ARRAY(mi, 1);
@@ -290,6 +329,7 @@ int merged_table_init_iter(struct reftable_merged_table *mt,
 		for (size_t i = 0; subiters && i < mt->tables_len; i++) {
 			reftable_iterator_destroy(&subiters[i].iter);
 			reftable_record_release(&subiters[i].rec);
+			reftable_table_decref(subiters[i].table);
 		}
 		reftable_free(subiters);
 		reftable_free(mi);
@@ -49,6 +49,12 @@ struct reftable_block {
 	 */
 	uint32_t full_block_size;
 	uint8_t block_type;
+
+	/*
+	 * The cache entry `block_data` points into when the block has been
+	 * served from a `struct reftable_block_cache`, NULL otherwise.
+	 */
+	struct reftable_block_cache_entry *cache_entry;
 };
 
 /* Initialize a reftable block from the given block source. */
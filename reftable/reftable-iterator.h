@@ -29,6 +29,15 @@ struct reftable_iterator {
 int reftable_iterator_seek_ref(struct reftable_iterator *it,
 			       const char *name);
 
+/*
+ * Like `reftable_iterator_seek_ref()`, but the caller promises to stop
+ * iterating at the first record whose name does not start with `prefix`.
+ * This allows iterators over a stack of tables to skip tables that cannot
+ * contain any such record, so records after the prefix may be missing.
+ */
+int reftable_iterator_seek_ref_prefix(struct reftable_iterator *it,
+				      const char *prefix);
+
 /* reads the next reftable_ref_record. Returns < 0 for error, 0 for OK and > 0:
  * end of iteration.
  */
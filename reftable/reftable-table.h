@@ -52,6 +52,17 @@ struct reftable_table {
 	struct reftable_table_offsets obj_offsets;
 	struct reftable_table_offsets log_offsets;
 
+	/* Cache of decompressed log blocks shared with the stack, if any. */
+	struct reftable_block_cache *block_cache;
+
+	/*
+	 * The first and last ref name stored in the table. These are loaded
+	 * lazily by `table_may_contain_ref_prefix()`.
+	 */
+	struct reftable_buf ref_first_key;
+	struct reftable_buf ref_last_key;
+	int ref_key_range_loaded;
+
 	uint64_t refcount;
 };
 
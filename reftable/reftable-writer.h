@@ -69,6 +69,32 @@ struct reftable_write_options {
 	 */
 	void (*on_reload)(void *payload);
 	void *on_reload_payload;
+
+	/*
+	 * Maximum number of bytes of decompressed log blocks the stack keeps
+	 * cached across iterators, so that reading the same log block again
+	 * does not need to inflate it again. Passing 0 disables the cache.
+	 */
+	size_t log_block_cache_size;
+
+	/*
+	 * Callback function to execute whenever a log block is looked up in
+	 * the cache, where `hit` tells whether it has been found. The payload
+	 * data will be passed as argument to the callback.
+	 */
+	void (*on_log_block_cache)(void *payload, int hit);
+	void *on_log_block_cache_payload;
+
+	/*
+	 * Callback function to execute after a new table has been added to
+	 * the stack while `disable_auto_compact` is set, but the stack would
+	 * have been auto-compacted otherwise. This allows the caller to defer
+	 * compaction, e.g. to a separate process, instead of paying for it
+	 * while committing. The payload data will be passed as argument to
+	 * the callback.
+	 */
+	void (*on_compaction_required)(void *payload);
+	void *on_compaction_required_payload;
 };
 
 /* reftable_block_stats holds statistics for a single block type */
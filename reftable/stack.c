@@ -9,6 +9,7 @@
 #include "stack.h"
 
 #include "system.h"
+#include "block.h"
 #include "constants.h"
 #include "merged.h"
 #include "reftable-error.h"
@@ -206,6 +207,7 @@ void reftable_stack_destroy(struct reftable_stack *st)
 		st->list_fd = -1;
 	}
 
+	block_cache_decref(st->block_cache);
 	REFTABLE_FREE_AND_NULL(st->list_file);
 	REFTABLE_FREE_AND_NULL(st->reftable_dir);
 	reftable_free(st);
@@ -303,6 +305,11 @@ static int reftable_stack_reload_once(struct reftable_stack *st,
 			err = reftable_table_new(&table, &src, name);
 			if (err < 0)
 				goto done;
+
+			if (st->block_cache) {
+				block_cache_incref(st->block_cache);
+				table->block_cache = st->block_cache;
+			}
 		}
 
 		new_tables[new_tables_len] = table;
@@ -329,6 +336,7 @@ static int reftable_stack_reload_once(struct reftable_stack *st,
 			if (err < 0)
 				goto done;
 
+			block_cache_drop_table(st->block_cache, name);
 			reftable_table_decref(cur[i]);
 			unlink(table_path.buf);
 		}
@@ -535,6 +543,14 @@ int reftable_new_stack(struct reftable_stack **dest, const char *dir,
 		goto out;
 	}
 
+	if (opts.log_block_cache_size) {
+		err = block_cache_new(&p->block_cache, opts.log_block_cache_size,
+				      opts.on_log_block_cache,
+				      opts.on_log_block_cache_payload);
+		if (err < 0)
+			goto out;
+	}
+
 	err = reftable_stack_reload_maybe_reuse(p, 1);
 	if (err < 0)
 		goto out;
@@ -825,6 +841,19 @@ int reftable_addition_commit(struct reftable_addition *add)
 		    err != REFTABLE_OUTDATED_ERROR)
 			goto done;
 		err = 0;
+	} else if (add->stack->opts.on_compaction_required) {
+		bool required;
+
+		/*
+		 * The caller wants to compact the stack on its own terms, e.g.
+		 * asynchronously. Tell it that it should do so.
+		 */
+		err = reftable_stack_compaction_required(add->stack, true,
+							 &required);
+		if (err < 0)
+			goto done;
+		if (required)
+			add->stack->opts.on_compaction_required(add->stack->opts.on_compaction_required_payload);
 	}
 
 done:
@@ -172,8 +172,15 @@ int table_init_block(struct reftable_table *t, struct reftable_block *block,
 	if (next_off >= t->size)
 		return 1;
 
-	err = reftable_block_init(block, &t->source, next_off, header_off,
-				  t->block_size, hash_size(t->hash_id), want_typ);
+	if (t->block_cache)
+		err = block_init_cached(block, t->block_cache, t->name,
+					&t->source, next_off, header_off,
+					t->block_size, hash_size(t->hash_id),
+					want_typ);
+	else
+		err = reftable_block_init(block, &t->source, next_off, header_off,
+					  t->block_size, hash_size(t->hash_id),
+					  want_typ);
 	if (err)
 		reftable_block_release(block);
 	return err;
@@ -315,6 +322,7 @@ static int table_iter_seek_linear(struct table_iter *ti,
 		next.block.zstream = NULL;
 		next.block.uncompressed_data = NULL;
 		next.block.uncompressed_cap = 0;
+		next.block.cache_entry = NULL;
 
 		err = table_iter_next_block(&next);
 		if (err < 0)
@@ -455,6 +463,78 @@ static int table_iter_seek(struct table_iter *ti,
 	return err;
 }
 
+/*
+ * Determine the first and last ref name of the table. This only needs to
+ * look at the first ref block and at the highest level of the ref index,
+ * whose last entry names the last key of the last ref block. Tables without
+ * an index only have a handful of ref blocks, so we scan those instead.
+ */
+static int table_load_ref_key_range(struct reftable_table *t)
+{
+	struct reftable_record rec = { 0 };
+	struct table_iter ti;
+	int err;
+
+	table_iter_init(&ti, t);
+
+	err = table_iter_seek_start(&ti, REFTABLE_BLOCK_TYPE_REF, 0);
+	if (err)
+		goto done;
+	err = reftable_block_first_key(&ti.block, &t->ref_first_key);
+	if (err < 0)
+		goto done;
+
+	if (t->ref_offsets.index_offset) {
+		table_iter_block_done(&ti);
+		err = table_iter_seek_start(&ti, REFTABLE_BLOCK_TYPE_REF, 1);
+		if (err)
+			goto done;
+	}
+
+	err = reftable_record_init(&rec, ti.typ);
+	if (err < 0)
+		goto done;
+	while (!(err = table_iter_next(&ti, &rec))) {
+		err = reftable_record_key(&rec, &t->ref_last_key);
+		if (err < 0)
+			goto done;
+	}
+	if (err > 0)
+		err = 0;
+
+done:
+	reftable_record_release(&rec);
+	table_iter_close(&ti);
+	return err;
+}
+
+int table_may_contain_ref_prefix(struct reftable_table *t,
+				 const struct reftable_buf *prefix)
+{
+	const struct reftable_buf *first = &t->ref_first_key;
+	int err;
+
+	if (!t->ref_offsets.is_present)
+		return 0;
+
+	if (!t->ref_key_range_loaded) {
+		err = table_load_ref_key_range(t);
+		if (err < 0)
+			return err;
+		t->ref_key_range_loaded = 1;
+	}
+
+	/* All refs sort before the prefix. */
+	if (reftable_buf_cmp(&t->ref_last_key, prefix) < 0)
+		return 0;
+	/* All refs sort after the prefix and do not start with it. */
+	if (reftable_buf_cmp(first, prefix) > 0 &&
+	    (first->len < prefix->len || memcmp(first->buf, prefix->buf, prefix->len)))
+		return 0;
+
+	return 1;
+}
+
 static int table_iter_seek_void(void *ti, struct reftable_record *want)
 {
 	return table_iter_seek(ti, want);
@@ -607,6 +687,9 @@ void reftable_table_decref(struct reftable_table *t)
 	if (--t->refcount)
 		return;
 	block_source_close(&t->source);
+	block_cache_decref(t->block_cache);
+	reftable_buf_release(&t->ref_first_key);
+	reftable_buf_release(&t->ref_last_key);
 	REFTABLE_FREE_AND_NULL(t->name);
 	reftable_free(t);
 }
@@ -26,4 +26,13 @@ int table_init_iter(struct reftable_table *t,
 int table_init_block(struct reftable_table *t, struct reftable_block *block,
 		     uint64_t next_off, uint8_t want_typ);
 
+/*
+ * Check whether the table may contain refs whose name starts with `prefix`.
+ * Returns 0 if it certainly does not, 1 if it may and a negative error code
+ * otherwise. The range of ref names in the table is computed on first use
+ * and cached, so this is cheap for tables that are kept open.
+ */
+int table_may_contain_ref_prefix(struct reftable_table *t,
+				 const struct reftable_buf *prefix);
+
 #endif
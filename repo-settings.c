@@ -131,6 +131,15 @@ void prepare_repo_settings(struct repository *r)
 			die("unknown fetch negotiation algorithm '%s'", strval);
 	}
 
+	if (!repo_config_get_string_tmp(r, "core.transactionobjects", &strval)) {
+		if (!strcasecmp(strval, "pack"))
+			r->settings.core_transaction_objects = TRANSACTION_OBJECTS_PACK;
+		else if (!strcasecmp(strval, "loose"))
+			r->settings.core_transaction_objects = TRANSACTION_OBJECTS_LOOSE;
+		else
+			die("unknown core.transactionObjects value '%s'", strval);
+	}
+
 	/*
 	 * This setting guards all index reads to require a full index
 	 * over a sparse index. After suitable guards are placed in the
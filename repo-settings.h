@@ -16,6 +16,11 @@ enum fetch_negotiation_setting {
 	FETCH_NEGOTIATION_NOOP,
 };
 
+enum transaction_objects_setting {
+	TRANSACTION_OBJECTS_LOOSE,
+	TRANSACTION_OBJECTS_PACK,
+};
+
 enum log_refs_config {
 	LOG_REFS_UNSET = -1,
 	LOG_REFS_NONE = 0,
@@ -60,6 +65,7 @@ struct repo_settings {
 	enum fetch_negotiation_setting fetch_negotiation_algorithm;
 
 	int core_multi_pack_index;
+	enum transaction_objects_setting core_transaction_objects;
 	int warn_ambiguous_refs; /* lazily loaded via accessor */
 
 	size_t delta_base_cache_limit;
@@ -92,6 +92,7 @@ static struct test_cmd cmds[] = {
 	{ "windows-named-pipe", cmd__windows_named_pipe },
 #endif
 	{ "write-cache", cmd__write_cache },
+	{ "xdiff-hash-speed", cmd__xdiff_hash_speed },
 	{ "zlib", cmd__zlib },
 };
 
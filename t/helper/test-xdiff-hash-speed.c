@@ -0,0 +1,70 @@
+#include "test-tool.h"
+#include "strbuf.h"
+#include "xdiff/xinclude.h"
+
+#define NUM_SECONDS 3
+
+static const struct {
+	const char *name;
+	uint64_t flags;
+} modes[] = {
+	{ "verbatim", 0 },
+	{ "ignore-all-space", XDF_IGNORE_WHITESPACE },
+	{ "ignore-space-change", XDF_IGNORE_WHITESPACE_CHANGE },
+	{ "ignore-space-at-eol", XDF_IGNORE_WHITESPACE_AT_EOL },
+	{ "ignore-cr-at-eol", XDF_IGNORE_CR_AT_EOL },
+};
+
+static uint64_t hash_buffer(const uint8_t *p, const uint8_t *top,
+			    uint64_t flags)
+{
+	uint64_t sum = 0;
+
+	while (p < top)
+		sum += xdl_hash_record(&p, top, flags);
+	return sum;
+}
+
+/*
+ * Report how fast the lines of the given file (or stdin) are hashed by
+ * xdl_hash_record() with each of the whitespace modes.
+ */
+int cmd__xdiff_hash_speed(int ac, const char **av)
+{
+	struct strbuf buf = STRBUF_INIT;
+	clock_t initial, start, end;
+
+	if (ac > 2)
+		die("usage: test-tool xdiff-hash-speed [<file>]");
+	if (ac == 2) {
+		if (strbuf_read_file(&buf, av[1], 0) < 0)
+			die_errno("unable to read '%s'", av[1]);
+	} else if (strbuf_read(&buf, 0, 0) < 0) {
+		die_errno("unable to read stdin");
+	}
+	if (!buf.len)
+		die("nothing to hash");
+
+	/* Use this as an offset to make overflow less likely. */
+	initial = clock();
+
+	for (size_t i = 0; i < ARRAY_SIZE(modes); i++) {
+		const uint8_t *p = (const uint8_t *)buf.buf;
+		uint64_t sum = 0;
+		unsigned long j, kb;
+		double kb_per_sec;
+
+		start = end = clock() - initial;
+		for (j = 0; ((end - start) / CLOCKS_PER_SEC) < NUM_SECONDS; j++) {
+			sum += hash_buffer(p, p + buf.len, modes[i].flags);
+			end = clock() - initial;
+		}
+		kb = j * buf.len / 1024;
+		kb_per_sec = kb / (((double)end - start) / CLOCKS_PER_SEC);
+		printf("%s: %lu iters; %lu KiB; %0.2f KiB/s (%"PRIx64")\n",
+		       modes[i].name, j, kb, kb_per_sec, sum);
+	}
+
+	strbuf_release(&buf);
+	return 0;
+}
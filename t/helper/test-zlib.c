@@ -2,7 +2,11 @@
 #include "git-zlib.h"
 #include "strbuf.h"
 
-static const char *zlib_usage = "test-tool zlib [inflate|deflate]";
+static const char *zlib_usage =
+	"test-tool zlib [inflate|deflate]\n"
+	"   or: test-tool zlib inflate-buffer <size>\n"
+	"   or: test-tool zlib deflate-buffer\n"
+	"   or: test-tool zlib bench (stream|buffer) <count>";
 
 static void do_zlib(struct git_zstream *stream,
 		    int (*zlib_func)(git_zstream *, int),
@@ -36,10 +40,110 @@ static void do_zlib(struct git_zstream *stream,
 	strbuf_release(&buf_in);
 }
 
+static void inflate_buffer(size_t size)
+{
+	struct strbuf in = STRBUF_INIT;
+	unsigned char *out = xmalloc(size);
+	int status;
+
+	if (strbuf_read(&in, 0, 0) < 0)
+		die_errno("read error");
+	status = git_inflate_buffer(out, size, in.buf, in.len);
+	if (status != Z_STREAM_END)
+		die("zlib error %d", status);
+	if (write_in_full(1, out, size) < 0)
+		die_errno("write error");
+
+	free(out);
+	strbuf_release(&in);
+}
+
+static void deflate_buffer(void)
+{
+	struct strbuf in = STRBUF_INIT;
+	size_t bound, len;
+	unsigned char *out;
+
+	if (strbuf_read(&in, 0, 0) < 0)
+		die_errno("read error");
+	bound = git_deflate_buffer_bound(in.len);
+	out = xmalloc(bound);
+	len = git_deflate_buffer(out, bound, in.buf, in.len,
+				 Z_DEFAULT_COMPRESSION);
+	if (!len)
+		die("deflate-buffer failed");
+	if (write_in_full(1, out, len) < 0)
+		die_errno("write error");
+
+	free(out);
+	strbuf_release(&in);
+}
+
+/*
+ * Compress stdin once, then inflate it <count> times, either through
+ * a zlib stream as most callers do, or in one go.
+ */
+static void bench(const char *mode, int count)
+{
+	struct strbuf raw = STRBUF_INIT;
+	unsigned char *zbuf, *out;
+	size_t bound, zlen;
+
+	if (strbuf_read(&raw, 0, 0) < 0)
+		die_errno("read error");
+	bound = git_deflate_buffer_bound(raw.len);
+	zbuf = xmalloc(bound);
+	zlen = git_deflate_buffer(zbuf, bound, raw.buf, raw.len,
+				  Z_DEFAULT_COMPRESSION);
+	if (!zlen)
+		die("deflate-buffer failed");
+	out = xmalloc(raw.len);
+
+	while (count-- > 0) {
+		int status;
+
+		if (!strcmp(mode, "buffer")) {
+			status = git_inflate_buffer(out, raw.len, zbuf, zlen);
+		} else if (!strcmp(mode, "stream")) {
+			git_zstream stream;
+
+			memset(&stream, 0, sizeof(stream));
+			stream.next_in = zbuf;
+			stream.avail_in = zlen;
+			stream.next_out = out;
+			stream.avail_out = raw.len;
+			git_inflate_init(&stream);
+			status = git_inflate(&stream, Z_FINISH);
+			git_inflate_end(&stream);
+		} else {
+			die("unknown bench mode: %s", mode);
+		}
+		if (status != Z_STREAM_END)
+			die("zlib error %d", status);
+	}
+	if (memcmp(out, raw.buf, raw.len))
+		die("inflated data differs from input");
+
+	free(out);
+	free(zbuf);
+	strbuf_release(&raw);
+}
+
 int cmd__zlib(int argc, const char **argv)
 {
 	git_zstream stream;
 
+	if (argc == 3 && !strcmp(argv[1], "inflate-buffer")) {
+		inflate_buffer(strtoul(argv[2], NULL, 10));
+		return 0;
+	} else if (argc == 2 && !strcmp(argv[1], "deflate-buffer")) {
+		deflate_buffer();
+		return 0;
+	} else if (argc == 4 && !strcmp(argv[1], "bench")) {
+		bench(argv[2], atoi(argv[3]));
+		return 0;
+	}
+
 	if (argc != 2)
 		usage(zlib_usage);
 
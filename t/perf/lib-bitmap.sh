@@ -33,6 +33,10 @@ test_full_bitmap () {
 		git rev-list HEAD --not perf-tag --use-bitmap-index --objects >/dev/null
 	'
 
+	test_perf 'rev-list count (objects)' '
+		git rev-list --use-bitmap-index --count --objects --all >/dev/null
+	'
+
 	test_perf 'rev-list count with blob:none' '
 		git rev-list --use-bitmap-index --count --objects --all \
 			--filter=blob:none >/dev/null
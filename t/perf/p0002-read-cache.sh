@@ -11,4 +11,12 @@ test_perf "read_cache/discard_cache $count times" "
 	test-tool read-cache $count
 "
 
+test_expect_success 'switch to index version 5' '
+	git update-index --index-version 5
+'
+
+test_perf "read_cache/discard_cache $count times (v5)" "
+	test-tool read-cache $count
+"
+
 test_done
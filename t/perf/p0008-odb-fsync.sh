@@ -3,7 +3,9 @@
 # This test measures the performance of adding new files to the object
 # database. The test was originally added to measure the effect of the
 # core.fsyncMethod=batch mode, which is why we are testing different values of
-# that setting explicitly and creating a lot of unique objects.
+# that setting explicitly and creating a lot of unique objects. The
+# core.transactionObjects=pack mode is measured alongside, with objects
+# hardened as part of the single packfile it writes.
 
 test_description="Tests performance of adding things to the object database"
 
@@ -32,19 +34,26 @@ setup_repo () {
 test_perf_fsync_cfgs () {
 	local method &&
 	local cfg &&
-	for method in none fsync batch writeout-only
+	local mode &&
+	for method in none fsync batch writeout-only pack
 	do
 		case $method in
 		none)
 			cfg="-c core.fsync=none"
+			mode="fsyncMethod=$method"
+			;;
+		pack)
+			cfg="-c core.fsync=objects -c core.transactionObjects=pack"
+			mode="transactionObjects=pack"
 			;;
 		*)
 			cfg="-c core.fsync=loose-object -c core.fsyncMethod=$method"
+			mode="fsyncMethod=$method"
 		esac &&
 
 		# Set GIT_TEST_FSYNC=1 explicitly since fsync is normally
 		# disabled by t/test-lib.sh.
-		if ! test_perf "$1 (fsyncMethod=$method)" \
+		if ! test_perf "$1 ($mode)" \
 						--setup "$2" \
 						"GIT_TEST_FSYNC=1 git $cfg $3"
 		then
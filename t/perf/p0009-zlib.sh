@@ -0,0 +1,27 @@
+#!/bin/sh
+
+test_description='Inflate performance of streaming and one-shot zlib calls'
+. ./perf-lib.sh
+
+test_perf_default_repo
+
+test_expect_success 'setup' '
+	git ls-files --stage "*.[ch]" |
+	cut -f2 -d" " |
+	git cat-file --batch >objects
+'
+
+for mode in stream buffer
+do
+	test_perf "inflate ($mode)" "
+		test-tool zlib bench $mode 100 <objects
+	"
+done
+
+test_perf 'cat-file --batch' '
+	git ls-files --stage "*.[ch]" |
+	cut -f2 -d" " |
+	git cat-file --batch >/dev/null
+'
+
+test_done
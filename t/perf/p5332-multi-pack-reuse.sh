@@ -9,6 +9,10 @@ packdir=.git/objects/pack
 
 test_perf_large_repo
 
+test_lazy_prereq GNU_TIME '
+	/usr/bin/time -f %M -o rss true
+'
+
 find_pack () {
 	for idx in $packdir/pack-*.idx
 	do
@@ -75,6 +79,14 @@ do
 		test_size "clone size for $nr_packs-pack scenario ($reuse-pack reuse)" '
 			test_file_size result
 		'
+
+		test_size GNU_TIME "peak RSS (KiB) for $nr_packs-pack scenario ($reuse-pack reuse)" "
+			/usr/bin/time -f %M -o rss \
+				git -c pack.allowPackReuse=$reuse pack-objects \
+				--revs --delta-base-offset --use-bitmap-index \
+				--stdout <in >/dev/null &&
+			tail -n 1 rss
+		"
 	done
 done
 
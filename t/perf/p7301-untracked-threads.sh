@@ -0,0 +1,46 @@
+#!/bin/sh
+
+test_description="Test threaded untracked file discovery"
+
+. ./perf-lib.sh
+
+test_perf_default_repo
+test_checkout_worktree
+
+test_expect_success 'setup untracked and ignored directories' '
+	rm -rf untracked_dirs build_output template &&
+	mkdir template &&
+	for i in $(test_seq 1 100)
+	do
+		mkdir template/dir$i &&
+		touch template/dir$i/file$i template/dir$i/file$i.o ||
+		return $?
+	done &&
+	mkdir untracked_dirs build_output &&
+	for i in $(test_seq 1 20)
+	do
+		cp -r template untracked_dirs/copy$i &&
+		cp -r template build_output/copy$i || return $?
+	done &&
+	rm -rf template &&
+	echo "build_output/" >>.git/info/exclude &&
+	echo "*.o" >>.git/info/exclude &&
+	git config core.untrackedCache false
+'
+
+for threads in 1 0
+do
+	test_perf "status -uall (core.untrackedThreads=$threads)" "
+		git -c core.untrackedThreads=$threads status -uall >/dev/null
+	"
+
+	test_perf "status --ignored (core.untrackedThreads=$threads)" "
+		git -c core.untrackedThreads=$threads status -uall --ignored >/dev/null
+	"
+
+	test_perf "add -A --dry-run (core.untrackedThreads=$threads)" "
+		git -c core.untrackedThreads=$threads add -A --dry-run >/dev/null
+	"
+done
+
+test_done
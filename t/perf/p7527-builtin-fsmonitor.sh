@@ -214,6 +214,32 @@ do_matrix () {
 	fi
 }
 
+# Time how long the daemon takes to start watching the tree.  On Linux
+# compare the listener backends: inotify has to walk the whole tree to
+# add a watch on every directory, while fanotify places a single mark
+# on the filesystem (and falls back to inotify when it is not allowed
+# to).
+#
+time_fsm_startup () {
+	backend=$1
+
+	test_perf "fsmonitor--daemon start [$backend]" "
+		git -C $REPO -c fsmonitor.linuxBackend=$backend \
+			fsmonitor--daemon start &&
+		git -C $REPO fsmonitor--daemon stop
+	"
+}
+
+if test "$(uname -s)" = Linux
+then
+	for backend in inotify fanotify
+	do
+		time_fsm_startup $backend
+	done
+else
+	time_fsm_startup default
+fi
+
 # Begin testing each case in the matrix that we care about.
 #
 uc_values="false"
@@ -684,4 +684,66 @@ test_expect_success ULIMIT_STACK_SIZE 'deep macro recursion' '
 	test_cmp expect actual
 '
 
+test_expect_success 'long attribute lists match like short ones' '
+	test_when_finished "rm -rf long-list" &&
+	mkdir long-list &&
+	(
+		cd long-list &&
+		cat >.gitattributes <<-\EOF &&
+		*.c text diff=cpp
+		*.h text
+		special.c -text
+		Makefile whitespace
+		sub/*.c -diff
+		*.tar.gz binary
+		[attr]mine text eol=lf
+		mine.h mine
+		*.C attr=upper
+		EOF
+		cp .gitattributes short &&
+		test_seq -f "no-such-file-%d foo" 1 20 >>.gitattributes &&
+		cat >paths <<-\EOF &&
+		a.c
+		special.c
+		sub/special.c
+		sub/a.c
+		a.h
+		mine.h
+		x.tar.gz
+		Makefile
+		sub/Makefile
+		a.C
+		other
+		EOF
+		git check-attr --all --stdin <paths >actual &&
+		cp short .gitattributes &&
+		git check-attr --all --stdin <paths >expect &&
+		test_cmp expect actual
+	)
+'
+
+test_expect_success 'check-attr --stdin moving between directories' '
+	test_when_finished "rm -rf hop" &&
+	mkdir -p hop/plain/deeper hop/attrs/deeper &&
+	echo "* test=attrs" >hop/attrs/.gitattributes &&
+	echo "*.c test=deeper" >hop/attrs/deeper/.gitattributes &&
+	cat >paths <<-\EOF &&
+	hop/plain/a.c
+	hop/plain/deeper/a.c
+	hop/attrs/a.c
+	hop/attrs/deeper/a.c
+	hop/attrs/deeper/a.h
+	hop/plain/deeper/b.c
+	hop/attrs/deeper/b.c
+	hop/a.c
+	hop/attrs/b.c
+	EOF
+	while read path
+	do
+		git check-attr test -- "$path" || return 1
+	done <paths >expect &&
+	git check-attr --stdin test <paths >actual &&
+	test_cmp expect actual
+'
+
 test_done
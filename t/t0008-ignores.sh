@@ -964,4 +964,52 @@ test_expect_success EXPENSIVE 'large exclude file ignored in tree' '
 	test_cmp expect err
 '
 
+test_expect_success 'long exclude lists match like short ones' '
+	test_when_finished "rm -rf long-list" &&
+	mkdir long-list &&
+	(
+		cd long-list &&
+		cat >.gitignore <<-\EOF &&
+		*.o
+		!keep.o
+		build
+		/anchored
+		cache/
+		*.tar.gz
+		!release.tar.gz
+		foo*
+		*.O
+		Makefile
+		!sub/Makefile
+		EOF
+		cp .gitignore short &&
+		test_seq -f "no-such-file-%d" 1 20 >>.gitignore &&
+		mkdir -p sub/cache sub/anchored &&
+		cat >paths <<-\EOF &&
+		a.o
+		keep.o
+		sub/keep.o
+		a.O
+		build
+		sub/build
+		anchored
+		sub/anchored
+		cache
+		sub/cache
+		x.tar.gz
+		release.tar.gz
+		tar.gz
+		foobar
+		sub/foo
+		Makefile
+		sub/Makefile
+		other
+		EOF
+		git check-ignore -v -n --stdin <paths >actual &&
+		cp short .gitignore &&
+		git check-ignore -v -n --stdin <paths >expect &&
+		test_cmp expect actual
+	)
+'
+
 test_done
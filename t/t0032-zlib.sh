@@ -0,0 +1,46 @@
+#!/bin/sh
+
+test_description='one-shot zlib helpers'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_seq 1 20000 >data &&
+	size=$(wc -c <data) &&
+	size=$(($size))
+'
+
+test_expect_success 'deflate-buffer output inflates as a stream' '
+	test-tool zlib deflate-buffer <data >data.z &&
+	test-tool zlib inflate <data.z >actual &&
+	test_cmp data actual
+'
+
+test_expect_success 'inflate-buffer reads a streamed deflate' '
+	test-tool zlib deflate <data >data.z &&
+	test-tool zlib inflate-buffer $size <data.z >actual &&
+	test_cmp data actual
+'
+
+test_expect_success 'inflate-buffer ignores data after the stream' '
+	echo trailing >>data.z &&
+	test-tool zlib inflate-buffer $size <data.z >actual &&
+	test_cmp data actual
+'
+
+test_expect_success 'inflate-buffer insists on the exact size' '
+	test_must_fail test-tool zlib inflate-buffer $(($size - 1)) <data.z &&
+	test_must_fail test-tool zlib inflate-buffer $(($size + 1)) <data.z
+'
+
+test_expect_success 'inflate-buffer rejects truncated input' '
+	test_copy_bytes 1000 <data.z >truncated.z &&
+	test_must_fail test-tool zlib inflate-buffer $size <truncated.z
+'
+
+test_expect_success 'bench inflates the same data either way' '
+	test-tool zlib bench stream 3 <data &&
+	test-tool zlib bench buffer 3 <data
+'
+
+test_done
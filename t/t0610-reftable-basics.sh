@@ -334,6 +334,47 @@ test_expect_success 'ref transaction: writes cause auto-compaction' '
 	test_line_count = 1 repo/.git/reftable/tables.list
 '
 
+test_expect_success 'ref transaction: background auto-compaction' '
+	test_when_finished "rm -rf repo" &&
+
+	git init repo &&
+	git -C repo config set reftable.autoCompaction background &&
+	test_commit -C repo --no-tag A &&
+	test_line_count = 1 repo/.git/reftable/tables.list &&
+
+	GIT_TRACE2_EVENT="$(pwd)/trace2.txt" \
+		test_commit -C repo --no-tag B &&
+	test_line_count = 1 repo/.git/reftable/tables.list &&
+	grep "\"event\":\"child_start\".*\"refs\",\"optimize\",\"--auto\"" trace2.txt
+'
+
+test_expect_success 'ref transaction: background auto-compaction can be disabled' '
+	test_when_finished "rm -rf repo" &&
+
+	git init repo &&
+	git -C repo config set reftable.autoCompaction background &&
+	test_commit -C repo A &&
+	start=$(wc -l <repo/.git/reftable/tables.list) &&
+
+	GIT_TEST_REFTABLE_AUTOCOMPACTION=false \
+		git -C repo update-ref refs/heads/branch-1 HEAD &&
+	GIT_TEST_REFTABLE_AUTOCOMPACTION=false \
+		git -C repo update-ref refs/heads/branch-2 HEAD &&
+	test_line_count = $((start + 2)) repo/.git/reftable/tables.list &&
+
+	git -C repo update-ref refs/heads/branch-3 HEAD &&
+	test_line_count -lt $((start + 2)) repo/.git/reftable/tables.list
+'
+
+test_expect_success 'ref transaction: invalid auto-compaction mode' '
+	test_when_finished "rm -rf repo" &&
+
+	git init repo &&
+	git -C repo config set reftable.autoCompaction bogus &&
+	test_must_fail git -C repo update-ref refs/heads/foo HEAD 2>err &&
+	test_grep "invalid value for ${SQ}reftable.autoCompaction${SQ}: ${SQ}bogus${SQ}" err
+'
+
 test_expect_success 'ref transaction: env var disables compaction' '
 	test_when_finished "rm -rf repo" &&
 
@@ -927,6 +968,27 @@ test_expect_success 'reflog: updates via HEAD update HEAD reflog' '
 	)
 '
 
+test_expect_success 'reflog: log blocks are cached across lookups' '
+	test_when_finished "rm -rf repo" &&
+	git init repo &&
+	(
+		cd repo &&
+		test_commit one &&
+		test_commit two &&
+		test_commit three &&
+		git pack-refs &&
+
+		GIT_TRACE2_EVENT="$(pwd)/trace2.txt" \
+			git rev-parse HEAD@{1} HEAD@{2} &&
+		grep "\"name\":\"log_block_cache_miss\",\"count\":1}" trace2.txt &&
+		grep "\"name\":\"log_block_cache_hit\"" trace2.txt &&
+
+		GIT_TRACE2_EVENT="$(pwd)/trace2-disabled.txt" \
+			git -c reftable.logBlockCacheSize=0 rev-parse HEAD@{1} HEAD@{2} &&
+		test_grep ! log_block_cache trace2-disabled.txt
+	)
+'
+
 test_expect_success 'branch: copying branch with D/F conflict' '
 	test_when_finished "rm -rf repo" &&
 	git init repo &&
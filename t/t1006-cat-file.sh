@@ -1186,6 +1186,40 @@ test_expect_success 'cat-file --batch="batman" with --batch-all-objects will wor
 	cmp expect actual
 '
 
+test_expect_success 'cat-file --batch-parallel keeps input order' '
+	{
+		cat objects &&
+		echo HEAD &&
+		echo HEAD:does-not-exist &&
+		echo deadbeef &&
+		sort -r objects
+	} >parallel-input &&
+	git -C all-two cat-file --batch <parallel-input >expect &&
+	git -C all-two cat-file --batch --batch-parallel=4 <parallel-input >actual &&
+	cmp expect actual &&
+	git -C all-two -c core.bigFileThreshold=1 \
+		cat-file --batch --batch-parallel=4 <parallel-input >actual &&
+	cmp expect actual
+'
+
+test_expect_success 'cat-file --batch-check --batch-parallel with custom format' '
+	format="%(objectname) %(objecttype) %(objectsize:disk) %(rest)" &&
+	sed "s/$/ some rest/" objects >parallel-input &&
+	git -C all-two cat-file --batch-check="$format" <parallel-input >expect &&
+	git -C all-two cat-file --batch-check="$format" --batch-parallel=3 \
+		<parallel-input >actual &&
+	cmp expect actual
+'
+
+test_expect_success 'cat-file --batch-parallel rejects incompatible options' '
+	test_must_fail git cat-file --batch-command --batch-parallel=2 2>err &&
+	test_grep "cannot be used together" err &&
+	test_must_fail git cat-file --batch --batch-all-objects --batch-parallel=2 2>err &&
+	test_grep "cannot be used together" err &&
+	test_must_fail git cat-file --batch-parallel=2 2>err &&
+	test_grep "requires a batch mode" err
+'
+
 test_expect_success 'cat-file %(objectsize:disk) with --batch-all-objects' '
 	# our state has both loose and packed objects,
 	# so find both for our expected output
@@ -24,5 +24,50 @@ test_expect_success 'empty index file' '
 	GIT_INDEX_FILE=new-index git read-tree main
 '
 
+test_expect_success 'checkout.treeReadThreads reads trees ahead' '
+	for d in x y z
+	do
+		mkdir -p $d/sub $d/other &&
+		echo $d >$d/file &&
+		echo $d >$d/sub/file &&
+		echo $d >$d/other/file || return 1
+	done &&
+	git add . &&
+	git commit -m subtrees &&
+	rm -f new-index &&
+	GIT_INDEX_FILE=new-index git read-tree main &&
+	GIT_INDEX_FILE=new-index git ls-files -s >expect &&
+	rm -f new-index &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" GIT_INDEX_FILE=new-index \
+		git -c checkout.treeReadThreads=3 read-tree main &&
+	grep "tree_prefetch/threads\",\"value\":\"3\"" trace.txt &&
+	GIT_INDEX_FILE=new-index git ls-files -s >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'checkout.treeReadLimit caps the trees read ahead' '
+	git rev-list --objects main | cut -d" " -f1 |
+	git cat-file --batch-check="%(objecttype) %(objectsize)" |
+	sed -n "s/^tree //p" | sort -n | tail -n 1 >largest &&
+	rm -f new-index trace.txt &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" GIT_INDEX_FILE=new-index \
+		git -c checkout.treeReadThreads=3 -c checkout.treeReadLimit=1 \
+		read-tree main &&
+	sed -n "s/.*tree_prefetch\/max_bytes\",\"value\":\"\([0-9]*\)\".*/\1/p" \
+		trace.txt >max &&
+	test_line_count = 1 max &&
+	test $(cat max) -le $(cat largest) &&
+	GIT_INDEX_FILE=new-index git ls-files -s >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'clone with checkout.treeReadThreads' '
+	git -c checkout.treeReadThreads=0 clone . clone &&
+	git -C clone ls-files -s >actual &&
+	git ls-files -s >expect &&
+	test_cmp expect actual &&
+	git -C clone diff --exit-code
+'
+
 test_done
 
@@ -95,6 +95,91 @@ test_expect_success 'index.skipHash config option' '
 	git -C sub fsck
 '
 
+test_expect_success 'index version 5 round-trips entries' '
+	test_when_finished "rm -rf v5" &&
+	git init v5 &&
+	(
+		cd v5 &&
+		mkdir -p dir/sub &&
+		for f in a b dir/c dir/sub/d dir/sub/a-rather-long-file-name
+		do
+			echo $f >$f || return 1
+		done &&
+		git add . &&
+		echo new >new &&
+		git add -N new &&
+		git update-index --skip-worktree dir/c &&
+		git update-index --assume-unchanged b &&
+		blob=$(echo stage | git hash-object -w --stdin) &&
+		printf "100644 $blob %d\tconflict\n" 1 2 3 |
+			git update-index --index-info &&
+		git ls-files -s -t -v --debug >expect &&
+
+		git update-index --index-version 5 &&
+		git update-index --show-index-version >version &&
+		echo 5 >expect.version &&
+		test_cmp expect.version version &&
+		git ls-files -s -t -v --debug >actual &&
+		test_cmp expect actual &&
+
+		git update-index --remove conflict &&
+		git update-index --index-version 2 &&
+		git ls-files -s -t -v --debug >expect.resolved &&
+		git update-index --index-version 5 &&
+		git ls-files -s -t -v --debug >actual &&
+		test_cmp expect.resolved actual &&
+
+		git update-index --index-version 3 &&
+		git ls-files -s -t -v --debug >actual &&
+		test_cmp expect.resolved actual
+	)
+'
+
+test_expect_success 'index version 5 reuses checksums of unchanged chunks' '
+	test_when_finished "rm -rf v5" &&
+	git init v5 &&
+	(
+		cd v5 &&
+		test_seq 1 5000 >files &&
+		xargs touch <files &&
+		git update-index --index-version 5 --add --stdin <files &&
+		git fsck &&
+
+		test_tick &&
+		echo changed >4999 &&
+		GIT_TRACE2_EVENT="$PWD/trace" git update-index 4999 &&
+		grep "\"key\":\"write/chunks\",\"value\":\"2\"" trace &&
+		grep "\"key\":\"write/chunks_reused\",\"value\":\"1\"" trace &&
+		git fsck &&
+
+		git update-index --index-version 2 &&
+		git ls-files -s >expect &&
+		git update-index --index-version 5 &&
+		git ls-files -s >actual &&
+		test_cmp expect actual
+	)
+'
+
+test_expect_success 'corrupt name length in version 5 index' '
+	test_when_finished "rm -rf v5" &&
+	git init v5 &&
+	(
+		cd v5 &&
+		touch a b &&
+		git update-index --index-version 5 --add a b &&
+		git ls-files >actual &&
+		test_write_lines a b >expect &&
+		test_cmp expect actual &&
+
+		# The first record follows the 12-byte header and the
+		# 8-byte offset table; its name length is at offset 64.
+		printf "\377\377" |
+			dd of=.git/index bs=1 seek=88 conv=notrunc &&
+		test_must_fail git ls-files 2>err &&
+		test_grep "index file corrupt" err
+	)
+'
+
 test_index_version () {
 	INDEX_VERSION_CONFIG=$1 &&
 	FEATURE_MANY_FILES=$2 &&
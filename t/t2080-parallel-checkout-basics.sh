@@ -106,11 +106,14 @@ test_expect_success 'setup repo for checkout with various types of changes' '
 	)
 '
 
-for mode in sequential parallel sequential-fallback
+for mode in sequential parallel threads sequential-fallback
 do
+	worker_mode=processes
 	case $mode in
 	sequential)          workers=1 threshold=0 expected_workers=0 ;;
 	parallel)            workers=2 threshold=0 expected_workers=2 ;;
+	threads)             workers=2 threshold=0 expected_workers=0
+			     worker_mode=threads ;;
 	sequential-fallback) workers=2 threshold=100 expected_workers=0 ;;
 	esac
 
@@ -128,16 +131,20 @@ do
 		git -C $repo submodule foreach "git update-index --refresh" &&
 
 		set_checkout_config $workers $threshold &&
+		test_config_global checkout.workerMode $worker_mode &&
 		test_checkout_workers $expected_workers \
 			git -C $repo checkout --recurse-submodules B2 &&
 		verify_checkout $repo
 	'
 done
 
-for mode in parallel sequential-fallback
+for mode in parallel threads sequential-fallback
 do
+	worker_mode=processes
 	case $mode in
 	parallel)            workers=2 threshold=0 expected_workers=2 ;;
+	threads)             workers=2 threshold=0 expected_workers=0
+			     worker_mode=threads ;;
 	sequential-fallback) workers=2 threshold=100 expected_workers=0 ;;
 	esac
 
@@ -145,6 +152,7 @@ do
 		test_config_global protocol.file.allow always &&
 		repo=various_${mode}_clone &&
 		set_checkout_config $workers $threshold &&
+		test_config_global checkout.workerMode $worker_mode &&
 		test_checkout_workers $expected_workers \
 			git clone --recurse-submodules --branch B2 various $repo &&
 		verify_checkout $repo
@@ -162,10 +170,38 @@ test_expect_success 'compare the working trees' '
 	#
 	git diff --no-index various_sequential various_parallel &&
 	git diff --no-index various_sequential various_parallel_clone &&
+	git diff --no-index various_sequential various_threads &&
+	git diff --no-index various_sequential various_threads_clone &&
 	git diff --no-index various_sequential various_sequential-fallback &&
 	git diff --no-index various_sequential various_sequential-fallback_clone
 '
 
+test_expect_success 'checkout.workerMode=threads writes files on threads' '
+	set_checkout_config 2 0 &&
+	test_config_global checkout.workerMode threads &&
+	git init threads &&
+	(
+		cd threads &&
+		test_commit A &&
+		test_commit B &&
+		rm *.t &&
+		GIT_TRACE2_EVENT="$(pwd)/../threads.trace" \
+			test_checkout_workers 0 git checkout --force HEAD &&
+		test_cmp_rev HEAD B &&
+		grep A A.t &&
+		grep B B.t
+	) &&
+	grep "\"event\":\"thread_start\".*pcheckout" threads.trace
+'
+
+test_expect_success 'checkout.workerMode rejects unknown values' '
+	set_checkout_config 2 0 &&
+	test_config_global checkout.workerMode fibers &&
+	rm threads/*.t &&
+	test_must_fail git -C threads checkout --force HEAD 2>err &&
+	test_grep "invalid value for ${SQ}checkout.workerMode${SQ}: ${SQ}fibers${SQ}" err
+'
+
 # Currently, each submodule is checked out in a separated child process, but
 # these subprocesses must also be able to use parallel checkout workers to
 # write the submodules' entries.
@@ -72,6 +72,38 @@ test_expect_success 'git update-index: core.fsyncmethod=batch' "
 	test_cmp added_files2_oids added_files2_actual
 "
 
+PACK_CONFIGURATION='-c core.transactionObjects=pack'
+
+test_expect_success 'git add: core.transactionObjects=pack' "
+	test_create_unique_files 2 4 files_base_dir3 &&
+	git $PACK_CONFIGURATION add -- ./files_base_dir3/ &&
+	git ls-files --stage files_base_dir3/ |
+	test_parse_ls_files_stage_oids >added_files3_oids &&
+
+	test_line_count = 8 added_files3_oids &&
+	git cat-file --batch-check='%(objectname)' <added_files3_oids >added_files3_actual &&
+	test_cmp added_files3_oids added_files3_actual &&
+	while read oid
+	do
+		test_path_is_missing .git/objects/\$(test_oid_to_path \$oid) || return 1
+	done <added_files3_oids
+"
+
+test_expect_success 'git update-index: core.transactionObjects=pack' "
+	test_create_unique_files 2 4 files_base_dir4 &&
+	find files_base_dir4 ! -type d -print | xargs git $PACK_CONFIGURATION update-index --add -- &&
+	git ls-files --stage files_base_dir4 |
+	test_parse_ls_files_stage_oids >added_files4_oids &&
+
+	test_line_count = 8 added_files4_oids &&
+	git cat-file --batch-check='%(objectname)' <added_files4_oids >added_files4_actual &&
+	test_cmp added_files4_oids added_files4_actual &&
+	while read oid
+	do
+		test_path_is_missing .git/objects/\$(test_oid_to_path \$oid) || return 1
+	done <added_files4_oids
+"
+
 test_expect_success \
 	'git add: Test that executable bit is not used if core.filemode=0' \
 	'git config core.filemode 0 &&
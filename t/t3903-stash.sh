@@ -1584,6 +1584,22 @@ test_expect_success 'stash with core.fsyncmethod=batch' "
 	test_cmp stashed_files_oids stashed_files_actual
 "
 
+test_expect_success 'stash with core.transactionObjects=pack' "
+	test_create_unique_files 2 4 files_base_dir_pack &&
+	git -c core.transactionObjects=pack stash push -u -- ./files_base_dir_pack/ &&
+
+	git ls-tree -r stash^3 -- ./files_base_dir_pack/ |
+	test_parse_ls_tree_oids >stashed_files_oids &&
+
+	test_line_count = 8 stashed_files_oids &&
+	git cat-file --batch-check='%(objectname)' <stashed_files_oids >stashed_files_actual &&
+	test_cmp stashed_files_oids stashed_files_actual &&
+	while read oid
+	do
+		test_path_is_missing .git/objects/\$(test_oid_to_path \$oid) || return 1
+	done <stashed_files_oids
+"
+
 
 test_expect_success 'git stash succeeds despite directory/file change' '
 	test_create_repo directory_file_switch_v1 &&
@@ -309,4 +309,56 @@ test_expect_success 'last line matters too' '
 	test_cmp expected actual.munged
 '
 
+test_expect_success 'diff.renameCache remembers fingerprints' '
+	test_when_finished "git update-ref -d refs/notes/rename-fingerprints" &&
+	git diff-tree -r -M --name-status HEAD^ HEAD >expect &&
+	git -c diff.renameCache=true diff-tree -r -M --name-status HEAD^ HEAD >actual &&
+	test_cmp expect actual &&
+	git rev-parse HEAD^:no-final-lf HEAD:still-absent-final-lf >blobs &&
+	sort blobs >expect.cached &&
+	git notes --ref=rename-fingerprints list >notes &&
+	cut -d" " -f2 notes | sort >actual.cached &&
+	test_cmp expect.cached actual.cached &&
+	git -c diff.renameCache=true diff-tree -r -M --name-status HEAD^ HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'diff.renameCache uses cached fingerprints' '
+	test_when_finished "git update-ref -d refs/notes/rename-fingerprints" &&
+	src=$(git rev-parse HEAD^:no-final-lf) &&
+	empty=$(git hash-object -w --stdin </dev/null) &&
+	tree=$(printf "100644 blob $empty\t$src\n" | git mktree) &&
+	commit=$(git commit-tree -m "spanhash v1" $tree) &&
+	git update-ref refs/notes/rename-fingerprints $commit &&
+	git -c diff.renameCache=true diff-tree -r -M --name-status HEAD^ HEAD >actual &&
+	cat >expect <<-\EOF &&
+	D	no-final-lf
+	A	still-absent-final-lf
+	EOF
+	test_cmp expect actual
+'
+
+test_expect_success 'diff.renameThreads does not change the result' '
+	test_when_finished "git reset --hard HEAD^" &&
+	for i in 1 2 3 4 5 6
+	do
+		test_seq 100 | sed "s/^/$i: /" >thread-src-$i || return 1
+	done &&
+	git add thread-src-* &&
+	git commit -m "sources for threaded rename detection" &&
+	for i in 1 2 3 4 5 6
+	do
+		git mv thread-src-$i thread-dst-$((7 - $i)) &&
+		echo changed >>thread-dst-$((7 - $i)) || return 1
+	done &&
+	git commit -a -m "threaded rename detection" &&
+	git -c diff.renameThreads=1 diff-tree -r -M --name-status HEAD^ HEAD >expect &&
+	test_grep "^R" expect &&
+	git -c diff.renameThreads=3 diff-tree -r -M --name-status HEAD^ HEAD >actual &&
+	test_cmp expect actual &&
+	git -c diff.renameThreads=0 diff-tree -r -C -C --name-status HEAD^ HEAD >expect &&
+	git -c diff.renameThreads=1 diff-tree -r -C -C --name-status HEAD^ HEAD >actual &&
+	test_cmp expect actual
+'
+
 test_done
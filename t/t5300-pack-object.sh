@@ -215,6 +215,23 @@ test_expect_success 'unpack with OFS_DELTA (core.fsyncmethod=batch)' '
 	check_unpack test-3-${packname_3} obj-list "$BATCH_CONFIGURATION"
 '
 
+PACK_CONFIGURATION='-c core.transactionObjects=pack'
+
+test_expect_success 'unpack with OFS_DELTA (core.transactionObjects=pack)' '
+	check_unpack test-3-${packname_3} obj-list "$PACK_CONFIGURATION"
+'
+
+test_expect_success 'core.transactionObjects=pack unpacks into a single pack' '
+	test_when_finished "rm -rf git2" &&
+	git init --bare git2 &&
+	git $PACK_CONFIGURATION -C git2 unpack-objects <test-3-${packname_3}.pack &&
+	git -C git2 count-objects -v >counts &&
+	test_grep "^count: 0" counts &&
+	test_grep "^packs: 1" counts &&
+	git -C git2 cat-file --batch-check="%(objectname)" <obj-list >current &&
+	cmp obj-list current
+'
+
 test_expect_success PERL_TEST_HELPERS 'compare delta flavors' '
 	perl -e '\''
 		defined($_ = -s $_) or die for @ARGV;
@@ -543,6 +560,51 @@ do
 	'
 done
 
+test_expect_success PTHREADS 'threaded delta search shares out the cost evenly' '
+	test_when_finished "rm -rf threads" &&
+	git init threads &&
+	(
+		cd threads &&
+		# The large blobs sort after all of the small ones, so
+		# splitting the list by count would give one thread all
+		# of them.
+		for i in 1 2 3
+		do
+			for j in $(test_seq 1 40)
+			do
+				test_seq $(($j * 100000 + $i)) $(($j * 100000 + 1000)) \
+					>$j.large || return 1
+			done &&
+			for j in $(test_seq 1 300)
+			do
+				test_seq $(($j + $i)) $(($j + 40)) >$j.small || return 1
+			done &&
+			git add . &&
+			git commit -q -m $i || return 1
+		done &&
+		git rev-list --objects --all >list &&
+		pack=$(GIT_TRACE2_EVENT="$PWD/trace" \
+		       git pack-objects --window=4 --threads=4 pack <list) &&
+		git verify-pack pack-$pack.pack &&
+		sed -n "s/.*\"key\":\"delta_share\",\"value\":\"\([0-9]*\)\".*/\1/p" \
+			trace >shares &&
+		test_line_count = 4 shares &&
+		# No thread starts out with more than 1.5 times or less
+		# than half of the average cost.
+		awk "{ s[NR] = \$1; sum += \$1 }
+		     END { for (i = 1; i <= NR; i++)
+				if (4 * s[i] > 1.5 * sum || 4 * s[i] < 0.5 * sum)
+					exit 1 }" shares &&
+
+		# Splitting the work must not cost many deltas.
+		single=$(git pack-objects --window=4 --threads=1 single <list) &&
+		threaded_size=$(test_file_size pack-$pack.pack) &&
+		single_size=$(test_file_size single-$single.pack) &&
+		echo "threaded $threaded_size, single $single_size" &&
+		test $threaded_size -le $(($single_size * 101 / 100))
+	)
+'
+
 test_expect_success !PTHREADS,!FAIL_PREREQS \
 	'index-pack --threads=N or pack.threads=N warns when no pthreads' '
 	test_must_fail git index-pack --threads=2 2>err &&
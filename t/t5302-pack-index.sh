@@ -67,6 +67,20 @@ test_expect_success 'index-pack results should match pack-objects ones' '
 	cmp "test-2-${pack2}.idx" "2.idx"
 '
 
+test_expect_success 'index-pack hashing in threads writes the same index' '
+	GIT_FORCE_THREADS=1 git index-pack --index-version=2 --strict \
+		-o threaded.idx "test-1-${pack1}.pack" &&
+	cmp "test-2-${pack2}.idx" threaded.idx &&
+
+	test_when_finished "rm -rf threaded" &&
+	git init threaded &&
+	GIT_FORCE_THREADS=1 git -C threaded index-pack --threads=4 --stdin \
+		<"test-1-${pack1}.pack" >out &&
+	echo "pack	${pack1}" >expect &&
+	test_cmp expect out &&
+	cmp "test-2-${pack2}.idx" threaded/.git/objects/pack/pack-${pack1}.idx
+'
+
 test_expect_success 'index-pack --verify on index version 1' '
 	git index-pack --verify "test-1-${pack1}.pack"
 '
@@ -121,4 +121,13 @@ test_expect_success 'negative depth disables deltas' '
 	test_cmp expect actual
 '
 
+test_expect_success 'delta base cache lookups are reported to trace2' '
+	git repack -adf &&
+	git rev-parse HEAD~5:file HEAD~5:file >in &&
+	GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+		git cat-file --batch <in >/dev/null &&
+	grep "\"category\":\"delta-base-cache\",\"name\":\"miss\"" trace.event &&
+	grep "\"category\":\"delta-base-cache\",\"name\":\"hit\"" trace.event
+'
+
 test_done
@@ -111,6 +111,20 @@ test_expect_success 'reuse all objects from all packs' '
 	test_pack_objects_reused_all 9 3
 '
 
+test_expect_success 'reused objects are sent before the delta search' '
+	test_pack_objects_reused_all 9 3 &&
+	sed -n "/\"event\":\"region_enter\"/s/.*\"label\":\"\([a-z-]*\)\".*/\1/p" \
+		trace2.txt >regions &&
+	cat >expect <<-\EOF &&
+	enumerate-objects
+	write-reused-packs
+	prepare-pack
+	write-pack-file
+	EOF
+	grep -x -f expect regions >actual &&
+	test_cmp expect actual
+'
+
 test_expect_success 'reuse objects from first pack with middle gap' '
 	for i in D E F
 	do
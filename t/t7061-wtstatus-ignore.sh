@@ -340,4 +340,37 @@ test_expect_success 'status ignores submodule in excluded directory' '
 	test_cmp expected actual
 '
 
+test_expect_success 'threaded directory walk finds the same paths' '
+	test_when_finished "rm -rf threads" &&
+	git init threads &&
+	(
+		cd threads &&
+		mkdir -p tracked/sub untracked/sub/deeper ignored/sub empty \
+			mixed/ignored mixed/untracked &&
+		for f in tracked/file tracked/sub/file untracked/file \
+			untracked/sub/deeper/file ignored/file ignored/sub/file \
+			mixed/ignored/file mixed/untracked/file mixed/file.o
+		do
+			echo $f >$f || return 1
+		done &&
+		printf "ignored/\n*.o\nmixed/ignored/\n" >.gitignore &&
+		git add .gitignore tracked &&
+		git init nested &&
+
+		for args in "-uall" "-uall --ignored" "--ignored=matching -uall" \
+			"--ignored=traditional" "-unormal"
+		do
+			git -c core.untrackedThreads=1 status --porcelain $args >../expect &&
+			git -c core.untrackedThreads=4 status --porcelain $args >../actual &&
+			test_cmp ../expect ../actual || return 1
+		done &&
+		git -c core.untrackedThreads=1 ls-files -o -i --exclude-standard >../expect &&
+		git -c core.untrackedThreads=4 ls-files -o -i --exclude-standard >../actual &&
+		test_cmp ../expect ../actual &&
+		git -c core.untrackedThreads=1 clean -n -d -x >../expect &&
+		git -c core.untrackedThreads=4 clean -n -d -x >../actual &&
+		test_cmp ../expect ../actual
+	)
+'
+
 test_done
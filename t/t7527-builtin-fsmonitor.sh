@@ -318,6 +318,55 @@ test_expect_success 'cannot start multiple daemons' '
 	test_must_fail git -C test_multiple fsmonitor--daemon status
 '
 
+test_expect_success !MINGW 'token journal survives a daemon restart' '
+	test_when_finished "stop_daemon_delete_repo test_journal" &&
+
+	git init test_journal &&
+	mkdir test_journal/dir &&
+	>test_journal/dir/file &&
+
+	# Changes to the worktree root within a couple of seconds of
+	# the journal cannot be told apart from ones made while the
+	# daemon was down.
+	sleep 3 &&
+
+	start_daemon -C test_journal &&
+	test-tool -C test_journal fsmonitor-client query --token 0 >actual &&
+	token=$(nul_to_q <actual | sed "s/Q.*//") &&
+	test_path_is_file test_journal/.git/fsmonitor--daemon/journal &&
+	git -C test_journal fsmonitor--daemon stop &&
+
+	echo changed >test_journal/dir/file &&
+	>test_journal/dir/new &&
+
+	GIT_TRACE2_EVENT="$PWD/.git/trace_journal" \
+		start_daemon -C test_journal &&
+	test-tool -C test_journal fsmonitor-client query --token "$token" >actual &&
+	nul_to_q <actual >actual.filtered &&
+	test_grep "Qdir/fileQ" actual.filtered &&
+	test_grep "Qdir/newQ" actual.filtered &&
+	test_grep ! "Q/Q" actual.filtered &&
+	have_t2_data_event fsmonitor journal/restored <.git/trace_journal &&
+
+	# A token handed out after the journal was last written
+	# cannot be answered.
+	test-tool -C test_journal fsmonitor-client query \
+		--token "${token%:*}:$((${token##*:} + 1))" >actual &&
+	nul_to_q <actual >actual.filtered &&
+	test_grep "Q/Q" actual.filtered
+'
+
+test_expect_success !MINGW 'token journal can be disabled' '
+	test_when_finished "stop_daemon_delete_repo test_journal" &&
+
+	git init test_journal &&
+	git -C test_journal config fsmonitor.journal false &&
+	start_daemon -C test_journal &&
+	test-tool -C test_journal fsmonitor-client query --token 0 >actual &&
+	git -C test_journal fsmonitor--daemon stop &&
+	test_path_is_missing test_journal/.git/fsmonitor--daemon/journal
+'
+
 # These tests use the main repo in the trash directory
 
 test_expect_success 'setup' '
@@ -551,6 +600,36 @@ test_expect_success 'rename directory' '
 	retry_grep "^event: dirrenamed/*$"  .git/trace
 '
 
+test_lazy_prereq LINUX '
+	test "$(uname -s)" = Linux
+'
+
+test_expect_success LINUX 'fanotify backend sees changes' '
+	test_when_finished "clean_up_repo_and_stop_daemon; rm -f .git/trace2" &&
+	test_config fsmonitor.linuxBackend fanotify &&
+
+	start_daemon --tf "$PWD/.git/trace" --t2 "$PWD/.git/trace2" &&
+
+	edit_files &&
+	mv dirtorename dirrenamed &&
+
+	retry_grep "^event: dir1/modified$" .git/trace &&
+	retry_grep "^event: modified$"      .git/trace &&
+	retry_grep "^event: dir1/untracked$" .git/trace &&
+	retry_grep "^event: dirtorename/*$" .git/trace &&
+	retry_grep "^event: dirrenamed/*$"  .git/trace &&
+
+	# Without the privileges for a filesystem mark we fall back to
+	# inotify; either way the chosen backend is recorded.
+	grep "listen/backend" .git/trace2
+'
+
+test_expect_success LINUX 'invalid fsmonitor.linuxBackend' '
+	test_must_fail git -c fsmonitor.linuxBackend=bogus \
+		fsmonitor--daemon run 2>err &&
+	test_grep "invalid value for .fsmonitor.linuxBackend." err
+'
+
 test_expect_success 'file changes to directory' '
 	test_when_finished clean_up_repo_and_stop_daemon &&
 
@@ -269,6 +269,78 @@ test_expect_success 'last-modified merge undoes changes' '
 	EOF
 '
 
+test_expect_success 'lastModified.cache reuses answers for ancestors' '
+	test_when_finished rm -rf repo &&
+	git init repo &&
+	(
+		cd repo &&
+		test_commit c1 file &&
+		mkdir dir &&
+		test_commit c2 dir/file &&
+		test_commit c3 other &&
+		git -c lastModified.cache=true last-modified -r >actual &&
+		git last-modified -r >expect &&
+		test_cmp expect actual &&
+		git rev-parse --verify refs/notes/last-modified &&
+
+		test_commit c4 dir/file &&
+		git switch -c side c3 &&
+		test_commit c5 other &&
+		git switch - &&
+		test_merge c6 side &&
+		GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+			git -c lastModified.cache=true last-modified -r >actual &&
+		grep "\"cache hit\",\"value\":\"$(git rev-parse c3)\"" trace.txt &&
+		git last-modified -r >expect &&
+		sort expect >expect.sorted &&
+		sort actual >actual.sorted &&
+		test_cmp expect.sorted actual.sorted &&
+
+		git -c lastModified.cache=true last-modified dir >actual &&
+		git last-modified dir >expect &&
+		test_cmp expect actual
+	)
+'
+
+test_expect_success 'lastModified.cache is not used for ranges' '
+	test_when_finished rm -rf repo &&
+	git init repo &&
+	(
+		cd repo &&
+		test_commit c1 file &&
+		test_commit c2 other &&
+		git -c lastModified.cache=true last-modified HEAD^..HEAD >actual &&
+		test_must_fail git rev-parse --verify refs/notes/last-modified &&
+		git last-modified HEAD^..HEAD >expect &&
+		test_cmp expect actual
+	)
+'
+
+test_expect_success 'lastModified.cache is not used with diff options' '
+	test_when_finished rm -rf repo &&
+	git init repo &&
+	(
+		cd repo &&
+		test_commit base f &&
+		git switch -c side &&
+		test_commit side f &&
+		git switch - &&
+		test_merge merge side &&
+		git -c lastModified.cache=true last-modified >actual &&
+		git last-modified >expect &&
+		test_cmp expect actual &&
+		git rev-parse --verify refs/notes/last-modified &&
+
+		for opts in "--diff-filter=A" "-S base" "--diff-filter=A -M"
+		do
+			git last-modified $opts -- f >expect &&
+			git -c lastModified.cache=true \
+				last-modified $opts -- f >actual &&
+			test_cmp expect actual || return 1
+		done
+	)
+'
+
 test_expect_success 'cannot run last-modified on two commits' '
 	test_must_fail git last-modified HEAD HEAD~1 2>err &&
 	test_grep "last-modified can only operate on one commit at a time" err
@@ -0,0 +1,135 @@
+#include "unit-test.h"
+#include "ewah/ewok.h"
+
+/*
+ * A deterministic mix of bit patterns: a sparse stretch, a stretch of
+ * solid words that compresses into a run of ones, a long gap that
+ * compresses into a run of zeros and a dense, irregular tail.
+ */
+#define NR_BITS (64 * 300 + 17)
+
+static int pattern_bit(size_t pos)
+{
+	if (pos < 64 * 40)
+		return !(pos % 97);
+	if (pos < 64 * 120)
+		return 1;
+	if (pos < 64 * 200)
+		return 0;
+	return !!((pos * 2654435761u) & 0x400);
+}
+
+static struct ewah_bitmap *pattern_ewah(void)
+{
+	struct ewah_bitmap *ewah = ewah_new();
+
+	for (size_t pos = 0; pos < NR_BITS; pos++)
+		if (pattern_bit(pos))
+			ewah_set(ewah, pos);
+	return ewah;
+}
+
+static size_t pattern_popcount(void)
+{
+	size_t count = 0;
+
+	for (size_t pos = 0; pos < NR_BITS; pos++)
+		count += pattern_bit(pos);
+	return count;
+}
+
+static struct bitmap *every_nth_bitmap(size_t n)
+{
+	struct bitmap *bitmap = bitmap_new();
+
+	for (size_t pos = 0; pos < NR_BITS + 200; pos += n)
+		bitmap_set(bitmap, pos);
+	return bitmap;
+}
+
+void test_ewah__to_bitmap(void)
+{
+	struct ewah_bitmap *ewah = pattern_ewah();
+	struct bitmap *bitmap = ewah_to_bitmap(ewah);
+
+	for (size_t pos = 0; pos < NR_BITS + 64; pos++)
+		cl_assert_equal_i(bitmap_get(bitmap, pos),
+				  pos < NR_BITS && pattern_bit(pos));
+	cl_assert(bitmap_equals_ewah(bitmap, ewah));
+
+	bitmap_free(bitmap);
+	ewah_free(ewah);
+}
+
+void test_ewah__popcount(void)
+{
+	struct ewah_bitmap *ewah = pattern_ewah();
+	struct bitmap *bitmap = ewah_to_bitmap(ewah);
+
+	cl_assert_equal_i(ewah_bitmap_popcount(ewah), pattern_popcount());
+	cl_assert_equal_i(bitmap_popcount(bitmap), pattern_popcount());
+
+	bitmap_free(bitmap);
+	ewah_free(ewah);
+}
+
+static void count_bit(size_t pos, void *data)
+{
+	size_t *next = data;
+
+	while (*next < pos)
+		cl_assert(!pattern_bit((*next)++));
+	cl_assert_equal_i(*next, pos);
+	cl_assert(pattern_bit(pos));
+	(*next)++;
+}
+
+void test_ewah__each_bit(void)
+{
+	struct ewah_bitmap *ewah = pattern_ewah();
+	size_t next = 0;
+
+	ewah_each_bit(ewah, count_bit, &next);
+	while (next < NR_BITS)
+		cl_assert(!pattern_bit(next++));
+
+	ewah_free(ewah);
+}
+
+void test_ewah__or_ewah(void)
+{
+	struct ewah_bitmap *ewah = pattern_ewah();
+	struct bitmap *bitmap = every_nth_bitmap(5);
+
+	bitmap_or_ewah(bitmap, ewah);
+	for (size_t pos = 0; pos < NR_BITS + 200; pos++)
+		cl_assert_equal_i(bitmap_get(bitmap, pos),
+				  !(pos % 5) || (pos < NR_BITS && pattern_bit(pos)));
+
+	bitmap_free(bitmap);
+	ewah_free(ewah);
+}
+
+void test_ewah__or_and_not(void)
+{
+	struct ewah_bitmap *ewah = pattern_ewah();
+	struct bitmap *bitmap = ewah_to_bitmap(ewah);
+	struct bitmap *threes = every_nth_bitmap(3);
+
+	bitmap_or(bitmap, threes);
+	for (size_t pos = 0; pos < NR_BITS + 200; pos++)
+		cl_assert_equal_i(bitmap_get(bitmap, pos),
+				  !(pos % 3) || (pos < NR_BITS && pattern_bit(pos)));
+
+	bitmap_and_not(bitmap, threes);
+	for (size_t pos = 0; pos < NR_BITS + 200; pos++)
+		cl_assert_equal_i(bitmap_get(bitmap, pos),
+				  (pos % 3) && pos < NR_BITS && pattern_bit(pos));
+
+	bitmap_and_not(bitmap, bitmap);
+	cl_assert(bitmap_is_empty(bitmap));
+
+	bitmap_free(threes);
+	bitmap_free(bitmap);
+	ewah_free(ewah);
+}
@@ -1,5 +1,6 @@
 #include "unit-test.h"
 #include "mem-pool.h"
+#include "write-or-die.h"
 
 static void test_many_pool_allocations(size_t block_alloc)
 {
@@ -23,3 +24,35 @@ void test_mem_pool__tiny_block(void)
 {
 	test_many_pool_allocations(1);
 }
+
+void test_mem_pool__adopt_mapping(void)
+{
+	struct mem_pool pool, other;
+	char path[] = "mem-pool-XXXXXX";
+	char data[64] = "mapped", *map, *mem;
+	int fd = xmkstemp(path);
+
+	write_or_die(fd, data, sizeof(data));
+	map = xmmap(NULL, sizeof(data), PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	mem_pool_init(&pool, 0);
+	mem = mem_pool_alloc(&pool, 16);
+	mem_pool_adopt_mapping(&pool, map, sizeof(data));
+	cl_assert(mem_pool_contains(&pool, map));
+	cl_assert(mem_pool_contains(&pool, map + sizeof(data) - 1));
+	cl_assert(!mem_pool_contains(&pool, map + sizeof(data)));
+
+	/* allocations are still served from the current block */
+	cl_assert(mem_pool_alloc(&pool, 16) == mem + 16);
+
+	mem_pool_init(&other, 0);
+	mem_pool_combine(&other, &pool);
+	cl_assert(!mem_pool_contains(&pool, map));
+	cl_assert(mem_pool_contains(&other, map));
+	cl_assert_equal_s(map, "mapped");
+
+	mem_pool_discard(&pool, 0);
+	mem_pool_discard(&other, 1);
+	unlink(path);
+}
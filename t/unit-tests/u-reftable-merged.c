@@ -271,6 +271,98 @@ void test_reftable_merged__seek_multiple_times(void)
 	reftable_free(sources);
 }
 
+void test_reftable_merged__seek_prefix(void)
+{
+	struct reftable_ref_record r1[] = {
+		{
+			.refname = (char *) "refs/heads/a",
+			.update_index = 1,
+			.value_type = REFTABLE_REF_VAL1,
+			.value.val1 = { 1 },
+		},
+		{
+			.refname = (char *) "refs/pull/1",
+			.update_index = 1,
+			.value_type = REFTABLE_REF_VAL1,
+			.value.val1 = { 2 },
+		},
+	};
+	struct reftable_ref_record r2[] = {
+		{
+			.refname = (char *) "refs/tags/v1",
+			.update_index = 2,
+			.value_type = REFTABLE_REF_VAL1,
+			.value.val1 = { 3 },
+		},
+		{
+			.refname = (char *) "refs/tags/v2",
+			.update_index = 2,
+			.value_type = REFTABLE_REF_VAL1,
+			.value.val1 = { 4 },
+		},
+	};
+	struct reftable_ref_record r3[] = {
+		{
+			.refname = (char *) "refs/pull/1",
+			.update_index = 3,
+			.value_type = REFTABLE_REF_DELETION,
+		},
+		{
+			.refname = (char *) "refs/pull/2",
+			.update_index = 3,
+			.value_type = REFTABLE_REF_VAL1,
+			.value.val1 = { 5 },
+		},
+	};
+	struct reftable_ref_record *refs[] = {
+		r1, r2, r3,
+	};
+	size_t sizes[] = {
+		ARRAY_SIZE(r1), ARRAY_SIZE(r2), ARRAY_SIZE(r3),
+	};
+	struct reftable_buf bufs[] = {
+		REFTABLE_BUF_INIT, REFTABLE_BUF_INIT, REFTABLE_BUF_INIT,
+	};
+	struct reftable_block_source *sources = NULL;
+	struct reftable_table **tables = NULL;
+	struct reftable_ref_record rec = { 0 };
+	struct reftable_iterator it = { 0 };
+	struct reftable_merged_table *mt;
+
+	mt = merged_table_from_records(refs, &sources, &tables, sizes, bufs, 3);
+	merged_table_init_iter(mt, &it, REFTABLE_BLOCK_TYPE_REF);
+
+	for (size_t i = 0; i < 2; i++) {
+		cl_assert(!reftable_iterator_seek_ref_prefix(&it, "refs/pull/"));
+
+		/* The deletion in the newest table must still shadow the ref. */
+		cl_assert(reftable_iterator_next_ref(&it, &rec) == 0);
+		cl_assert_equal_s(rec.refname, "refs/pull/1");
+		cl_assert_equal_i(rec.value_type, REFTABLE_REF_DELETION);
+		cl_assert(reftable_iterator_next_ref(&it, &rec) == 0);
+		cl_assert_equal_i(reftable_ref_record_equal(&rec, &r3[1],
+							    REFTABLE_HASH_SIZE_SHA1), 1);
+
+		/* The table with tags has been skipped. */
+		cl_assert(reftable_iterator_next_ref(&it, &rec) > 0);
+
+		/* A plain seek still sees all tables. */
+		cl_assert(!reftable_iterator_seek_ref(&it, "refs/pull/2"));
+		cl_assert(reftable_iterator_next_ref(&it, &rec) == 0);
+		cl_assert_equal_s(rec.refname, "refs/pull/2");
+		cl_assert(reftable_iterator_next_ref(&it, &rec) == 0);
+		cl_assert_equal_s(rec.refname, "refs/tags/v1");
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(bufs); i++)
+		reftable_buf_release(&bufs[i]);
+	tables_destroy(tables, ARRAY_SIZE(refs));
+	reftable_ref_record_release(&rec);
+	reftable_iterator_destroy(&it);
+	reftable_merged_table_free(mt);
+	reftable_free(sources);
+}
+
 void test_reftable_merged__seek_multiple_times_no_drain(void)
 {
 	struct reftable_ref_record r1[] = {
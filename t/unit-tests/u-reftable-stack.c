@@ -1242,6 +1242,143 @@ void test_reftable_stack__read_across_reload(void)
 	clear_dir(dir);
 }
 
+struct log_block_cache_stats {
+	int hits, misses;
+};
+
+static void count_log_block_cache(void *payload, int hit)
+{
+	struct log_block_cache_stats *stats = payload;
+	if (hit)
+		stats->hits++;
+	else
+		stats->misses++;
+}
+
+static void read_all_logs(struct reftable_stack *st, size_t expected)
+{
+	struct reftable_log_record log = { 0 };
+	struct reftable_iterator it = { 0 };
+	size_t n = 0;
+	int err;
+
+	cl_assert_equal_i(reftable_stack_init_log_iterator(st, &it), 0);
+	cl_assert_equal_i(reftable_iterator_seek_log(&it, ""), 0);
+	while (!(err = reftable_iterator_next_log(&it, &log))) {
+		cl_assert_equal_s(log.value.update.message, "commit\n");
+		n++;
+	}
+	cl_assert(err > 0);
+	cl_assert_equal_i(n, expected);
+
+	reftable_log_record_release(&log);
+	reftable_iterator_destroy(&it);
+}
+
+void test_reftable_stack__log_block_cache(void)
+{
+	struct log_block_cache_stats stats = { 0 };
+	struct reftable_write_options opts = {
+		.disable_auto_compact = 1,
+		.log_block_cache_size = 64 * 1024,
+		.on_log_block_cache = count_log_block_cache,
+		.on_log_block_cache_payload = &stats,
+	};
+	struct reftable_stack *st = NULL;
+	struct reftable_log_record log = { 0 };
+	struct reftable_iterator it = { 0 };
+	char *dir = get_tmp_dir(__LINE__);
+	/* enough tables for the cache to grow its hash table */
+	size_t i, N = 100;
+
+	cl_assert_equal_i(reftable_new_stack(&st, dir, &opts), 0);
+	for (i = 0; i < N; i++) {
+		struct reftable_log_record input = {
+			.refname = xstrfmt("branch%03"PRIuMAX, (uintmax_t)i),
+			.update_index = i + 1,
+			.value_type = REFTABLE_LOG_UPDATE,
+			.value.update.message = (char *) "commit\n",
+		};
+		struct write_log_arg arg = {
+			.log = &input,
+			.update_index = reftable_stack_next_update_index(st),
+		};
+
+		cl_assert_equal_i(reftable_stack_add(st, write_test_log,
+						     &arg, 0), 0);
+		reftable_free(input.refname);
+	}
+
+	/* The first read inflates the log block of every table... */
+	read_all_logs(st, N);
+	cl_assert_equal_i(stats.misses, N);
+	cl_assert_equal_i(stats.hits, 0);
+
+	/* ... and subsequent reads are served from the cache. */
+	read_all_logs(st, N);
+	cl_assert_equal_i(stats.misses, N);
+	cl_assert_equal_i(stats.hits, N);
+
+	/*
+	 * Compacting the stack drops the entries of the old tables, but
+	 * iterators that still use their blocks must remain functional.
+	 */
+	cl_assert_equal_i(reftable_stack_init_log_iterator(st, &it), 0);
+	cl_assert_equal_i(reftable_iterator_seek_log(&it, ""), 0);
+	cl_assert_equal_i(reftable_iterator_next_log(&it, &log), 0);
+	cl_assert_equal_i(reftable_stack_compact_all(st, NULL), 0);
+	cl_assert_equal_i(st->merged->tables_len, 1);
+	for (i = 1; i < N; i++)
+		cl_assert_equal_i(reftable_iterator_next_log(&it, &log), 0);
+	cl_assert(reftable_iterator_next_log(&it, &log) > 0);
+	reftable_log_record_release(&log);
+	reftable_iterator_destroy(&it);
+
+	stats.hits = stats.misses = 0;
+	read_all_logs(st, N);
+	cl_assert(stats.misses > 0);
+	stats.hits = stats.misses = 0;
+	read_all_logs(st, N);
+	cl_assert_equal_i(stats.misses, 0);
+	cl_assert(stats.hits > 0);
+
+	reftable_stack_destroy(st);
+	clear_dir(dir);
+}
+
+void test_reftable_stack__log_block_cache_too_small(void)
+{
+	struct log_block_cache_stats stats = { 0 };
+	struct reftable_write_options opts = {
+		.log_block_cache_size = 1,
+		.on_log_block_cache = count_log_block_cache,
+		.on_log_block_cache_payload = &stats,
+	};
+	struct reftable_log_record input = {
+		.refname = (char *) "branch",
+		.update_index = 1,
+		.value_type = REFTABLE_LOG_UPDATE,
+		.value.update.message = (char *) "commit\n",
+	};
+	struct write_log_arg arg = {
+		.log = &input,
+		.update_index = 1,
+	};
+	struct reftable_stack *st = NULL;
+	char *dir = get_tmp_dir(__LINE__);
+
+	cl_assert_equal_i(reftable_new_stack(&st, dir, &opts), 0);
+	cl_assert_equal_i(reftable_stack_add(st, write_test_log, &arg, 0), 0);
+
+	read_all_logs(st, 1);
+	read_all_logs(st, 1);
+	cl_assert_equal_i(stats.misses, 2);
+	cl_assert_equal_i(stats.hits, 0);
+
+	reftable_stack_destroy(st);
+	clear_dir(dir);
+}
+
 void test_reftable_stack__reload_with_missing_table(void)
 {
 	struct reftable_write_options opts = { 0 };
@@ -199,3 +199,58 @@ void test_reftable_table__block_iterator(void)
 	reftable_buf_release(&buf);
 	reftable_free(records);
 }
+
+static void check_prefix(struct reftable_table *table, const char *prefix,
+			 int expect)
+{
+	struct reftable_buf buf = REFTABLE_BUF_INIT;
+
+	cl_assert(!reftable_buf_addstr(&buf, prefix));
+	cl_assert_equal_i(table_may_contain_ref_prefix(table, &buf), expect);
+	reftable_buf_release(&buf);
+}
+
+void test_reftable_table__may_contain_ref_prefix(void)
+{
+	struct reftable_write_options opts = {
+		.block_size = 256,
+	};
+	size_t nr_records[] = { 1, 500 };
+
+	for (size_t i = 0; i < ARRAY_SIZE(nr_records); i++) {
+		size_t nr = nr_records[i];
+		struct reftable_ref_record *records;
+		struct reftable_block_source source = { 0 };
+		struct reftable_buf buf = REFTABLE_BUF_INIT;
+		struct reftable_table *table;
+
+		REFTABLE_CALLOC_ARRAY(records, nr);
+		for (size_t j = 0; j < nr; j++) {
+			records[j].refname = xstrfmt("refs/heads/branch-%04"PRIuMAX,
+						     (uintmax_t)j);
+			records[j].update_index = 1;
+			records[j].value_type = REFTABLE_REF_VAL1;
+		}
+
+		cl_reftable_write_to_buf(&buf, records, nr, NULL, 0, &opts);
+		block_source_from_buf(&source, &buf);
+		cl_assert(!reftable_table_new(&table, &source, "name"));
+		/* Larger tables need to read the last key from the index. */
+		cl_assert_equal_i(!!table->ref_offsets.index_offset, nr > 1);
+
+		check_prefix(table, "", 1);
+		check_prefix(table, "refs/", 1);
+		check_prefix(table, "refs/heads/branch-0000", 1);
+		check_prefix(table, records[nr - 1].refname, 1);
+		check_prefix(table, "refs/heads/branch-9", 0);
+		check_prefix(table, "refs/heads/a", 0);
+		check_prefix(table, "refs/tags/", 0);
+		check_prefix(table, "refs/a", 0);
+
+		reftable_table_decref(table);
+		reftable_buf_release(&buf);
+		for (size_t j = 0; j < nr; j++)
+			reftable_ref_record_release(&records[j]);
+		reftable_free(records);
+	}
+}
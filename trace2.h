@@ -560,6 +560,14 @@ enum trace2_counter_id {
 	TRACE2_COUNTER_ID_FSYNC_WRITEOUT_ONLY,
 	TRACE2_COUNTER_ID_FSYNC_HARDWARE_FLUSH,
 
+	/* counts lookups in the packfile delta base cache */
+	TRACE2_COUNTER_ID_DELTA_BASE_CACHE_HIT,
+	TRACE2_COUNTER_ID_DELTA_BASE_CACHE_MISS,
+
+	/* counts lookups in the reftable log block cache */
+	TRACE2_COUNTER_ID_REFTABLE_LOG_BLOCK_CACHE_HIT,
+	TRACE2_COUNTER_ID_REFTABLE_LOG_BLOCK_CACHE_MISS,
+
 	/* Add additional counter definitions before here. */
 	TRACE2_NUMBER_OF_COUNTERS
 };
@@ -46,6 +46,26 @@ static struct tr2_counter_metadata tr2_counter_metadata[TRACE2_NUMBER_OF_COUNTER
 		.name = "hardware-flush",
 		.want_per_thread_events = 0,
 	},
+	[TRACE2_COUNTER_ID_DELTA_BASE_CACHE_HIT] = {
+		.category = "delta-base-cache",
+		.name = "hit",
+		.want_per_thread_events = 1,
+	},
+	[TRACE2_COUNTER_ID_DELTA_BASE_CACHE_MISS] = {
+		.category = "delta-base-cache",
+		.name = "miss",
+		.want_per_thread_events = 1,
+	},
+	[TRACE2_COUNTER_ID_REFTABLE_LOG_BLOCK_CACHE_HIT] = {
+		.category = "reftable",
+		.name = "log_block_cache_hit",
+		.want_per_thread_events = 0,
+	},
+	[TRACE2_COUNTER_ID_REFTABLE_LOG_BLOCK_CACHE_MISS] = {
+		.category = "reftable",
+		.name = "log_block_cache_miss",
+		.want_per_thread_events = 0,
+	},
 
 	/* Add additional metadata before here. */
 };
@@ -27,10 +27,15 @@
 #include "trace2.h"
 #include "fsmonitor.h"
 #include "odb.h"
+#include "oid-array.h"
+#include "oidmap.h"
+#include "oidset.h"
 #include "promisor-remote.h"
 #include "entry.h"
 #include "parallel-checkout.h"
 #include "setup.h"
+#include "config.h"
+#include "thread-utils.h"
 
 /*
  * Error messages expected by scripts out of plumbing commands such as
@@ -863,6 +868,267 @@ static int traverse_by_cache_tree(int pos, int nr_entries, int nr_names,
 	return 0;
 }
 
+/*
+ * When unpacking into an empty index, as clone and the initial checkout
+ * do, every tree below the ones we were given will be read. With
+ * checkout.treeReadThreads, worker threads read and inflate these trees
+ * ahead of the traversal, one top-level directory at a time, and hand
+ * them over to traverse_trees_recursive(). The traversal itself, and
+ * with it the creation of the cache entries, stays on the main thread
+ * and in index order.
+ *
+ * The trees that have been read but not yet consumed by the traversal
+ * are kept within checkout.treeReadLimit bytes; workers wait for the
+ * traversal to catch up when they would exceed it.
+ */
+struct prefetched_tree {
+	struct oidmap_entry entry;
+	void *buf;
+	unsigned long size;
+};
+
+struct tree_prefetch {
+	struct repository *repo;
+	struct oidmap trees;
+	struct oid_array tasks;
+	size_t next_task;
+	int stop;
+	int nr_threads;
+	pthread_t *threads;
+	pthread_mutex_t mutex;
+	pthread_cond_t room;
+	/* trees the traversal did not find and read by itself */
+	struct oidset missed;
+	unsigned long bytes, max_bytes, limit;
+	intmax_t hits, misses;
+};
+
+#define DEFAULT_TREE_READ_LIMIT (64 * 1024 * 1024)
+
+static int tree_read_threads(struct repository *r)
+{
+	int nr_threads = 1;
+
+	repo_config_get_int(r, "checkout.treereadthreads", &nr_threads);
+	if (nr_threads < 1)
+		nr_threads = online_cpus();
+	if (!HAVE_THREADS)
+		nr_threads = 1;
+	return nr_threads;
+}
+
+/* Append the subtrees of the tree 'desc' points into to 'out'. */
+static void add_subtrees(struct tree_desc desc, struct oid_array *out)
+{
+	struct name_entry entry;
+
+	while (tree_entry_gently(&desc, &entry))
+		if (S_ISDIR(entry.mode))
+			oid_array_append(out, &entry.oid);
+}
+
+static void *tree_prefetch_thread(void *data)
+{
+	struct tree_prefetch *tp = data;
+	struct oid_array todo = OID_ARRAY_INIT;
+
+	trace2_thread_start("tree_prefetch");
+
+	for (;;) {
+		pthread_mutex_lock(&tp->mutex);
+		if (tp->stop || tp->next_task >= tp->tasks.nr) {
+			pthread_mutex_unlock(&tp->mutex);
+			break;
+		}
+		oid_array_append(&todo, &tp->tasks.oid[tp->next_task++]);
+		pthread_mutex_unlock(&tp->mutex);
+
+		/* Read the whole directory, depth first and in tree order. */
+		while (todo.nr) {
+			struct object_id oid = todo.oid[--todo.nr];
+			struct prefetched_tree *t;
+			struct tree_desc desc;
+			unsigned long size;
+			size_t first = todo.nr;
+			void *buf;
+
+			buf = odb_read_object_peeled(tp->repo->objects, &oid,
+						     OBJ_TREE, &size, NULL);
+			if (!buf)
+				continue; /* the traversal will complain */
+			if (init_tree_desc_gently(&desc, &oid, buf, size, 0)) {
+				free(buf);
+				continue;
+			}
+
+			/* Once it is in the map, the traversal may free "buf". */
+			add_subtrees(desc, &todo);
+			for (size_t i = first, j = todo.nr; i + 1 < j; i++, j--)
+				SWAP(todo.oid[i], todo.oid[j - 1]);
+
+			CALLOC_ARRAY(t, 1);
+			oidcpy(&t->entry.oid, &oid);
+			t->buf = buf;
+			t->size = size;
+			pthread_mutex_lock(&tp->mutex);
+			while (tp->bytes && tp->bytes + size > tp->limit &&
+			       !tp->stop)
+				pthread_cond_wait(&tp->room, &tp->mutex);
+			if (tp->stop) {
+				todo.nr = 0;
+			} else if (!oidset_contains(&tp->missed, &oid)) {
+				tp->bytes += size;
+				t = oidmap_put(&tp->trees, t);
+				if (t)
+					tp->bytes -= t->size;
+				if (tp->bytes > tp->max_bytes)
+					tp->max_bytes = tp->bytes;
+			}
+			pthread_mutex_unlock(&tp->mutex);
+			if (t) {
+				free(t->buf);
+				free(t);
+			}
+		}
+	}
+
+	oid_array_clear(&todo);
+	trace2_thread_exit();
+	return NULL;
+}
+
+static void start_tree_prefetch(struct unpack_trees_options *o,
+				unsigned n, struct tree_desc *t)
+{
+	struct repository *r = o->src_index->repo;
+	struct tree_prefetch *tp;
+	struct oidset seen = OIDSET_INIT;
+	size_t nr_tasks = 0;
+	int nr_threads;
+
+	/* Otherwise the traversal may not need all trees. */
+	if (o->src_index->cache_nr || o->pathspec ||
+	    !o->skip_sparse_checkout || o->internal.result.sparse_index)
+		return;
+	/* Workers must not trigger lazy fetches. */
+	if (repo_has_promisor_remote(r))
+		return;
+	nr_threads = tree_read_threads(r);
+	if (nr_threads < 2)
+		return;
+
+	CALLOC_ARRAY(tp, 1);
+	tp->repo = r;
+	tp->nr_threads = nr_threads;
+	oidmap_init(&tp->trees, 0);
+	oidset_init(&tp->missed, 0);
+	if (repo_config_get_ulong(r, "checkout.treereadlimit", &tp->limit))
+		tp->limit = DEFAULT_TREE_READ_LIMIT;
+
+	for (unsigned i = 0; i < n; i++)
+		add_subtrees(t[i], &tp->tasks);
+	for (size_t i = 0; i < tp->tasks.nr; i++)
+		if (!oidset_insert(&seen, &tp->tasks.oid[i]))
+			tp->tasks.oid[nr_tasks++] = tp->tasks.oid[i];
+	tp->tasks.nr = nr_tasks;
+	oidset_clear(&seen);
+
+	trace2_data_intmax("unpack_trees", r, "tree_prefetch/tasks",
+			   tp->tasks.nr);
+	trace2_data_intmax("unpack_trees", r, "tree_prefetch/threads",
+			   nr_threads);
+
+	enable_obj_read_lock();
+	pthread_mutex_init(&tp->mutex, NULL);
+	pthread_cond_init(&tp->room, NULL);
+	CALLOC_ARRAY(tp->threads, nr_threads);
+	for (int i = 0; i < nr_threads; i++) {
+		int err = pthread_create(&tp->threads[i], NULL,
+					 tree_prefetch_thread, tp);
+		if (err)
+			die(_("unable to create tree prefetch thread: %s"),
+			    strerror(err));
+	}
+
+	o->internal.prefetch = tp;
+}
+
+static void free_prefetched_tree(void *e)
+{
+	struct prefetched_tree *t = e;
+
+	free(t->buf);
+	free(t);
+}
+
+static void stop_tree_prefetch(struct unpack_trees_options *o)
+{
+	struct tree_prefetch *tp = o->internal.prefetch;
+
+	if (!tp)
+		return;
+
+	pthread_mutex_lock(&tp->mutex);
+	tp->stop = 1;
+	pthread_cond_broadcast(&tp->room);
+	pthread_mutex_unlock(&tp->mutex);
+	for (int i = 0; i < tp->nr_threads; i++)
+		pthread_join(tp->threads[i], NULL);
+	disable_obj_read_lock();
+
+	trace2_data_intmax("unpack_trees", tp->repo, "tree_prefetch/hits",
+			   tp->hits);
+	trace2_data_intmax("unpack_trees", tp->repo, "tree_prefetch/misses",
+			   tp->misses);
+	trace2_data_intmax("unpack_trees", tp->repo, "tree_prefetch/max_bytes",
+			   tp->max_bytes);
+
+	oidmap_clear_with_free(&tp->trees, free_prefetched_tree);
+	oid_array_clear(&tp->tasks);
+	oidset_clear(&tp->missed);
+	pthread_cond_destroy(&tp->room);
+	pthread_mutex_destroy(&tp->mutex);
+	free(tp->threads);
+	FREE_AND_NULL(o->internal.prefetch);
+}
+
+/*
+ * Like fill_tree_descriptor(), but take the tree from the prefetch
+ * threads if they have read it already.
+ */
+static void *unpack_fill_tree_descriptor(struct unpack_trees_options *o,
+					 struct tree_desc *desc,
+					 const struct object_id *oid)
+{
+	struct tree_prefetch *tp = o->internal.prefetch;
+	struct prefetched_tree *t;
+	void *buf;
+
+	if (!tp || !oid)
+		return fill_tree_descriptor(the_repository, desc, oid);
+
+	pthread_mutex_lock(&tp->mutex);
+	t = oidmap_remove(&tp->trees, oid);
+	if (t) {
+		tp->bytes -= t->size;
+		pthread_cond_broadcast(&tp->room);
+	} else {
+		/* Keep it from being buffered when a worker gets to it. */
+		oidset_insert(&tp->missed, oid);
+	}
+	pthread_mutex_unlock(&tp->mutex);
+	if (!t) {
+		tp->misses++;
+		return fill_tree_descriptor(the_repository, desc, oid);
+	}
+
+	tp->hits++;
+	buf = t->buf;
+	init_tree_desc(desc, oid, buf, t->size);
+	free(t);
+	return buf;
+}
+
 static int traverse_trees_recursive(int n, unsigned long dirmask,
 				    unsigned long df_conflicts,
 				    struct name_entry *names,
@@ -937,7 +1203,7 @@ static int traverse_trees_recursive(int n, unsigned long dirmask,
 			const struct object_id *oid = NULL;
 			if (dirmask & 1)
 				oid = &names[i].oid;
-			buf[nr_buf++] = fill_tree_descriptor(the_repository, t + i, oid);
+			buf[nr_buf++] = unpack_fill_tree_descriptor(o, t + i, oid);
 		}
 	}
 
@@ -2008,7 +2274,9 @@ int unpack_trees(unsigned len, struct tree_desc *t, struct unpack_trees_options
 
 		trace_performance_enter();
 		trace2_region_enter("unpack_trees", "traverse_trees", repo);
+		start_tree_prefetch(o, len, t);
 		ret = traverse_trees(o->src_index, len, t, &info);
+		stop_tree_prefetch(o);
 		trace2_region_leave("unpack_trees", "traverse_trees", repo);
 		trace_performance_leave("traverse_trees");
 		if (ret < 0)
@@ -107,6 +107,7 @@ struct unpack_trees_options {
 
 		struct pattern_list *pl;
 		struct dir_struct *dir;
+		struct tree_prefetch *prefetch;
 	} internal;
 };
 
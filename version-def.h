@@ -0,0 +1,8 @@
+#ifndef VERSION_DEF_H
+#define VERSION_DEF_H
+
+#define GIT_VERSION "2.55.0"
+#define GIT_BUILT_FROM_COMMIT "77586dfea118b3ff8cf7d61616122213bb6bfa67"
+#define GIT_USER_AGENT "git/2.55.0"
+
+#endif /* VERSION_DEF_H */
@@ -249,18 +249,57 @@ int xdl_recmatch(const char *l1, long s1, const char *l2, long s2, long flags)
 	return 1;
 }
 
+/*
+ * Compiler reassociation barrier: pretend to modify X and Y to disallow
+ * changing evaluation order with respect to following uses of X and Y.
+ */
+#ifdef __GNUC__
+#define REASSOC_FENCE(x, y) __asm__("" : "+r"(x), "+r"(y))
+#else
+#define REASSOC_FENCE(x, y)
+#endif
+
+/*
+ * Combine characters C0 and C1 into the djb2 hash HA; see the comment
+ * in xdl_hash_record_verbatim() for why it is written this way.
+ */
+static inline uint64_t xdl_hash_pair(uint64_t ha, uint64_t c0, uint64_t c1)
+{
+	ha *= 33 * 33;
+	c1 += c0;
+	REASSOC_FENCE(c1, c0);
+	c1 += c0 * 32;
+	REASSOC_FENCE(c1, ha);
+	return ha + c1;
+}
+
+/*
+ * This computes the same djb2 hash as xdl_hash_record_verbatim() over
+ * the characters that survive the whitespace rules, so that a line
+ * without any whitespace hashes the same with and without the flags.
+ * Runs of non-whitespace characters, which make up most of a typical
+ * line, are consumed two at a time without looking at the flags.
+ */
 uint64_t xdl_hash_record_with_whitespace(uint8_t const **data,
 		uint8_t const *top, uint64_t flags) {
 	uint64_t ha = 5381;
 	uint8_t const *ptr = *data;
 	bool cr_at_eol_only = (flags & XDF_WHITESPACE_FLAGS) == XDF_IGNORE_CR_AT_EOL;
 
-	for (; ptr < top && *ptr != '\n'; ptr++) {
+	while (ptr < top && *ptr != '\n') {
+		if (top - ptr >= 2 &&
+		    !XDL_ISSPACE(ptr[0]) && !XDL_ISSPACE(ptr[1])) {
+			ha = xdl_hash_pair(ha, ptr[0], ptr[1]);
+			ptr += 2;
+			continue;
+		}
 		if (cr_at_eol_only) {
 			/* do not ignore CR at the end of an incomplete line */
 			if (*ptr == '\r' &&
-			    (ptr + 1 < top && ptr[1] == '\n'))
+			    (ptr + 1 < top && ptr[1] == '\n')) {
+				ptr++;
 				continue;
+			}
 		}
 		else if (XDL_ISSPACE(*ptr)) {
 			const uint8_t *ptr2 = ptr;
@@ -274,43 +313,35 @@ uint64_t xdl_hash_record_with_whitespace(uint8_t const **data,
 			else if (flags & XDF_IGNORE_WHITESPACE_CHANGE
 				 && !at_eol) {
 				ha += (ha << 5);
-				ha ^= (uint64_t) ' ';
+				ha += (uint64_t) ' ';
 			}
 			else if (flags & XDF_IGNORE_WHITESPACE_AT_EOL
 				 && !at_eol) {
 				while (ptr2 != ptr + 1) {
 					ha += (ha << 5);
-					ha ^= (uint64_t) *ptr2;
+					ha += (uint64_t) *ptr2;
 					ptr2++;
 				}
 			}
+			ptr++;
 			continue;
 		}
 		ha += (ha << 5);
-		ha ^= (uint64_t) *ptr;
+		ha += (uint64_t) *ptr;
+		ptr++;
 	}
 	*data = ptr < top ? ptr + 1: ptr;
 
 	return ha;
 }
 
-/*
- * Compiler reassociation barrier: pretend to modify X and Y to disallow
- * changing evaluation order with respect to following uses of X and Y.
- */
-#ifdef __GNUC__
-#define REASSOC_FENCE(x, y) __asm__("" : "+r"(x), "+r"(y))
-#else
-#define REASSOC_FENCE(x, y)
-#endif
-
 uint64_t xdl_hash_record_verbatim(uint8_t const **data, uint8_t const *top) {
 	uint64_t ha = 5381, c0, c1;
 	uint8_t const *ptr = *data;
 #if 0
 	/*
 	 * The baseline form of the optimized loop below. This is the djb2
-	 * hash (the above function uses a variant with XOR instead of ADD).
+	 * hash, which xdl_hash_record_with_whitespace() uses as well.
 	 */
 	for (; ptr < top && *ptr != '\n'; ptr++) {
 		ha += (ha << 5);